@@ -58,14 +58,16 @@ int main(int argc, char** argv) {
             "-fdata-sections",
             "-ffunction-sections",
             "-Wl,--gc-sections",
-            "-s"
+            "-s",
+            "-pthread"
         );
     } else {
         nob_cmd_append(&cmd,
             "gcc",
             "source/main.c",
             "-o", "mewo",
-            "-g"
+            "-g",
+            "-pthread"
         );
     }
     
@@ -0,0 +1,557 @@
+/*
+ * builtins.c - In-process versions of trivial shell commands for Mewo
+ *
+ * Features:
+ *   - echo, mkdir [-p], rm [-rf], cp [-r], touch run without fork/exec
+ *   - Only used for simple command lines: plain words and quotes, no
+ *     variables, globs, redirections, pipes or escapes
+ *   - Same exit codes and coreutils-style error messages as the tools
+ *   - Anything unusual (unknown options, interactive rm) falls back to
+ *     the external command, decided before anything is echoed or done;
+ *     #external, #timeout or --no-builtins force it
+ *   - Resource usage is that of mewo's own thread; #perfstat counts
+ *     mewo too, so both cover builtins
+ *   - Unix only; Windows always runs the external command
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - str_dup() from error.c
+ *   - nob.h utilities
+ */
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#define BUILTIN_MAX_ARGS 256
+
+static bool g_builtins_enabled = true;
+
+void builtins_set_enabled(bool enabled) {
+    g_builtins_enabled = enabled;
+}
+
+typedef struct {
+    char* items[BUILTIN_MAX_ARGS];
+    size_t count;
+} BuiltinArgs;
+
+static void builtin_args_free(BuiltinArgs* args) {
+    for (size_t i = 0; i < args->count; i++) {
+        free(args->items[i]);
+    }
+    args->count = 0;
+}
+
+static bool builtin_is_meta(char c) {
+    return strchr("|&;<>()$`\\\"'*?[]{}~#!=\n", c) != NULL;
+}
+
+/*
+ * Split a command line into words the way /bin/sh would, but only if
+ * doing so needs no expansion at all. Returns false otherwise.
+ */
+static bool builtin_split(const char* cmd, BuiltinArgs* args) {
+    args->count = 0;
+    const char* p = cmd;
+
+    while (*p) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+        if (args->count >= BUILTIN_MAX_ARGS) goto fail;
+
+        InterpBuilder word;
+        ib_init(&word);
+        bool quoted = false;
+
+        while (*p && *p != ' ' && *p != '\t') {
+            if (*p == '\'') {
+                const char* end = strchr(p + 1, '\'');
+                if (!end) goto fail_word;
+                for (const char* c = p + 1; c < end; c++) {
+                    if (*c == '\\') goto fail_word;
+                }
+                ib_append_strn(&word, p + 1, end - p - 1);
+                quoted = true;
+                p = end + 1;
+            } else if (*p == '"') {
+                const char* end = p + 1;
+                while (*end && *end != '"') {
+                    if (*end == '$' || *end == '`' || *end == '\\' || *end == '!') goto fail_word;
+                    end++;
+                }
+                if (*end != '"') goto fail_word;
+                ib_append_strn(&word, p + 1, end - p - 1);
+                quoted = true;
+                p = end + 1;
+            } else if (builtin_is_meta(*p)) {
+                goto fail_word;
+            } else {
+                ib_append_char(&word, *p);
+                p++;
+            }
+        }
+
+        if (word.len == 0 && !quoted) {
+            ib_free(&word);
+            continue;
+        }
+        args->items[args->count++] = ib_take(&word);
+        continue;
+
+    fail_word:
+        ib_free(&word);
+        goto fail;
+    }
+
+    return args->count > 0;
+
+fail:
+    builtin_args_free(args);
+    return false;
+}
+
+/*
+ * Builtins replace what /bin/sh would run, so only use them when the
+ * command would go to a POSIX shell.
+ */
+bool builtin_shell_compatible(const char* shell) {
+#ifdef _WIN32
+    (void)shell;
+    return false;
+#else
+    if (!shell) return true;
+    const char* base = strrchr(shell, '/');
+    base = base ? base + 1 : shell;
+    return strcmp(base, "sh") == 0 || strcmp(base, "bash") == 0 || strcmp(base, "dash") == 0;
+#endif
+}
+
+#ifndef _WIN32
+
+static void builtin_error(const char* tool, const char* what, const char* path, int err) {
+    fprintf(stderr, "%s: %s '%s': %s\n", tool, what, path, strerror(err));
+}
+
+typedef struct {
+    size_t first;       /* index of the first operand */
+    bool no_newline;    /* echo -n */
+    bool parents;       /* mkdir -p */
+    bool recursive;     /* rm -r, cp -r */
+    bool force;         /* rm -f */
+} BuiltinOpts;
+
+/*
+ * Parse the options of builtin `name`. Returns false if the command line
+ * has to go to the real tool; nothing has been printed or done by then.
+ */
+static bool builtin_parse(const char* name, BuiltinArgs* args, BuiltinOpts* opts) {
+    memset(opts, 0, sizeof(*opts));
+    size_t i = 1;
+
+    if (strcmp(name, "echo") == 0) {
+        if (i < args->count && strcmp(args->items[i], "-n") == 0) {
+            opts->no_newline = true;
+            i++;
+        }
+        /* -e, -E and the like change what is printed */
+        if (i < args->count && args->items[i][0] == '-' && args->items[i][1] != '\0') return false;
+    } else if (strcmp(name, "mkdir") == 0) {
+        if (i < args->count && strcmp(args->items[i], "-p") == 0) {
+            opts->parents = true;
+            i++;
+        }
+        if (i < args->count && strcmp(args->items[i], "--") == 0) i++;
+        for (size_t j = i; j < args->count; j++) {
+            if (args->items[j][0] == '-') return false;
+        }
+        if (i >= args->count) return false;
+    } else if (strcmp(name, "rm") == 0) {
+        for (; i < args->count && args->items[i][0] == '-' && args->items[i][1] != '\0'; i++) {
+            const char* opt = args->items[i];
+            if (strcmp(opt, "--") == 0) {
+                i++;
+                break;
+            }
+            for (const char* c = opt + 1; *c; c++) {
+                if (*c == 'r' || *c == 'R') opts->recursive = true;
+                else if (*c == 'f') opts->force = true;
+                else return false;
+            }
+        }
+        /* Without -f, rm may prompt on a terminal; leave that to the real tool */
+        if (!opts->force && isatty(STDIN_FILENO)) return false;
+        if (i >= args->count && !opts->force) return false;
+    } else if (strcmp(name, "cp") == 0) {
+        for (; i < args->count && args->items[i][0] == '-' && args->items[i][1] != '\0'; i++) {
+            const char* opt = args->items[i];
+            if (strcmp(opt, "--") == 0) {
+                i++;
+                break;
+            }
+            if (strcmp(opt, "-r") == 0 || strcmp(opt, "-R") == 0) opts->recursive = true;
+            else return false;
+        }
+        if (args->count - i < 2) return false;
+    } else if (strcmp(name, "touch") == 0) {
+        if (args->count < 2) return false;
+        for (size_t j = i; j < args->count; j++) {
+            if (args->items[j][0] == '-') return false;
+        }
+    } else {
+        return false;
+    }
+
+    opts->first = i;
+    return true;
+}
+
+static int builtin_echo(BuiltinArgs* args, const BuiltinOpts* opts) {
+    for (size_t i = opts->first; i < args->count; i++) {
+        if (i > opts->first) fputc(' ', stdout);
+        fputs(args->items[i], stdout);
+    }
+    if (!opts->no_newline) fputc('\n', stdout);
+    fflush(stdout);
+    return 0;
+}
+
+static bool builtin_mkdir_parents(const char* path) {
+    char* buf = str_dup(path);
+    size_t len = strlen(buf);
+    bool ok = true;
+
+    for (size_t i = 1; i <= len && ok; i++) {
+        if (buf[i] != '/' && buf[i] != '\0') continue;
+        char saved = buf[i];
+        buf[i] = '\0';
+        if (mkdir(buf, 0777) < 0 && errno != EEXIST) {
+            ok = false;
+        } else if (saved == '\0') {
+            struct stat st;
+            if (stat(buf, &st) < 0 || !S_ISDIR(st.st_mode)) {
+                errno = EEXIST;
+                ok = false;
+            }
+        }
+        buf[i] = saved;
+    }
+
+    free(buf);
+    return ok;
+}
+
+static int builtin_mkdir(BuiltinArgs* args, const BuiltinOpts* opts) {
+    int status = 0;
+    for (size_t i = opts->first; i < args->count; i++) {
+        const char* path = args->items[i];
+        bool ok = opts->parents ? builtin_mkdir_parents(path) : mkdir(path, 0777) == 0;
+        if (!ok) {
+            builtin_error("mkdir", "cannot create directory", path, errno);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+static bool builtin_remove_tree(const char* path) {
+    struct stat st;
+    if (lstat(path, &st) < 0) return false;
+
+    if (S_ISDIR(st.st_mode)) {
+        DIR* dir = opendir(path);
+        if (!dir) return false;
+
+        bool ok = true;
+        struct dirent* ent;
+        while ((ent = readdir(dir))) {
+            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+            char* child = temp_sprintf("%s/%s", path, ent->d_name);
+            size_t mark = temp_save();
+            if (!builtin_remove_tree(child)) {
+                builtin_error("rm", "cannot remove", child, errno);
+                ok = false;
+            }
+            temp_rewind(mark);
+        }
+        closedir(dir);
+
+        if (!ok) {
+            errno = ENOTEMPTY;
+            return false;
+        }
+        return rmdir(path) == 0;
+    }
+
+    return unlink(path) == 0;
+}
+
+static int builtin_rm(BuiltinArgs* args, const BuiltinOpts* opts) {
+    int status = 0;
+    for (size_t i = opts->first; i < args->count; i++) {
+        const char* path = args->items[i];
+        const char* base = strrchr(path, '/');
+        base = base && base[1] ? base + 1 : path;
+
+        if (strcmp(base, ".") == 0 || strcmp(base, "..") == 0) {
+            fprintf(stderr, "rm: refusing to remove '.' or '..' directory: skipping '%s'\n", path);
+            status = 1;
+            continue;
+        }
+        if (strcmp(path, "/") == 0) {
+            fprintf(stderr, "rm: it is dangerous to operate recursively on '/'\n");
+            status = 1;
+            continue;
+        }
+
+        struct stat st;
+        if (lstat(path, &st) < 0) {
+            if (!(opts->force && errno == ENOENT)) {
+                builtin_error("rm", "cannot remove", path, errno);
+                status = 1;
+            }
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode) && !opts->recursive) {
+            builtin_error("rm", "cannot remove", path, EISDIR);
+            status = 1;
+            continue;
+        }
+
+        if (!builtin_remove_tree(path)) {
+            builtin_error("rm", "cannot remove", path, errno);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+static bool builtin_copy_file(const char* src, const char* dst, mode_t mode) {
+    int in = open(src, O_RDONLY);
+    if (in < 0) return false;
+
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, mode & 0777);
+    if (out < 0) {
+        int err = errno;
+        close(in);
+        errno = err;
+        return false;
+    }
+
+    char buf[64 * 1024];
+    bool ok = true;
+    for (;;) {
+        ssize_t n = read(in, buf, sizeof(buf));
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        for (ssize_t off = 0; off < n;) {
+            ssize_t w = write(out, buf + off, n - off);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                ok = false;
+                break;
+            }
+            off += w;
+        }
+        if (!ok) break;
+    }
+
+    int err = errno;
+    close(in);
+    if (close(out) < 0 && ok) {
+        err = errno;
+        ok = false;
+    }
+    errno = err;
+    return ok;
+}
+
+static bool builtin_copy_tree(const char* src, const char* dst, bool recursive, bool top) {
+    struct stat st;
+    if ((recursive ? lstat(src, &st) : stat(src, &st)) < 0) {
+        builtin_error("cp", "cannot stat", src, errno);
+        return false;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        if (!recursive) {
+            fprintf(stderr, "cp: -r not specified; omitting directory '%s'\n", src);
+            return false;
+        }
+
+        if (mkdir(dst, st.st_mode & 0777) < 0 && errno != EEXIST) {
+            builtin_error("cp", "cannot create directory", dst, errno);
+            return false;
+        }
+
+        DIR* dir = opendir(src);
+        if (!dir) {
+            builtin_error("cp", "cannot access", src, errno);
+            return false;
+        }
+
+        bool ok = true;
+        struct dirent* ent;
+        while ((ent = readdir(dir))) {
+            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+            size_t mark = temp_save();
+            char* child_src = temp_sprintf("%s/%s", src, ent->d_name);
+            char* child_dst = temp_sprintf("%s/%s", dst, ent->d_name);
+            if (!builtin_copy_tree(child_src, child_dst, recursive, false)) ok = false;
+            temp_rewind(mark);
+        }
+        closedir(dir);
+        return ok;
+    }
+
+    if (S_ISLNK(st.st_mode)) {
+        char target[4096];
+        ssize_t n = readlink(src, target, sizeof(target) - 1);
+        if (n < 0) {
+            builtin_error("cp", "cannot read symbolic link", src, errno);
+            return false;
+        }
+        target[n] = '\0';
+        unlink(dst);
+        if (symlink(target, dst) < 0) {
+            builtin_error("cp", "cannot create symbolic link", dst, errno);
+            return false;
+        }
+        return true;
+    }
+
+    struct stat dst_st;
+    if (top && stat(dst, &dst_st) == 0 && dst_st.st_dev == st.st_dev && dst_st.st_ino == st.st_ino) {
+        fprintf(stderr, "cp: '%s' and '%s' are the same file\n", src, dst);
+        return false;
+    }
+
+    if (!builtin_copy_file(src, dst, st.st_mode)) {
+        builtin_error("cp", "cannot create regular file", dst, errno);
+        return false;
+    }
+    return true;
+}
+
+static int builtin_cp(BuiltinArgs* args, const BuiltinOpts* opts) {
+    size_t i = opts->first;
+    bool recursive = opts->recursive;
+    const char* dst = args->items[args->count - 1];
+    struct stat dst_st;
+    bool dst_is_dir = stat(dst, &dst_st) == 0 && S_ISDIR(dst_st.st_mode);
+    size_t src_count = args->count - 1 - i;
+
+    if (src_count > 1 && !dst_is_dir) {
+        fprintf(stderr, "cp: target '%s' is not a directory\n", dst);
+        return 1;
+    }
+
+    int status = 0;
+    for (; i < args->count - 1; i++) {
+        const char* src = args->items[i];
+        size_t mark = temp_save();
+        const char* target = dst;
+        if (dst_is_dir) {
+            size_t len = strlen(src);
+            while (len > 1 && src[len - 1] == '/') len--;
+            const char* base = src + len;
+            while (base > src && base[-1] != '/') base--;
+            target = temp_sprintf("%s/%.*s", dst, (int)(src + len - base), base);
+        }
+
+        if (recursive) {
+            size_t src_len = strlen(src);
+            if (strncmp(target, src, src_len) == 0 && target[src_len] == '/') {
+                fprintf(stderr, "cp: cannot copy a directory, '%s', into itself, '%s'\n", src, target);
+                status = 1;
+                temp_rewind(mark);
+                continue;
+            }
+        }
+
+        if (!builtin_copy_tree(src, target, recursive, true)) status = 1;
+        temp_rewind(mark);
+    }
+    return status;
+}
+
+static int builtin_touch(BuiltinArgs* args, const BuiltinOpts* opts) {
+    int status = 0;
+    for (size_t i = opts->first; i < args->count; i++) {
+        const char* path = args->items[i];
+        if (utimensat(AT_FDCWD, path, NULL, 0) == 0) continue;
+        if (errno != ENOENT) {
+            builtin_error("touch", "cannot touch", path, errno);
+            status = 1;
+            continue;
+        }
+
+        int fd = open(path, O_WRONLY | O_CREAT | O_NONBLOCK | O_NOCTTY, 0666);
+        if (fd < 0) {
+            builtin_error("touch", "cannot touch", path, errno);
+            status = 1;
+            continue;
+        }
+        close(fd);
+    }
+    return status;
+}
+
+#endif
+
+/*
+ * Try to run `cmd` in-process.
+ *
+ * Returns:
+ *   true if the command was handled, with its exit status in *exit_code;
+ *   false if it has to be run by the shell.
+ */
+bool builtin_run(const char* cmd, bool echo, int* exit_code) {
+#ifdef _WIN32
+    (void)cmd;
+    (void)echo;
+    (void)exit_code;
+    return false;
+#else
+    if (!g_builtins_enabled) return false;
+
+    BuiltinArgs args;
+    if (!builtin_split(cmd, &args)) return false;
+
+    const char* name = args.items[0];
+    BuiltinOpts opts;
+    if (!builtin_parse(name, &args, &opts)) {
+        builtin_args_free(&args);
+        return false;
+    }
+
+    if (echo) {
+        printf("%s\n", cmd);
+        fflush(stdout);
+    }
+
+    int status;
+    if (strcmp(name, "echo") == 0) status = builtin_echo(&args, &opts);
+    else if (strcmp(name, "mkdir") == 0) status = builtin_mkdir(&args, &opts);
+    else if (strcmp(name, "rm") == 0) status = builtin_rm(&args, &opts);
+    else if (strcmp(name, "cp") == 0) status = builtin_cp(&args, &opts);
+    else status = builtin_touch(&args, &opts);
+
+    builtin_args_free(&args);
+
+    nob_log(NOB_INFO, "BUILTIN: %s", cmd);
+    fflush(stderr);
+    *exit_code = status;
+    return true;
+#endif
+}
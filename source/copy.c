@@ -0,0 +1,447 @@
+/*
+ * copy.c - Fast file and tree copying for Mewo (#copy / #install)
+ *
+ * Features:
+ *   - Reflink (FICLONE) first, then copy_file_range, then sendfile,
+ *     then a plain buffered read/write loop
+ *   - Directory trees are copied by a pool of worker threads, as many
+ *     as -j allows; their log lines are serialized
+ *   - Files whose size and mtime already match are skipped; copies get
+ *     the source mtime so the next run can skip them too
+ *   - Installs write to a temp file, set the mode and rename into place
+ *     atomically, so readers never see a half-written file
+ *   - Windows falls back to nob_copy_file, sequentially
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - str_dup() from error.c
+ *   - nob.h utilities
+ */
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#endif
+#ifdef __APPLE__
+#define st_atim st_atimespec
+#define st_mtim st_mtimespec
+#endif
+#endif
+
+#define COPY_MAX_THREADS 16
+#define COPY_BUFFER_SIZE (128 * 1024)
+
+typedef struct {
+    bool atomic;
+    int mode;           /* -1 keeps the source mode */
+} CopyOpts;
+
+typedef struct {
+    size_t copied;
+    size_t skipped;
+    size_t reflinked;
+    uint64_t bytes;
+} CopyStats;
+
+typedef struct {
+    char* src;
+    char* dst;
+} CopyPair;
+
+typedef struct {
+    CopyPair* items;
+    size_t count;
+    size_t capacity;
+
+    const CopyOpts* opts;
+    CopyStats stats;
+    bool ok;
+    size_t next;
+#ifndef _WIN32
+    pthread_mutex_t lock;
+#endif
+} CopyQueue;
+
+static void copy_queue_push(CopyQueue* q, const char* src, const char* dst) {
+    if (q->count >= q->capacity) {
+        size_t new_cap = q->capacity == 0 ? 64 : q->capacity * 2;
+        CopyPair* new_items = realloc(q->items, new_cap * sizeof(CopyPair));
+        if (!new_items) return;
+        q->items = new_items;
+        q->capacity = new_cap;
+    }
+    q->items[q->count].src = str_dup(src);
+    q->items[q->count].dst = str_dup(dst);
+    q->count++;
+}
+
+static void copy_queue_free(CopyQueue* q) {
+    for (size_t i = 0; i < q->count; i++) {
+        free(q->items[i].src);
+        free(q->items[i].dst);
+    }
+    free(q->items);
+    q->items = NULL;
+    q->count = 0;
+    q->capacity = 0;
+}
+
+#ifdef _WIN32
+
+static bool copy_one_file(const char* src, const char* dst, const CopyOpts* opts, CopyStats* stats) {
+    (void)opts;
+    if (!nob_copy_file(src, dst)) return false;
+    stats->copied++;
+    return true;
+}
+
+#else
+
+static pthread_mutex_t g_copy_log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * nob_log() from a worker thread: the log handler also feeds the event
+ * stream, which is not thread-safe, so one line at a time.
+ */
+static void copy_log(Nob_Log_Level level, const char* fmt, ...) {
+    char message[1024];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+
+    pthread_mutex_lock(&g_copy_log_lock);
+    nob_log(level, "%s", message);
+    pthread_mutex_unlock(&g_copy_log_lock);
+}
+
+/*
+ * Move the bytes of `in` into `out` with the cheapest mechanism the
+ * kernel supports for this pair of files.
+ */
+static bool copy_fd_data(int in, int out, off_t size, CopyStats* stats) {
+    off_t done = 0;
+
+#ifdef __linux__
+#ifdef FICLONE
+    if (ioctl(out, FICLONE, in) == 0) {
+        stats->reflinked++;
+        return true;
+    }
+#endif
+
+#ifdef SYS_copy_file_range
+    while (done < size) {
+        off_t off = done;
+        ssize_t n = syscall(SYS_copy_file_range, in, &off, out, NULL, (size_t)(size - done), 0);
+        if (n > 0) {
+            done += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        break;
+    }
+#endif
+
+    while (done < size) {
+        ssize_t n = sendfile(out, in, &done, (size_t)(size - done));
+        if (n > 0) continue;
+        if (n < 0 && errno == EINTR) continue;
+        break;
+    }
+
+    if (done > 0 && lseek(out, done, SEEK_SET) < 0) return false;
+#endif
+
+    /* On the heap: worker threads get small stacks on some libcs (128 KiB on musl) */
+    char* buf = malloc(COPY_BUFFER_SIZE);
+    if (!buf) return false;
+    bool ok = true;
+    while (ok) {
+        ssize_t n = pread(in, buf, COPY_BUFFER_SIZE, done);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        for (ssize_t off = 0; off < n;) {
+            ssize_t w = write(out, buf + off, (size_t)(n - off));
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                ok = false;
+                break;
+            }
+            off += w;
+        }
+        done += n;
+    }
+    int err = errno;
+    free(buf);
+    errno = err;
+    return ok;
+}
+
+static bool copy_one_file(const char* src, const char* dst, const CopyOpts* opts, CopyStats* stats) {
+    struct stat src_st;
+    if (stat(src, &src_st) < 0) {
+        copy_log(NOB_ERROR, "Could not stat %s: %s", src, strerror(errno));
+        return false;
+    }
+
+    mode_t mode = opts->mode >= 0 ? (mode_t)opts->mode : (src_st.st_mode & 07777);
+
+    struct stat dst_st;
+    if (stat(dst, &dst_st) == 0 &&
+        S_ISREG(dst_st.st_mode) &&
+        dst_st.st_size == src_st.st_size &&
+        dst_st.st_mtim.tv_sec == src_st.st_mtim.tv_sec &&
+        dst_st.st_mtim.tv_nsec == src_st.st_mtim.tv_nsec &&
+        (opts->mode < 0 || (dst_st.st_mode & 07777) == mode)) {
+        stats->skipped++;
+        return true;
+    }
+
+    int in = open(src, O_RDONLY);
+    if (in < 0) {
+        copy_log(NOB_ERROR, "Could not open %s: %s", src, strerror(errno));
+        return false;
+    }
+
+    char* tmp_path = NULL;
+    int out;
+    if (opts->atomic) {
+        tmp_path = malloc(strlen(dst) + 32);
+        sprintf(tmp_path, "%s.mewo-XXXXXX", dst);
+        out = mkstemp(tmp_path);
+    } else {
+        out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, mode);
+    }
+    if (out < 0) {
+        copy_log(NOB_ERROR, "Could not create %s: %s", tmp_path ? tmp_path : dst, strerror(errno));
+        close(in);
+        free(tmp_path);
+        return false;
+    }
+
+    bool ok = copy_fd_data(in, out, src_st.st_size, stats);
+    if (!ok) copy_log(NOB_ERROR, "Could not copy %s to %s: %s", src, dst, strerror(errno));
+
+    if (ok && (opts->atomic || opts->mode >= 0)) {
+        ok = fchmod(out, mode) == 0;
+        if (!ok) copy_log(NOB_ERROR, "Could not set mode of %s: %s", dst, strerror(errno));
+    }
+
+    if (ok) {
+        struct timespec times[2] = { src_st.st_atim, src_st.st_mtim };
+        futimens(out, times);
+    }
+
+    close(in);
+    if (close(out) < 0 && ok) {
+        copy_log(NOB_ERROR, "Could not write %s: %s", dst, strerror(errno));
+        ok = false;
+    }
+
+    if (tmp_path) {
+        if (ok && rename(tmp_path, dst) < 0) {
+            copy_log(NOB_ERROR, "Could not rename %s to %s: %s", tmp_path, dst, strerror(errno));
+            ok = false;
+        }
+        if (!ok) unlink(tmp_path);
+        free(tmp_path);
+    }
+
+    if (ok) {
+        stats->copied++;
+        stats->bytes += (uint64_t)src_st.st_size;
+    }
+    return ok;
+}
+
+static void* copy_worker(void* arg) {
+    CopyQueue* q = arg;
+    CopyStats local = {0};
+    bool ok = true;
+
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        size_t i = q->next++;
+        pthread_mutex_unlock(&q->lock);
+        if (i >= q->count) break;
+
+        if (!copy_one_file(q->items[i].src, q->items[i].dst, q->opts, &local)) ok = false;
+    }
+
+    pthread_mutex_lock(&q->lock);
+    q->stats.copied += local.copied;
+    q->stats.skipped += local.skipped;
+    q->stats.reflinked += local.reflinked;
+    q->stats.bytes += local.bytes;
+    if (!ok) q->ok = false;
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+#endif
+
+/*
+ * Create the directory skeleton of `src` under `dst` and queue every
+ * file for copying. Symlinks are copied as links.
+ */
+static bool copy_collect(CopyQueue* q, const char* src, const char* dst) {
+    Nob_File_Type type = nob_get_file_type(src);
+    if (type < 0) return false;
+
+    if (type == NOB_FILE_DIRECTORY) {
+        if (!mkdir_if_not_exists(dst)) return false;
+
+        Nob_File_Paths children = {0};
+        if (!nob_read_entire_dir(src, &children)) return false;
+
+        bool ok = true;
+        for (size_t i = 0; i < children.count && ok; i++) {
+            const char* name = children.items[i];
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+            size_t mark = temp_save();
+            ok = copy_collect(q, temp_sprintf("%s/%s", src, name), temp_sprintf("%s/%s", dst, name));
+            temp_rewind(mark);
+        }
+        nob_da_free(children);
+        return ok;
+    }
+
+#ifndef _WIN32
+    if (type == NOB_FILE_SYMLINK) {
+        char target[4096];
+        ssize_t n = readlink(src, target, sizeof(target) - 1);
+        if (n < 0) {
+            nob_log(NOB_ERROR, "Could not read link %s: %s", src, strerror(errno));
+            return false;
+        }
+        target[n] = '\0';
+
+        char existing[4096];
+        ssize_t m = readlink(dst, existing, sizeof(existing) - 1);
+        if (m == n && memcmp(existing, target, (size_t)n) == 0) {
+            q->stats.skipped++;
+            return true;
+        }
+
+        unlink(dst);
+        if (symlink(target, dst) < 0) {
+            nob_log(NOB_ERROR, "Could not create link %s: %s", dst, strerror(errno));
+            return false;
+        }
+        q->stats.copied++;
+        return true;
+    }
+#endif
+
+    copy_queue_push(q, src, dst);
+    return true;
+}
+
+static bool copy_run_queue(CopyQueue* q, size_t max_threads) {
+    q->ok = true;
+
+#ifdef _WIN32
+    (void)max_threads;
+    for (size_t i = 0; i < q->count; i++) {
+        if (!copy_one_file(q->items[i].src, q->items[i].dst, q->opts, &q->stats)) q->ok = false;
+    }
+#else
+    size_t threads = max_threads > 0 ? max_threads : (size_t)nob_nprocs();
+    if (threads > COPY_MAX_THREADS) threads = COPY_MAX_THREADS;
+    if (threads > q->count) threads = q->count;
+
+    if (threads <= 1) {
+        for (size_t i = 0; i < q->count; i++) {
+            if (!copy_one_file(q->items[i].src, q->items[i].dst, q->opts, &q->stats)) q->ok = false;
+        }
+        return q->ok;
+    }
+
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_t tids[COPY_MAX_THREADS];
+    size_t started = 0;
+    for (size_t t = 0; t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, copy_worker, q) != 0) break;
+        started++;
+    }
+    if (started == 0) copy_worker(q);
+    for (size_t t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    pthread_mutex_destroy(&q->lock);
+#endif
+
+    return q->ok;
+}
+
+static bool copy_mkdir_parents(const char* path) {
+    char* dir = str_dup(path);
+    bool ok = true;
+    for (char* p = dir + 1; *p && ok; p++) {
+        if (*p != '/' && *p != '\\') continue;
+        char saved = *p;
+        *p = '\0';
+        if (!nob_file_exists(dir)) ok = mkdir_if_not_exists(dir);
+        *p = saved;
+    }
+    free(dir);
+    return ok;
+}
+
+/*
+ * Copy a file or directory tree from `src` to `dst`.
+ *
+ * If `dst` is an existing directory (or ends with '/'), the source is
+ * copied into it under its own name.
+ */
+bool copy_path(const char* src, const char* dst, const CopyOpts* opts, size_t max_threads, CopyStats* stats) {
+    if (!nob_file_exists(src)) {
+        nob_log(NOB_ERROR, "Copy source %s does not exist", src);
+        return false;
+    }
+
+    size_t src_len = strlen(src);
+    while (src_len > 1 && (src[src_len - 1] == '/' || src[src_len - 1] == '\\')) src_len--;
+    src = temp_sprintf("%.*s", (int)src_len, src);
+
+    size_t dst_len = strlen(dst);
+    bool into_dir = (dst_len > 0 && (dst[dst_len - 1] == '/' || dst[dst_len - 1] == '\\')) ||
+                    (nob_file_exists(dst) && nob_get_file_type(dst) == NOB_FILE_DIRECTORY);
+    const char* target = dst;
+    if (into_dir) {
+        if (!mkdir_if_not_exists(dst)) return false;
+        while (dst_len > 1 && (dst[dst_len - 1] == '/' || dst[dst_len - 1] == '\\')) dst_len--;
+        target = temp_sprintf("%.*s/%s", (int)dst_len, dst, nob_path_name(src));
+    }
+
+    if (!copy_mkdir_parents(target)) return false;
+
+    CopyQueue q = {0};
+    q.opts = opts;
+    bool ok = copy_collect(&q, src, target);
+    if (ok) ok = copy_run_queue(&q, max_threads);
+
+    stats->copied += q.stats.copied;
+    stats->skipped += q.stats.skipped;
+    stats->reflinked += q.stats.reflinked;
+    stats->bytes += q.stats.bytes;
+
+    copy_queue_free(&q);
+    return ok;
+}
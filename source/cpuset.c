@@ -0,0 +1,243 @@
+/*
+ * cpuset.c - CPU affinity and NUMA placement for Mewo (#cpuset(0-7))
+ *
+ * Features:
+ *   - CPU lists in the kernel's format ("0-7,16,18-19")
+ *   - Pins a command or label to a list: the calling thread's affinity is
+ *     set before anything is spawned and restored afterwards, so the
+ *     children inherit it; when the CPUs all sit on one NUMA node, memory
+ *     is preferably allocated there too
+ *   - Exclusive sets take a lock per CPU (a private pool in pool.c), so
+ *     two exclusive labels never share a core, even across mewo processes
+ *   - Leaving a scope restores the affinity and memory policy it found
+ *   - --numa-spread places parallel jobs on the NUMA nodes round-robin
+ *   - No-op outside Linux
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - nob.h utilities
+ *   - pool_declare_private(), pool_acquire(), pool_release() from pool.c
+ */
+
+#define CPUSET_MAX 1024
+#define CPUSET_MAX_NODES 1024   /* the kernel's MAX_NUMNODES can't be larger */
+#define CPUSET_WORD_BITS (8 * sizeof(unsigned long))
+
+/* Laid out like the kernel's affinity masks */
+typedef struct {
+    unsigned long bits[CPUSET_MAX / CPUSET_WORD_BITS];
+} CpuMask;
+
+static inline bool cpu_mask_has(const CpuMask* mask, size_t cpu) {
+    return cpu < CPUSET_MAX && (mask->bits[cpu / CPUSET_WORD_BITS] >> (cpu % CPUSET_WORD_BITS)) & 1;
+}
+
+static inline void cpu_mask_add(CpuMask* mask, size_t cpu) {
+    if (cpu < CPUSET_MAX) mask->bits[cpu / CPUSET_WORD_BITS] |= 1UL << (cpu % CPUSET_WORD_BITS);
+}
+
+/*
+ * Parse a CPU list like "0-7,16". False if it is malformed or empty.
+ */
+bool cpuset_parse(const char* list, CpuMask* out) {
+    memset(out, 0, sizeof(*out));
+    const char* p = list;
+    bool any = false;
+
+    while (*p) {
+        while (*p == ' ' || *p == ',') p++;
+        if (!*p || *p == '\n') break;
+
+        char* end = NULL;
+        unsigned long first = strtoul(p, &end, 10);
+        if (end == p) return false;
+        unsigned long last = first;
+        p = end;
+        if (*p == '-') {
+            p++;
+            last = strtoul(p, &end, 10);
+            if (end == p || last < first) return false;
+            p = end;
+        }
+        if (last >= CPUSET_MAX) return false;
+
+        for (unsigned long cpu = first; cpu <= last; cpu++) cpu_mask_add(out, cpu);
+        any = true;
+        if (*p && *p != ',' && *p != ' ' && *p != '\n') return false;
+    }
+    return any;
+}
+
+typedef struct {
+    bool active;
+    CpuMask exclusive;      /* CPUs locked for this scope */
+    int slots[CPUSET_MAX];
+    CpuMask saved;
+    bool policy_saved;
+    int saved_policy;       /* mode of the memory policy found, with its flags */
+    unsigned long saved_nodes[CPUSET_MAX_NODES / CPUSET_WORD_BITS];
+} CpusetScope;
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/* Raw syscalls: the libc wrappers and cpu_set_t need _GNU_SOURCE */
+static bool cpuset_get_affinity(CpuMask* mask) {
+    memset(mask, 0, sizeof(*mask));
+    return syscall(SYS_sched_getaffinity, 0, sizeof(mask->bits), mask->bits) > 0;
+}
+
+static bool cpuset_set_affinity(const CpuMask* mask) {
+    return syscall(SYS_sched_setaffinity, 0, sizeof(mask->bits), mask->bits) == 0;
+}
+
+/* Kernel ABI of set_mempolicy(); the wrapper lives in libnuma */
+#define CPUSET_MPOL_PREFERRED 1
+
+static struct {
+    CpuMask cpus[64];
+    size_t count;
+    bool loaded;
+} g_numa_nodes = {0};
+
+static void cpuset_load_nodes(void) {
+    if (g_numa_nodes.loaded) return;
+    g_numa_nodes.loaded = true;
+
+    for (size_t node = 0; node < 64; node++) {
+        String_Builder sb = {0};
+        const char* path = temp_sprintf("/sys/devices/system/node/node%zu/cpulist", node);
+        if (!nob_file_exists(path) || !read_entire_file(path, &sb)) break;
+        sb_append_null(&sb);
+        if (!cpuset_parse(sb.items, &g_numa_nodes.cpus[node])) memset(&g_numa_nodes.cpus[node], 0, sizeof(CpuMask));
+        sb_free(sb);
+        g_numa_nodes.count = node + 1;
+    }
+}
+
+/*
+ * The one NUMA node holding every CPU in `mask`, or -1.
+ */
+static int cpuset_single_node(const CpuMask* mask) {
+    cpuset_load_nodes();
+    int found = -1;
+    for (size_t cpu = 0; cpu < CPUSET_MAX; cpu++) {
+        if (!cpu_mask_has(mask, cpu)) continue;
+        int node = -1;
+        for (size_t n = 0; n < g_numa_nodes.count; n++) {
+            if (cpu_mask_has(&g_numa_nodes.cpus[n], cpu)) node = (int)n;
+        }
+        if (node < 0 || (found >= 0 && node != found)) return -1;
+        found = node;
+    }
+    return found;
+}
+
+static void cpuset_apply(const CpuMask* mask) {
+    if (!cpuset_set_affinity(mask)) {
+        nob_log(NOB_WARNING, "Could not set CPU affinity: %s", strerror(errno));
+        return;
+    }
+
+    int node = cpuset_single_node(mask);
+    if (node >= 0 && g_numa_nodes.count > 1) {
+        unsigned long nodemask = 1UL << node;
+        syscall(SYS_set_mempolicy, CPUSET_MPOL_PREFERRED, &nodemask, sizeof(nodemask) * 8);
+    }
+}
+
+/*
+ * The pool that locks `cpu` for exclusive scopes.
+ */
+static const char* cpuset_lock(size_t cpu) {
+    return pool_declare_private(temp_sprintf("cpu%zu", cpu), 1);
+}
+
+/*
+ * Run what follows on the CPUs in `mask` until cpuset_leave(). With
+ * `exclusive`, first wait until no other exclusive scope holds them.
+ */
+bool cpuset_enter(const CpuMask* mask, bool exclusive, CpusetScope* scope) {
+    memset(&scope->exclusive, 0, sizeof(scope->exclusive));
+    if (!cpuset_get_affinity(&scope->saved)) {
+        nob_log(NOB_WARNING, "Could not read CPU affinity: %s", strerror(errno));
+        scope->active = false;
+        return false;
+    }
+
+    /* Ascending order, so exclusive scopes can't deadlock on each other */
+    for (size_t cpu = 0; exclusive && cpu < CPUSET_MAX; cpu++) {
+        if (!cpu_mask_has(mask, cpu)) continue;
+        scope->slots[cpu] = pool_acquire(cpuset_lock(cpu));
+        cpu_mask_add(&scope->exclusive, cpu);
+    }
+
+    /* cpuset_apply() may prefer a node; whatever policy was there before comes back on leaving */
+    scope->policy_saved = syscall(SYS_get_mempolicy, &scope->saved_policy, scope->saved_nodes,
+                                  (unsigned long)CPUSET_MAX_NODES, NULL, 0UL) == 0;
+    cpuset_apply(mask);
+    scope->active = true;
+    return true;
+}
+
+void cpuset_leave(CpusetScope* scope) {
+    if (!scope->active) return;
+    cpuset_set_affinity(&scope->saved);
+    if (scope->policy_saved && g_numa_nodes.count > 1) {
+        syscall(SYS_set_mempolicy, scope->saved_policy, scope->saved_nodes, (unsigned long)CPUSET_MAX_NODES);
+    }
+
+    for (size_t cpu = 0; cpu < CPUSET_MAX; cpu++) {
+        if (cpu_mask_has(&scope->exclusive, cpu)) pool_release(cpuset_lock(cpu), scope->slots[cpu]);
+    }
+    scope->active = false;
+}
+
+/*
+ * Place the job with this index on a NUMA node, round-robin. Called in
+ * the job's own process.
+ */
+void cpuset_spread(size_t job_index) {
+    cpuset_load_nodes();
+    if (g_numa_nodes.count < 2) return;
+
+    const CpuMask* node = &g_numa_nodes.cpus[job_index % g_numa_nodes.count];
+    CpuMask allowed = {0};
+    CpuMask current;
+    if (!cpuset_get_affinity(&current)) return;
+
+    /* Stay inside what we were given (taskset, cgroup cpuset, #cpuset) */
+    bool any = false;
+    for (size_t cpu = 0; cpu < CPUSET_MAX; cpu++) {
+        if (cpu_mask_has(node, cpu) && cpu_mask_has(&current, cpu)) {
+            cpu_mask_add(&allowed, cpu);
+            any = true;
+        }
+    }
+    if (any) cpuset_apply(&allowed);
+}
+
+#else
+
+bool cpuset_enter(const CpuMask* mask, bool exclusive, CpusetScope* scope) {
+    (void)mask;
+    (void)exclusive;
+    static bool warned = false;
+    if (!warned) nob_log(NOB_WARNING, "#cpuset is only supported on Linux, ignoring it");
+    warned = true;
+    scope->active = false;
+    return false;
+}
+
+void cpuset_leave(CpusetScope* scope) {
+    (void)scope;
+}
+
+void cpuset_spread(size_t job_index) {
+    (void)job_index;
+}
+
+#endif
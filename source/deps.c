@@ -0,0 +1,760 @@
+/*
+ * deps.c - Per-command dependency records for Mewo
+ *
+ * Features:
+ *   - One record per command (keyed by the hash of its cwd, shell and
+ *     interpolated text) listing the files it read, probed without
+ *     finding, and wrote
+ *   - Compact binary log in .mewo/deps, loaded once: paths are interned
+ *     and records refer to them by id; later records replace earlier
+ *     ones, and the log is rewritten when it is mostly stale
+ *   - Appends are locked and pick up records written meanwhile by
+ *     parallel jobs, so forked workers share one log
+ *   - Makefile-style depfiles (gcc/clang -MD) as a record source
+ *   - Up-to-date check: size+mtime first, content hash only when the
+ *     mtime moved (then the record is refreshed), and nothing at all for
+ *     paths the fsmonitor says are unchanged since the record was written
+ *     (each record keeps the fsmonitor token of its run)
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - str_dup() from error.c
+ *   - nob.h utilities
+ *   - MEWO_STATE_DIR from history.c
+ *   - FsToken, fs_maybe_changed(), fs_token_covered(), fs_current_token()
+ *     from fsmonitor.c
+ *   - file_content_id(), Sha1 from hash.c
+ */
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/file.h>
+#endif
+
+#define DEPS_PATH MEWO_STATE_DIR "/deps"
+#define DEPS_MAGIC "MEWODEPS"
+#define DEPS_VERSION 2
+#define DEPS_RECORD_HEADER 40   /* key, count, fsmonitor token */
+#define DEPS_RECORD_FLAG 0x80000000u
+#define DEPS_TOMBSTONE 0xFFFFFFFFu
+
+/* Ordered by strength: a path seen several ways keeps the strongest kind */
+typedef enum {
+    DEPS_ABSENT,    /* looked up but missing; appearing makes it stale */
+    DEPS_PRESENT,   /* looked up and found; disappearing makes it stale */
+    DEPS_INPUT,     /* read; content matters */
+    DEPS_OUTPUT,    /* written; must still be as the command left it */
+} Deps_Kind;
+
+/* Files collected while a command runs */
+typedef struct {
+    char* path;
+    Deps_Kind kind;
+} DepsFile;
+
+typedef struct {
+    DepsFile* items;
+    size_t count;
+    size_t capacity;
+} DepsFiles;
+
+/* On-disk entry */
+typedef struct {
+    uint32_t path_id;
+    uint8_t kind;
+    uint8_t pad[3];
+    int64_t mtime_ns;
+    uint64_t size;
+    unsigned char id[20];
+} DepsEntry;
+
+typedef struct {
+    unsigned char key[20];
+    DepsEntry* entries;
+    uint32_t count;
+    FsToken token;          /* fsmonitor token when it was written */
+    bool live;
+} DepsRecord;
+
+typedef struct {
+    bool loaded;
+    FILE* file;
+    int pid;
+    long offset;            /* how far the log has been read */
+
+    char** paths;
+    size_t paths_count;
+    size_t paths_capacity;
+    uint32_t* path_table;   /* open addressing, id + 1, 0 = empty */
+    size_t path_table_size;
+
+    DepsRecord* records;
+    size_t records_count;
+    size_t records_capacity;
+    uint32_t* record_table;
+    size_t record_table_size;
+    size_t stale_records;
+} DepsLog;
+
+static DepsLog g_deps = {0};
+
+void deps_files_add(DepsFiles* files, const char* path, Deps_Kind kind) {
+    for (size_t i = 0; i < files->count; i++) {
+        if (strcmp(files->items[i].path, path) == 0) {
+            if (kind > files->items[i].kind) files->items[i].kind = kind;
+            return;
+        }
+    }
+
+    if (files->count >= files->capacity) {
+        size_t new_cap = files->capacity == 0 ? 32 : files->capacity * 2;
+        DepsFile* new_items = realloc(files->items, new_cap * sizeof(DepsFile));
+        if (!new_items) return;
+        files->items = new_items;
+        files->capacity = new_cap;
+    }
+    files->items[files->count].path = str_dup(path);
+    files->items[files->count].kind = kind;
+    files->count++;
+}
+
+void deps_files_free(DepsFiles* files) {
+    for (size_t i = 0; i < files->count; i++) free(files->items[i].path);
+    free(files->items);
+    memset(files, 0, sizeof(DepsFiles));
+}
+
+void deps_key(const char* cwd, const char* shell, const char* cmd, unsigned char key[20]) {
+    Sha1 s;
+    sha1_init(&s);
+    sha1_update(&s, cwd ? cwd : "", strlen(cwd ? cwd : "") + 1);
+    sha1_update(&s, shell ? shell : "", strlen(shell ? shell : "") + 1);
+    sha1_update(&s, cmd, strlen(cmd));
+    sha1_final(&s, key);
+}
+
+static uint64_t deps_str_hash(const char* s) {
+    uint64_t h = 1469598103934665603ull;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static uint64_t deps_key_hash(const unsigned char key[20]) {
+    uint64_t h;
+    memcpy(&h, key, sizeof(h));
+    return h;
+}
+
+static void deps_path_table_insert(DepsLog* log, uint32_t id) {
+    size_t mask = log->path_table_size - 1;
+    size_t i = deps_str_hash(log->paths[id]) & mask;
+    while (log->path_table[i]) i = (i + 1) & mask;
+    log->path_table[i] = id + 1;
+}
+
+static void deps_record_table_insert(DepsLog* log, uint32_t index) {
+    size_t mask = log->record_table_size - 1;
+    size_t i = deps_key_hash(log->records[index].key) & mask;
+    while (log->record_table[i]) i = (i + 1) & mask;
+    log->record_table[i] = index + 1;
+}
+
+static bool deps_grow_tables(DepsLog* log) {
+    if ((log->paths_count + 1) * 2 > log->path_table_size) {
+        size_t new_size = log->path_table_size == 0 ? 1024 : log->path_table_size * 2;
+        uint32_t* table = calloc(new_size, sizeof(uint32_t));
+        if (!table) return false;
+        free(log->path_table);
+        log->path_table = table;
+        log->path_table_size = new_size;
+        for (size_t i = 0; i < log->paths_count; i++) deps_path_table_insert(log, (uint32_t)i);
+    }
+    if ((log->records_count + 1) * 2 > log->record_table_size) {
+        size_t new_size = log->record_table_size == 0 ? 256 : log->record_table_size * 2;
+        uint32_t* table = calloc(new_size, sizeof(uint32_t));
+        if (!table) return false;
+        free(log->record_table);
+        log->record_table = table;
+        log->record_table_size = new_size;
+        for (size_t i = 0; i < log->records_count; i++) deps_record_table_insert(log, (uint32_t)i);
+    }
+    return true;
+}
+
+static int64_t deps_find_path(DepsLog* log, const char* path) {
+    if (log->path_table_size == 0) return -1;
+    size_t mask = log->path_table_size - 1;
+    size_t i = deps_str_hash(path) & mask;
+    while (log->path_table[i]) {
+        uint32_t id = log->path_table[i] - 1;
+        if (strcmp(log->paths[id], path) == 0) return id;
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+static DepsRecord* deps_find_record(DepsLog* log, const unsigned char key[20]) {
+    if (log->record_table_size == 0) return NULL;
+    size_t mask = log->record_table_size - 1;
+    size_t i = deps_key_hash(key) & mask;
+    while (log->record_table[i]) {
+        DepsRecord* r = &log->records[log->record_table[i] - 1];
+        if (memcmp(r->key, key, 20) == 0) return r;
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+static bool deps_add_path(DepsLog* log, const char* path, size_t len) {
+    if (!deps_grow_tables(log)) return false;
+    if (log->paths_count >= log->paths_capacity) {
+        size_t new_cap = log->paths_capacity == 0 ? 256 : log->paths_capacity * 2;
+        char** new_paths = realloc(log->paths, new_cap * sizeof(char*));
+        if (!new_paths) return false;
+        log->paths = new_paths;
+        log->paths_capacity = new_cap;
+    }
+    char* copy = malloc(len + 1);
+    if (!copy) return false;
+    memcpy(copy, path, len);
+    copy[len] = '\0';
+    log->paths[log->paths_count] = copy;
+    deps_path_table_insert(log, (uint32_t)log->paths_count);
+    log->paths_count++;
+    return true;
+}
+
+/*
+ * Install a record, taking ownership of `entries`. A NULL `entries` with
+ * DEPS_TOMBSTONE count forgets the key.
+ */
+static void deps_set_record(DepsLog* log, const unsigned char key[20], DepsEntry* entries, uint32_t count,
+                            FsToken token) {
+    DepsRecord* r = deps_find_record(log, key);
+    if (r) {
+        free(r->entries);
+        log->stale_records++;
+    } else {
+        if (!deps_grow_tables(log)) {
+            free(entries);
+            return;
+        }
+        if (log->records_count >= log->records_capacity) {
+            size_t new_cap = log->records_capacity == 0 ? 64 : log->records_capacity * 2;
+            DepsRecord* new_records = realloc(log->records, new_cap * sizeof(DepsRecord));
+            if (!new_records) {
+                free(entries);
+                return;
+            }
+            log->records = new_records;
+            log->records_capacity = new_cap;
+        }
+        r = &log->records[log->records_count];
+        memcpy(r->key, key, 20);
+        deps_record_table_insert(log, (uint32_t)log->records_count);
+        log->records_count++;
+    }
+
+    r->live = count != DEPS_TOMBSTONE;
+    r->token = token;
+    r->entries = r->live ? entries : NULL;
+    r->count = r->live ? count : 0;
+    if (!r->live) free(entries);
+}
+
+/*
+ * Read log records from the current offset to the end of the file.
+ * Returns false if the log is corrupt from some point on.
+ */
+static bool deps_read_tail(DepsLog* log) {
+    if (fseek(log->file, log->offset, SEEK_SET) != 0) return false;
+
+    for (;;) {
+        uint32_t header;
+        size_t n = fread(&header, 1, sizeof(header), log->file);
+        if (n == 0) return true;
+        if (n != sizeof(header)) return false;
+
+        uint32_t size = header & ~DEPS_RECORD_FLAG;
+        char* payload = malloc(size ? size : 1);
+        if (!payload) return false;
+        if (fread(payload, 1, size, log->file) != size) {
+            free(payload);
+            return false;
+        }
+
+        if (header & DEPS_RECORD_FLAG) {
+            uint32_t count;
+            FsToken token;
+            if (size < DEPS_RECORD_HEADER) {
+                free(payload);
+                return false;
+            }
+            memcpy(&count, payload + 20, sizeof(count));
+            memcpy(&token, payload + 24, sizeof(token));
+            bool tombstone = count == DEPS_TOMBSTONE;
+            if (!tombstone && size != DEPS_RECORD_HEADER + (size_t)count * sizeof(DepsEntry)) {
+                free(payload);
+                return false;
+            }
+
+            DepsEntry* entries = NULL;
+            if (!tombstone && count > 0) {
+                entries = malloc((size_t)count * sizeof(DepsEntry));
+                if (!entries) {
+                    free(payload);
+                    return false;
+                }
+                memcpy(entries, payload + DEPS_RECORD_HEADER, (size_t)count * sizeof(DepsEntry));
+                for (uint32_t i = 0; i < count; i++) {
+                    if (entries[i].path_id >= log->paths_count) {
+                        free(entries);
+                        free(payload);
+                        return false;
+                    }
+                }
+            }
+            deps_set_record(log, (unsigned char*)payload, entries, count, token);
+        } else {
+            deps_add_path(log, payload, size);
+        }
+
+        free(payload);
+        log->offset = ftell(log->file);
+    }
+}
+
+static bool deps_write_path(String_Builder* sb, const char* path) {
+    uint32_t len = (uint32_t)strlen(path);
+    sb_append_buf(sb, &len, sizeof(len));
+    sb_append_buf(sb, path, len);
+    return true;
+}
+
+static void deps_write_record(String_Builder* sb, const unsigned char key[20], const DepsEntry* entries, uint32_t count,
+                              FsToken token) {
+    uint32_t size = DEPS_RECORD_HEADER + (count == DEPS_TOMBSTONE ? 0 : count * (uint32_t)sizeof(DepsEntry));
+    uint32_t header = size | DEPS_RECORD_FLAG;
+    sb_append_buf(sb, &header, sizeof(header));
+    sb_append_buf(sb, key, 20);
+    sb_append_buf(sb, &count, sizeof(count));
+    sb_append_buf(sb, &token, sizeof(token));
+    if (count != DEPS_TOMBSTONE && count > 0) sb_append_buf(sb, entries, count * sizeof(DepsEntry));
+}
+
+/*
+ * Rewrite the log with only the live records and the paths they use.
+ */
+static void deps_recompact(DepsLog* log) {
+    uint32_t* remap = malloc((log->paths_count + 1) * sizeof(uint32_t));
+    if (!remap) return;
+    for (size_t i = 0; i < log->paths_count; i++) remap[i] = UINT32_MAX;
+
+    String_Builder sb = {0};
+    sb_append_buf(&sb, DEPS_MAGIC, 8);
+    uint32_t version = DEPS_VERSION;
+    sb_append_buf(&sb, &version, sizeof(version));
+
+    uint32_t next_id = 0;
+    for (size_t r = 0; r < log->records_count; r++) {
+        DepsRecord* rec = &log->records[r];
+        if (!rec->live) continue;
+        for (uint32_t e = 0; e < rec->count; e++) {
+            uint32_t id = rec->entries[e].path_id;
+            if (remap[id] == UINT32_MAX) {
+                remap[id] = next_id++;
+                deps_write_path(&sb, log->paths[id]);
+            }
+        }
+    }
+    for (size_t r = 0; r < log->records_count; r++) {
+        DepsRecord* rec = &log->records[r];
+        if (!rec->live) continue;
+        for (uint32_t e = 0; e < rec->count; e++) rec->entries[e].path_id = remap[rec->entries[e].path_id];
+        deps_write_record(&sb, rec->key, rec->entries, rec->count, rec->token);
+    }
+
+    /* Rebuild the in-memory path table to match the new ids */
+    char** new_paths = calloc(next_id ? next_id : 1, sizeof(char*));
+    if (new_paths) {
+        for (size_t i = 0; i < log->paths_count; i++) {
+            if (remap[i] != UINT32_MAX) new_paths[remap[i]] = log->paths[i];
+            else free(log->paths[i]);
+        }
+        free(log->paths);
+        log->paths = new_paths;
+        log->paths_count = next_id;
+        log->paths_capacity = next_id ? next_id : 1;
+        memset(log->path_table, 0, log->path_table_size * sizeof(uint32_t));
+        for (size_t i = 0; i < log->paths_count; i++) deps_path_table_insert(log, (uint32_t)i);
+    }
+    free(remap);
+
+    /* The ids changed, so the old log can't be appended to either way */
+    char* tmp_path = temp_sprintf("%s.tmp", DEPS_PATH);
+    fclose(log->file);
+    log->file = NULL;
+    if (write_entire_file(tmp_path, sb.items, sb.count) && nob_rename(tmp_path, DEPS_PATH)) {
+        log->file = fopen(DEPS_PATH, "a+b");
+        log->offset = (long)sb.count;
+        log->stale_records = 0;
+        nob_log(NOB_INFO, "deps: compacted log to %zu bytes", sb.count);
+    } else {
+        nob_log(NOB_WARNING, "deps: could not rewrite %s", DEPS_PATH);
+    }
+    sb_free(sb);
+}
+
+static bool deps_load(DepsLog* log) {
+    if (log->loaded) return log->file != NULL;
+    log->loaded = true;
+
+    if (!mkdir_if_not_exists(MEWO_STATE_DIR)) return false;
+    log->file = fopen(DEPS_PATH, "a+b");
+    if (!log->file) {
+        nob_log(NOB_WARNING, "deps: cannot open %s", DEPS_PATH);
+        return false;
+    }
+
+    char magic[8];
+    uint32_t version = 0;
+    fseek(log->file, 0, SEEK_SET);
+    size_t n = fread(magic, 1, sizeof(magic), log->file);
+    bool fresh = n == 0;
+    bool valid = n == sizeof(magic) && memcmp(magic, DEPS_MAGIC, 8) == 0 &&
+                 fread(&version, 1, sizeof(version), log->file) == sizeof(version) && version == DEPS_VERSION;
+
+    if (fresh || !valid) {
+        if (!fresh) nob_log(NOB_WARNING, "deps: %s has an unknown format, starting over", DEPS_PATH);
+        fclose(log->file);
+        log->file = fopen(DEPS_PATH, "w+b");
+        if (!log->file) return false;
+        version = DEPS_VERSION;
+        fwrite(DEPS_MAGIC, 1, 8, log->file);
+        fwrite(&version, 1, sizeof(version), log->file);
+        fclose(log->file);
+        log->file = fopen(DEPS_PATH, "a+b");
+        if (!log->file) return false;
+    }
+
+#ifndef _WIN32
+    log->pid = getpid();
+#endif
+    log->offset = 12;
+    bool intact = deps_read_tail(log);
+    if (!intact) nob_log(NOB_WARNING, "deps: %s is truncated, dropping the damaged tail", DEPS_PATH);
+
+    size_t live = 0;
+    for (size_t i = 0; i < log->records_count; i++) {
+        if (log->records[i].live) live++;
+    }
+    if (!intact || (log->stale_records > 1000 && log->stale_records > live * 3)) {
+        deps_recompact(log);
+    }
+    nob_log(NOB_INFO, "deps: %zu records, %zu paths", live, log->paths_count);
+    return log->file != NULL;
+}
+
+static void deps_lock(DepsLog* log, bool lock) {
+#ifndef _WIN32
+    /* flock() locks belong to the open file, which forked jobs share */
+    if (lock && log->pid != getpid()) {
+        FILE* own = fopen(DEPS_PATH, "a+b");
+        if (own) {
+            fclose(log->file);
+            log->file = own;
+        }
+        log->pid = getpid();
+    }
+    flock(fileno(log->file), lock ? LOCK_EX : LOCK_UN);
+#else
+    (void)log;
+    (void)lock;
+#endif
+}
+
+static bool deps_stat(const char* path, int64_t* mtime_ns, uint64_t* size) {
+    struct stat st;
+    if (stat(path, &st) < 0) return false;
+#if defined(_WIN32)
+    *mtime_ns = (int64_t)st.st_mtime * 1000000000;
+#elif defined(__APPLE__)
+    *mtime_ns = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    *mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    *size = (uint64_t)st.st_size;
+    return true;
+}
+
+/*
+ * Append a record (or tombstone) under the lock, interning new paths.
+ * `paths[i]` names entries[i]; their path_id fields are filled in here.
+ */
+static void deps_append(DepsLog* log, const unsigned char key[20], DepsEntry* entries, const char** paths, uint32_t count,
+                        FsToken token) {
+    deps_lock(log, true);
+
+    /* Parallel jobs may have appended since we last looked */
+    fseek(log->file, 0, SEEK_END);
+    if (ftell(log->file) > log->offset) deps_read_tail(log);
+
+    String_Builder sb = {0};
+    if (count != DEPS_TOMBSTONE) {
+        for (uint32_t i = 0; i < count; i++) {
+            int64_t id = deps_find_path(log, paths[i]);
+            if (id < 0) {
+                deps_write_path(&sb, paths[i]);
+                deps_add_path(log, paths[i], strlen(paths[i]));
+                id = (int64_t)log->paths_count - 1;
+            }
+            entries[i].path_id = (uint32_t)id;
+        }
+    }
+    deps_write_record(&sb, key, entries, count, token);
+
+    fseek(log->file, 0, SEEK_END);
+    fwrite(sb.items, 1, sb.count, log->file);
+    fflush(log->file);
+    log->offset = ftell(log->file);
+    sb_free(sb);
+
+    deps_lock(log, false);
+    deps_set_record(log, key, entries, count, token);
+}
+
+/*
+ * Store what a successful command touched. Inputs are fingerprinted and
+ * hashed now, so a later run can tell a touched file from a changed one.
+ */
+void deps_record(const unsigned char key[20], const DepsFiles* files) {
+    DepsLog* log = &g_deps;
+    if (!deps_load(log)) return;
+
+    DepsEntry* entries = calloc(files->count ? files->count : 1, sizeof(DepsEntry));
+    const char** paths = malloc((files->count ? files->count : 1) * sizeof(char*));
+    if (!entries || !paths) {
+        free(entries);
+        free(paths);
+        return;
+    }
+
+    uint32_t count = 0;
+    for (size_t i = 0; i < files->count; i++) {
+        const DepsFile* file = &files->items[i];
+        DepsEntry* e = &entries[count];
+        e->kind = (uint8_t)file->kind;
+
+        if (file->kind != DEPS_ABSENT) {
+            /* Temporaries the command created and removed again */
+            if (!deps_stat(file->path, &e->mtime_ns, &e->size)) continue;
+            /* Directories and unreadable files keep a zero id and go stale on any change */
+            if (file->kind == DEPS_INPUT) file_content_id(file->path, e->id);
+        }
+        paths[count++] = file->path;
+    }
+
+    deps_append(log, key, entries, paths, count, fs_current_token());
+    free(paths);
+}
+
+/*
+ * Forget a command's record, e.g. after it failed.
+ */
+void deps_forget(const unsigned char key[20]) {
+    DepsLog* log = &g_deps;
+    if (!deps_load(log)) return;
+    DepsRecord* r = deps_find_record(log, key);
+    if (!r || !r->live) return;
+    FsToken none = {0};
+    deps_append(log, key, NULL, NULL, DEPS_TOMBSTONE, none);
+}
+
+/*
+ * True if the command with `key` has a record and none of its inputs,
+ * absent paths or outputs changed since.
+ */
+bool deps_up_to_date(const unsigned char key[20]) {
+    DepsLog* log = &g_deps;
+    if (!deps_load(log)) return false;
+
+    DepsRecord* r = deps_find_record(log, key);
+    if (!r || !r->live) return false;
+
+    /* Checked in full now, so from here on the fsmonitor can vouch for it */
+    FsToken now = fs_current_token();
+    bool refreshed = now.instance != 0 && !fs_token_covered(r->token);
+    for (uint32_t i = 0; i < r->count; i++) {
+        DepsEntry* e = &r->entries[i];
+        const char* path = log->paths[e->path_id];
+        if (path[0] != '/' && !fs_maybe_changed(path, r->token)) continue;
+
+        int64_t mtime_ns;
+        uint64_t size;
+        bool exists = deps_stat(path, &mtime_ns, &size);
+
+        if (e->kind == DEPS_ABSENT) {
+            if (exists) {
+                nob_log(NOB_INFO, "deps: %s appeared", path);
+                return false;
+            }
+            continue;
+        }
+        if (!exists) {
+            nob_log(NOB_INFO, "deps: %s is missing", path);
+            return false;
+        }
+        if (e->kind == DEPS_PRESENT) continue;
+        if (mtime_ns == e->mtime_ns && size == e->size) continue;
+
+        if (e->kind == DEPS_OUTPUT || size != e->size) {
+            nob_log(NOB_INFO, "deps: %s changed", path);
+            return false;
+        }
+
+        unsigned char id[20];
+        if (!file_content_id(path, id) || memcmp(id, e->id, 20) != 0) {
+            nob_log(NOB_INFO, "deps: %s changed", path);
+            return false;
+        }
+        e->mtime_ns = mtime_ns;
+        refreshed = true;
+    }
+
+    if (refreshed) {
+        /* Touched but identical, or newly vouched for; store the new mtimes and token */
+        DepsEntry* entries = malloc((r->count ? r->count : 1) * sizeof(DepsEntry));
+        const char** paths = malloc((r->count ? r->count : 1) * sizeof(char*));
+        if (entries && paths) {
+            memcpy(entries, r->entries, r->count * sizeof(DepsEntry));
+            for (uint32_t i = 0; i < r->count; i++) paths[i] = log->paths[r->entries[i].path_id];
+            unsigned char k[20];
+            memcpy(k, key, 20);
+            /* Paths skipped above are unchanged up to this run's token too */
+            deps_append(log, k, entries, paths, r->count, now);
+            entries = NULL;
+        }
+        free(entries);
+        free(paths);
+    }
+    return true;
+}
+
+/*
+ * Next word of a Makefile-style depfile, unescaping "\ ", "\#" and "$$".
+ * Sets *is_target when the word ends in the rule's ':'.
+ */
+static bool depfile_next_word(const char** cursor, String_Builder* word, bool* is_target, bool* end_of_rule) {
+    const char* p = *cursor;
+    word->count = 0;
+    *is_target = false;
+    *end_of_rule = false;
+
+    for (;;) {
+        if (*p == '\\' && (p[1] == '\n' || (p[1] == '\r' && p[2] == '\n'))) {
+            p += p[1] == '\n' ? 2 : 3;
+        } else if (*p == ' ' || *p == '\t') {
+            p++;
+        } else {
+            break;
+        }
+    }
+    if (*p == '\0') {
+        *cursor = p;
+        return false;
+    }
+    if (*p == '\n' || *p == '\r') {
+        while (*p == '\n' || *p == '\r') p++;
+        *end_of_rule = true;
+        *cursor = p;
+        return true;
+    }
+
+    while (*p && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+        if (*p == '\\' && (p[1] == ' ' || p[1] == '#' || p[1] == '\\')) {
+            da_append(word, p[1]);
+            p += 2;
+        } else if (*p == '\\' && (p[1] == '\n' || p[1] == '\r')) {
+            break;
+        } else if (*p == '$' && p[1] == '$') {
+            da_append(word, '$');
+            p += 2;
+        } else if (*p == ':' && (p[1] == '\0' || p[1] == ' ' || p[1] == '\t' || p[1] == '\n' || p[1] == '\r')) {
+            /* Only a word-final ':' ends the targets, so "C:/x" stays a path */
+            *is_target = true;
+            p++;
+            break;
+        } else {
+            da_append(word, *p);
+            p++;
+        }
+    }
+    sb_append_null(word);
+    *cursor = p;
+    return true;
+}
+
+/*
+ * Read a depfile as written by gcc/clang -MD: targets become outputs and
+ * prerequisites inputs. Empty rules from -MP are ignored. Relative paths
+ * are taken relative to `dir` (NULL for the current directory).
+ */
+bool deps_parse_depfile(const char* path, const char* dir, DepsFiles* files) {
+    String_Builder sb = {0};
+    if (!nob_file_exists(path) || !read_entire_file(path, &sb)) return false;
+    sb_append_null(&sb);
+
+    String_Builder word = {0};
+    const char* cursor = sb.items;
+    char** targets = NULL;
+    size_t target_count = 0;
+    size_t prereq_count = 0;
+    bool in_rule = false;
+    bool ok = true;
+
+    for (;;) {
+        bool is_target, end_of_rule;
+        bool more = depfile_next_word(&cursor, &word, &is_target, &end_of_rule);
+
+        if (!more || end_of_rule) {
+            /* Rule finished: keep its targets only if it had prerequisites */
+            if (prereq_count > 0) {
+                for (size_t i = 0; i < target_count; i++) deps_files_add(files, targets[i], DEPS_OUTPUT);
+            }
+            for (size_t i = 0; i < target_count; i++) free(targets[i]);
+            target_count = 0;
+            prereq_count = 0;
+            in_rule = false;
+            if (!more) break;
+            continue;
+        }
+
+        const char* name = word.items;
+        char* full = (dir && name[0] != '/' && !(name[0] && name[1] == ':'))
+                         ? temp_sprintf("%s/%s", dir, name) : (char*)name;
+        while (full[0] == '.' && full[1] == '/') full += 2;
+
+        if (!in_rule) {
+            if (name[0]) {
+                targets = realloc(targets, (target_count + 1) * sizeof(char*));
+                targets[target_count++] = str_dup(full);
+            }
+            if (is_target) in_rule = true;
+        } else if (is_target) {
+            /* A second ':' on one line is not something compilers write */
+            ok = false;
+        } else {
+            deps_files_add(files, full, DEPS_INPUT);
+            prereq_count++;
+        }
+    }
+
+    free(targets);
+    sb_free(word);
+    sb_free(sb);
+    return ok;
+}
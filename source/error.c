@@ -5,6 +5,10 @@
  *   - Global error state with type, message, and line number
  *   - Error types: SYNTAX, RUNTIME, MEMORY
  *   - Formatted error output with file:line:type:message format
+ *   - Errors can be handed from a forked child back to its parent
+ *   - With --keep-going, errors are collected instead of overwritten and
+ *     printed as one summary at the end
+ *   - Each error goes to the --events stream once, when it is first printed
  *   - Utility str_dup() function used throughout the codebase
  */
 
@@ -24,6 +28,7 @@ typedef struct {
     ErrorType type;
     char* message;
     size_t line_number;
+    bool reported;      /* already sent as an "error" event */
 } Error;
 
 static Error g_error = {0};
@@ -42,24 +47,37 @@ void set_error(ErrorType type, const char* message, size_t line_number) {
     g_error.type = type;
     g_error.message = str_dup(message);
     g_error.line_number = line_number;
+    g_error.reported = false;
 }
 
 bool has_error() {
     return g_error.type != ERROR_NONE;
 }
 
-void print_error(const char* file, FILE* stream) {
-    if (g_error.type == ERROR_NONE) return;
-
+static void print_one_error(Error* error, const char* file, FILE* stream) {
     const char* type_str = "Unknown";
-    switch (g_error.type) {
+    switch (error->type) {
         case ERROR_SYNTAX: type_str = "Syntax Error"; break;
         case ERROR_RUNTIME: type_str = "Runtime Error"; break;
         case ERROR_MEMORY: type_str = "Memory Error"; break;
         default: break;
     }
 
-    fprintf(stream, "%s:%zu: %s: %s\n", file, g_error.line_number, type_str, g_error.message);
+    fprintf(stream, "%s:%zu: %s: %s\n", file, error->line_number, type_str, error->message);
+
+    if (!error->reported && events_begin("error")) {
+        events_str("file", file);
+        events_int("line", (long long)error->line_number);
+        events_str("type", type_str);
+        events_str("message", error->message ? error->message : "");
+        events_end();
+    }
+    error->reported = true;
+}
+
+void print_error(const char* file, FILE* stream) {
+    if (g_error.type == ERROR_NONE) return;
+    print_one_error(&g_error, file, stream);
 }
 
 void clear_error(void) {
@@ -67,4 +85,85 @@ void clear_error(void) {
     g_error.type = ERROR_NONE;
     g_error.message = NULL;
     g_error.line_number = 0;
-}
\ No newline at end of file
+    g_error.reported = false;
+}
+/*
+ * Pass the current error to another process (e.g. from a forked child)
+ * as one "type line message" record.
+ */
+void error_save(FILE* stream) {
+    if (g_error.type == ERROR_NONE) return;
+    fprintf(stream, "%d %zu %s\n", (int)g_error.type, g_error.line_number,
+            g_error.message ? g_error.message : "");
+}
+
+bool error_load(FILE* stream) {
+    int type = 0;
+    size_t line_number = 0;
+    char message[1024];
+    if (fscanf(stream, "%d %zu ", &type, &line_number) != 2) return false;
+    if (!fgets(message, sizeof(message), stream)) message[0] = '\0';
+
+    size_t len = strlen(message);
+    if (len > 0 && message[len - 1] == '\n') message[len - 1] = '\0';
+    set_error((ErrorType)type, message, line_number);
+    return true;
+}
+
+typedef struct {
+    char* context;      /* what failed, e.g. a job or target name */
+    Error error;
+} CollectedError;
+
+static struct {
+    CollectedError* items;
+    size_t count;
+    size_t capacity;
+} g_collected_errors = {0};
+
+/*
+ * Move the current error to the summary (--keep-going), so the next
+ * failure doesn't overwrite it. `reported`: it was already printed, by
+ * the job that failed.
+ */
+void error_collect(const char* context, bool reported) {
+    if (g_error.type == ERROR_NONE) return;
+
+    if (g_collected_errors.count >= g_collected_errors.capacity) {
+        size_t new_cap = g_collected_errors.capacity == 0 ? 8 : g_collected_errors.capacity * 2;
+        CollectedError* new_items = realloc(g_collected_errors.items, new_cap * sizeof(CollectedError));
+        if (!new_items) return;
+        g_collected_errors.items = new_items;
+        g_collected_errors.capacity = new_cap;
+    }
+
+    CollectedError* collected = &g_collected_errors.items[g_collected_errors.count++];
+    collected->context = str_dup(context);
+    collected->error = g_error;
+    if (reported) collected->error.reported = true;
+    g_error.type = ERROR_NONE;
+    g_error.message = NULL;
+    g_error.line_number = 0;
+    g_error.reported = false;
+}
+
+size_t collected_error_count(void) {
+    return g_collected_errors.count;
+}
+
+/*
+ * Print every collected error, then the current one if any.
+ */
+void print_error_summary(const char* file, FILE* stream) {
+    size_t total = g_collected_errors.count + (g_error.type != ERROR_NONE ? 1 : 0);
+    fprintf(stream, "%zu error%s:\n", total, total == 1 ? "" : "s");
+    for (size_t i = 0; i < g_collected_errors.count; i++) {
+        CollectedError* collected = &g_collected_errors.items[i];
+        fprintf(stream, "  [%s] ", collected->context ? collected->context : "?");
+        print_one_error(&collected->error, file, stream);
+    }
+    if (g_error.type != ERROR_NONE) {
+        fprintf(stream, "  ");
+        print_error(file, stream);
+    }
+}
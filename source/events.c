@@ -0,0 +1,310 @@
+/*
+ * events.c - Machine-readable event stream (--events=FD|path)
+ *
+ * Features:
+ *   - One JSON object per line (NDJSON) for dashboards and CI: run,
+ *     label, command and job start/end with durations and exit codes,
+ *     skipped commands, errors with their line numbers, warnings
+ *   - Every event has "ts" (seconds since the epoch) and "event"
+ *   - Written to a file or to an inherited file descriptor; a descriptor
+ *     is made non-blocking and events are buffered in memory, so a slow
+ *     reader never stalls the build. Past EVENTS_MAX_BUFFER events are
+ *     dropped and counted in a final "dropped" event
+ *   - Each forked job writes its own events, one write() per event; on
+ *     a pipe, events of up to PIPE_BUF bytes never interleave
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - nob.h utilities
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#ifdef _WIN32
+#include <io.h>
+#include <process.h>
+#define events_getpid _getpid
+#define events_write(fd, buf, n) _write(fd, buf, (unsigned int)(n))
+#else
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#define events_getpid getpid
+#endif
+
+#define EVENTS_MAX_BUFFER (1024 * 1024)
+#define EVENTS_CLOSE_WAIT_MS 1000
+
+static struct {
+    int fd;                 /* -1 when off */
+    int pid;                /* the process the buffered events are from */
+    String_Builder buf;     /* events not written yet */
+    size_t event_start;     /* where the event being built starts in buf */
+    bool building;
+    size_t dropped;
+} g_events = { .fd = -1 };
+
+/*
+ * Send events to `spec`: a file descriptor number, or a path that is
+ * created or truncated.
+ */
+bool events_open(const char* spec) {
+    bool is_fd = *spec != '\0';
+    for (const char* p = spec; *p; p++) {
+        if (*p < '0' || *p > '9') is_fd = false;
+    }
+
+    int fd;
+    if (is_fd) {
+        fd = atoi(spec);
+#ifndef _WIN32
+        if (fcntl(fd, F_GETFD) < 0) {
+            fprintf(stderr, "Error: --events: file descriptor %d is not open\n", fd);
+            return false;
+        }
+        /* Not passed on to commands; stdout and stderr are shared with them, so they stay blocking */
+        fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+        if (fd > STDERR_FILENO) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#endif
+    } else {
+#ifdef _WIN32
+        fd = _open(spec, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+        fd = open(spec, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+        if (fd < 0) {
+            fprintf(stderr, "Error: --events: could not open %s: %s\n", spec, strerror(errno));
+            return false;
+        }
+    }
+
+    g_events.fd = fd;
+    g_events.pid = (int)events_getpid();
+    return true;
+}
+
+bool events_enabled(void) {
+    return g_events.fd >= 0;
+}
+
+#ifndef _WIN32
+/*
+ * write() without the SIGPIPE of a reader that went away; mewo's own
+ * disposition of SIGPIPE is what the commands it runs inherit, so it is
+ * blocked and the pending signal taken instead of ignoring it.
+ */
+static ssize_t events_write(int fd, const char* buf, size_t count) {
+    sigset_t pipe_set, old_set, pending;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &pipe_set, &old_set);
+    sigpending(&pending);
+    bool was_pending = sigismember(&pending, SIGPIPE);
+
+    ssize_t n = write(fd, buf, count);
+    int saved_errno = errno;
+    if (n < 0 && errno == EPIPE && !was_pending) {
+        int sig;
+        sigpending(&pending);
+        if (sigismember(&pending, SIGPIPE)) sigwait(&pipe_set, &sig);
+    }
+    sigprocmask(SIG_SETMASK, &old_set, NULL);
+    errno = saved_errno;
+    return n;
+}
+#endif
+
+/*
+ * Write as much of the buffer as the reader takes right now, waiting up
+ * to `wait_ms` for it if the descriptor is full. What is left when that
+ * runs out is dropped, unless `wait_ms` is 0.
+ *
+ * Every event is its own write(), so on a pipe one of up to PIPE_BUF
+ * bytes goes out whole or not at all, never mixed with another job's.
+ * A longer event that only partly went out is finished before anything
+ * else, waiting up to EVENTS_CLOSE_WAIT_MS; a reader that doesn't take
+ * the rest of a line by then gets no more events.
+ */
+static void events_flush(int wait_ms) {
+    uint64_t start = nob_nanos_since_unspecified_epoch();
+    size_t written = 0;
+    size_t partial = 0;     /* bytes of the event at `written` already sent */
+    while (written < g_events.buf.count) {
+        const char* event = g_events.buf.items + written;
+        const char* newline = memchr(event, '\n', g_events.buf.count - written);
+        size_t len = newline ? (size_t)(newline - event) + 1 : g_events.buf.count - written;
+
+        long long n = (long long)events_write(g_events.fd, event + partial, len - partial);
+        if (n > 0) {
+            if (partial == 0 && (size_t)n < len) {
+                start = nob_nanos_since_unspecified_epoch();
+            }
+            partial += (size_t)n;
+            if (partial == len) {
+                written += len;
+                partial = 0;
+            }
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+#ifndef _WIN32
+        int limit_ms = partial > 0 ? EVENTS_CLOSE_WAIT_MS : wait_ms;
+        if (n < 0 && errno == EAGAIN && limit_ms > 0) {
+            uint64_t elapsed_ms = (nob_nanos_since_unspecified_epoch() - start) / 1000000;
+            if (elapsed_ms < (uint64_t)limit_ms) {
+                struct pollfd pfd = { .fd = g_events.fd, .events = POLLOUT };
+                poll(&pfd, 1, limit_ms - (int)elapsed_ms);
+                continue;
+            }
+        }
+        if (n < 0 && errno == EAGAIN && partial == 0 && wait_ms == 0) break;
+#endif
+        /* The reader is gone or too slow: whole events that didn't make it are lost */
+        if ((n < 0 && errno == EPIPE) || partial > 0) {
+            close(g_events.fd);
+            g_events.fd = -1;
+        }
+        for (size_t i = written; i < g_events.buf.count; i++) {
+            if (g_events.buf.items[i] == '\n') g_events.dropped++;
+        }
+        written = g_events.buf.count;
+    }
+
+    memmove(g_events.buf.items, g_events.buf.items + written, g_events.buf.count - written);
+    g_events.buf.count -= written;
+}
+
+static void events_append_string(const char* s) {
+    sb_append_cstr(&g_events.buf, "\"");
+    for (const unsigned char* p = (const unsigned char*)s; *p; p++) {
+        switch (*p) {
+            case '"':  sb_append_cstr(&g_events.buf, "\\\""); break;
+            case '\\': sb_append_cstr(&g_events.buf, "\\\\"); break;
+            case '\n': sb_append_cstr(&g_events.buf, "\\n"); break;
+            case '\r': sb_append_cstr(&g_events.buf, "\\r"); break;
+            case '\t': sb_append_cstr(&g_events.buf, "\\t"); break;
+            default:
+                if (*p < 0x20) {
+                    char esc[8];
+                    snprintf(esc, sizeof(esc), "\\u%04x", *p);
+                    sb_append_cstr(&g_events.buf, esc);
+                } else {
+                    da_append(&g_events.buf, (char)*p);
+                }
+                break;
+        }
+    }
+    sb_append_cstr(&g_events.buf, "\"");
+}
+
+static void events_key(const char* key) {
+    sb_append_cstr(&g_events.buf, ",");
+    events_append_string(key);
+    sb_append_cstr(&g_events.buf, ":");
+}
+
+/*
+ * Start an event called `name`; add its fields with events_str() and
+ * friends and send it with events_end(). Returns false when events are
+ * off, then the rest are no-ops.
+ */
+bool events_begin(const char* name) {
+    if (g_events.fd < 0) return false;
+
+    /* A forked child starts with its parent's unsent events; those are the parent's to write */
+    int pid = (int)events_getpid();
+    if (pid != g_events.pid) {
+        g_events.buf.count = 0;
+        g_events.pid = pid;
+    }
+
+    struct timespec ts = {0};
+    timespec_get(&ts, TIME_UTC);
+    char head[64];
+    snprintf(head, sizeof(head), "{\"ts\":%lld.%03ld,\"event\":", (long long)ts.tv_sec, ts.tv_nsec / 1000000);
+
+    g_events.event_start = g_events.buf.count;
+    g_events.building = true;
+    sb_append_cstr(&g_events.buf, head);
+    events_append_string(name);
+    return true;
+}
+
+void events_str(const char* key, const char* value) {
+    if (!g_events.building || !value) return;
+    events_key(key);
+    events_append_string(value);
+}
+
+void events_int(const char* key, long long value) {
+    if (!g_events.building) return;
+    events_key(key);
+    char num[32];
+    snprintf(num, sizeof(num), "%lld", value);
+    sb_append_cstr(&g_events.buf, num);
+}
+
+void events_num(const char* key, double value) {
+    if (!g_events.building) return;
+    events_key(key);
+    char num[32];
+    snprintf(num, sizeof(num), "%.3f", value);
+    sb_append_cstr(&g_events.buf, num);
+}
+
+void events_bool(const char* key, bool value) {
+    if (!g_events.building) return;
+    events_key(key);
+    sb_append_cstr(&g_events.buf, value ? "true" : "false");
+}
+
+void events_end(void) {
+    if (!g_events.building) return;
+    g_events.building = false;
+    sb_append_cstr(&g_events.buf, "}\n");
+
+    if (g_events.buf.count > EVENTS_MAX_BUFFER) {
+        g_events.buf.count = g_events.event_start;
+        g_events.dropped++;
+    }
+    events_flush(0);
+}
+
+/*
+ * Send what is still buffered before this process exits, waiting at most
+ * EVENTS_CLOSE_WAIT_MS for a slow reader. Forked jobs call it before _exit().
+ */
+void events_finish(void) {
+    if (g_events.fd < 0 || g_events.pid != (int)events_getpid()) return;
+    events_flush(EVENTS_CLOSE_WAIT_MS);
+}
+
+/*
+ * At exit of the main process: flush, report dropped events, close.
+ */
+void events_close(void) {
+    if (g_events.fd < 0 || g_events.pid != (int)events_getpid()) return;
+    events_flush(EVENTS_CLOSE_WAIT_MS);
+    if (g_events.dropped > 0 && events_begin("dropped")) {
+        events_int("count", (long long)g_events.dropped);
+        events_end();
+        events_flush(EVENTS_CLOSE_WAIT_MS);
+    }
+    close(g_events.fd);
+    g_events.fd = -1;
+    sb_free(g_events.buf);
+    memset(&g_events.buf, 0, sizeof(g_events.buf));
+}
+
+/*
+ * Forget the stream without writing to it, for a process that outlives
+ * the run (the fsmonitor daemon).
+ */
+void events_detach(void) {
+    if (g_events.fd < 0) return;
+    close(g_events.fd);
+    g_events.fd = -1;
+    g_events.buf.count = 0;
+}
@@ -8,6 +8,31 @@
  *   - Variable interpolation in commands
  *   - goto (continues after target) / call (returns back) semantics
  *   - Inside labels: call other labels by name
+ *   - Alias targets split across CI nodes with --shard
+ *   - Per-target duration, CPU time and I/O history in .mewo/timings
+ *   - Per-command resource usage, logged with --debug
+ *   - #perfstat(var) counts cycles, instructions, faults, ... of a command
+ *   - #priority(high|normal|background) sets nice and I/O priority of
+ *     everything a label runs
+ *   - #cpuset(list[, exclusive]) pins a command or label to CPUs
+ *   - #scratch gives a command or label a temporary ${scratch} directory
+ *   - Asks the fsmonitor daemon what changed since the last run
+ *   - Trivial commands (echo, mkdir, rm, cp, touch) run in-process
+ *   - #copy / #install of files and trees (copy.c)
+ *   - Label pipelines (call a | b, #pipe(a, b)) streaming over kernel pipes
+ *   - #stdin(var) feeds a variable to a command through a pipe
+ *   - #traced commands record the files they touch and are skipped
+ *     while none of them changed (trace.c, deps.c)
+ *   - #depfile(path) does the same from a compiler's -MD output
+ *   - Pattern labels (build/%.o: src/%.c) run one job per out-of-date
+ *     target, in parallel up to -j (pattern.c, jobs.c), or per chunk of
+ *     targets with #batch(max_files)
+ *   - #pool(name, size) declares a resource pool; #pool(name) on a command,
+ *     label or pattern label runs it in one of the pool's slots (pool.c)
+ *   - Commands are waited for through reaper.c; #timeout(ms) stops one
+ *     that runs too long (SIGTERM, then SIGKILL)
+ *   - Completed commands are journaled; --resume skips them (journal.c)
+ *   - Label, command and pattern events for --events (events.c)
  */
 
 /* Note: This file is included from main.c which provides:
@@ -16,16 +41,35 @@
  *   - nob.h utilities
  *   - AST, Stmt types from parser.c
  *   - Variable types and functions from vars.c
+ *   - builtin_run() from builtins.c
+ *   - copy_path(), copy_mkdir_parents() from copy.c
+ *   - pattern_expand(), pattern_stale(), pattern_word_list() from pattern.c
+ *   - Jobs from jobs.c
+ *   - pool_declare(), pool_acquire(), pool_release() from pool.c
+ *   - rusage_begin(), rusage_end() from rusage.c
+ *   - perfstat_start(), perfstat_stop() from perfstat.c
+ *   - priority_run() from priority.c
+ *   - cpuset_parse(), cpuset_enter(), cpuset_leave() from cpuset.c
+ *   - scratch_enter(), scratch_leave(), scratch_create() from scratch.c
+ *   - deps_up_to_date(), deps_record() from deps.c
+ *   - trace_run() from trace.c
+ *   - reaper_init(), reaper_add(), reaper_wait() from reaper.c
+ *   - journal_key(), journal_skip(), journal_record(), journal_command_failed() from journal.c
+ *   - events_begin(), events_str(), events_end(), events_finish() from events.c
  */
 
 #ifdef _WIN32
 #include <direct.h>
 #include <process.h>
+#include <io.h>
 #define getcwd _getcwd
 #define chdir _chdir
 #define getpid _getpid
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <sys/wait.h>
 #endif
 
@@ -50,6 +94,7 @@ typedef struct {
     } call_stack;
     
     int current_label_index;
+    bool shard_applied;
     
     struct {
         Stmt** attrs;
@@ -59,6 +104,10 @@ typedef struct {
     
 } ExecContext;
 
+#define TIMINGS_PATH MEWO_STATE_DIR "/timings"
+
+static History g_timings = {0};
+
 static bool exec_stmt(ExecContext* ctx, Stmt* stmt, size_t line_number);
 static bool exec_label(ExecContext* ctx, const char* label_name, size_t caller_line);
 static bool exec_command(ExecContext* ctx, const char* raw_cmd, size_t line_number);
@@ -141,7 +190,9 @@ static void ctx_clear_pending_attrs(ExecContext* ctx) {
 static void ctx_add_pending_attr(ExecContext* ctx, Stmt* attr) {
     if (ctx->pending_attrs.count > 0) {
         Stmt* last_attr = ctx->pending_attrs.attrs[ctx->pending_attrs.count - 1];
-        if (last_attr->indent_level == attr->indent_level) {
+        /* Attributes on one line all apply; on separate lines the last one wins, as before */
+        bool same_line = attr->line_number == last_attr->line_number;
+        if (last_attr->indent_level == attr->indent_level && !same_line) {
             ctx_clear_pending_attrs(ctx);
         }
     }
@@ -384,6 +435,15 @@ typedef struct {
     char* save_stream;
     char* save_var;
     bool use_system_shell;
+    bool external;
+    char* stdin_var;
+    bool traced;
+    char* depfile;
+    char* pool;
+    bool perfstat;
+    char* perfstat_var;
+    Stmt* cpuset;
+    bool scratch;
 } CmdAttrs;
 
 static void cmd_attrs_init(CmdAttrs* attrs) {
@@ -396,6 +456,10 @@ static void cmd_attrs_free(CmdAttrs* attrs) {
     free(attrs->shell);
     free(attrs->save_stream);
     free(attrs->save_var);
+    free(attrs->stdin_var);
+    free(attrs->depfile);
+    free(attrs->pool);
+    free(attrs->perfstat_var);
 }
 
 static void apply_pending_attrs(ExecContext* ctx, CmdAttrs* attrs) {
@@ -453,6 +517,35 @@ static void apply_pending_attrs(ExecContext* ctx, CmdAttrs* attrs) {
             }
         } else if (strcmp(attr->attr.name, "once") == 0) {
             attrs->once = true;
+        } else if (strcmp(attr->attr.name, "external") == 0) {
+            attrs->external = true;
+        } else if (strcmp(attr->attr.name, "traced") == 0) {
+            attrs->traced = true;
+        } else if (strcmp(attr->attr.name, "depfile") == 0) {
+            if (attr->attr.param_count > 0) {
+                free(attrs->depfile);
+                attrs->depfile = str_dup(attr->attr.parameters[0]->command.raw_line);
+            }
+        } else if (strcmp(attr->attr.name, "perfstat") == 0) {
+            attrs->perfstat = true;
+            if (attr->attr.param_count > 0) {
+                free(attrs->perfstat_var);
+                attrs->perfstat_var = str_dup(attr->attr.parameters[0]->command.raw_line);
+            }
+        } else if (strcmp(attr->attr.name, "cpuset") == 0) {
+            attrs->cpuset = attr;
+        } else if (strcmp(attr->attr.name, "scratch") == 0) {
+            attrs->scratch = true;
+        } else if (strcmp(attr->attr.name, "pool") == 0) {
+            if (attr->attr.param_count == 1) {
+                free(attrs->pool);
+                attrs->pool = str_dup(attr->attr.parameters[0]->command.raw_line);
+            }
+        } else if (strcmp(attr->attr.name, "stdin") == 0) {
+            if (attr->attr.param_count > 0) {
+                free(attrs->stdin_var);
+                attrs->stdin_var = str_dup(attr->attr.parameters[0]->command.raw_line);
+            }
         } else if (strcmp(attr->attr.name, "save") == 0) {
             if (attr->attr.param_count >= 2) {
                 attrs->save_stream = str_dup(attr->attr.parameters[0]->command.raw_line);
@@ -463,41 +556,539 @@ static void apply_pending_attrs(ExecContext* ctx, CmdAttrs* attrs) {
     ctx_clear_pending_attrs(ctx);
 }
 
-static bool exec_command(ExecContext* ctx, const char* raw_cmd, size_t line_number) {
-    char* cmd = interpolate(raw_cmd, line_number);
-    if (!cmd) {
+/*
+ * Contents of a variable as command input: strings as they are, arrays
+ * one item per line.
+ */
+static char* stdin_contents(const char* var_name, size_t line_number) {
+    Variable* var = vars_get(var_name);
+    if (!var) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Undefined variable '%s' in #stdin", var_name);
+        set_error(ERROR_RUNTIME, msg, line_number);
+        return NULL;
+    }
+    if (var->type != VAR_ARRAY) return var_to_string(var);
+    
+    String_Builder sb = {0};
+    for (size_t i = 0; i < var->array_value.count; i++) {
+        char* item = var_to_string(var->array_value.items[i]);
+        sb_append_cstr(&sb, item);
+        sb_append_cstr(&sb, "\n");
+        free(item);
+    }
+    sb_append_null(&sb);
+    return sb.items;
+}
+
+#define EXEC_KILL_GRACE_MS 2000
+#define EXEC_TIMEOUT_EXIT_CODE 124
+
+#ifndef _WIN32
+static volatile sig_atomic_t g_exec_signal = 0;
+
+static void exec_on_signal(int sig) {
+    g_exec_signal = sig;
+}
+
+/*
+ * Signal a command started with a #timeout: its whole process group, so
+ * what the shell started goes too, or just the process if it has none.
+ */
+static void exec_kill(Nob_Proc proc, int sig) {
+    if (kill(-proc, sig) < 0) kill(proc, sig);
+}
+
+/*
+ * reaper_wait for `proc` that passes a SIGINT/SIGTERM caught meanwhile on
+ * to its process group (once) and goes on waiting out `timeout_ms`.
+ */
+static pid_t exec_reap(Reaper* reaper, Nob_Proc proc, int timeout_ms, int* wstatus) {
+    uint64_t start = nob_nanos_since_unspecified_epoch();
+    for (;;) {
+        int wait_ms = timeout_ms;
+        if (timeout_ms >= 0) {
+            uint64_t elapsed_ms = (nob_nanos_since_unspecified_epoch() - start) / 1000000;
+            wait_ms = elapsed_ms >= (uint64_t)timeout_ms ? 0 : timeout_ms - (int)elapsed_ms;
+        }
+        pid_t pid = reaper_wait(reaper, wait_ms, wstatus, NULL);
+        if (pid >= 0 || !reaper->interrupt || !*reaper->interrupt) return pid;
+        exec_kill(proc, *reaper->interrupt);
+        reaper->interrupt = NULL;
+    }
+}
+#endif
+
+/*
+ * Wait for a command's process. Once it runs longer than `timeout_ms`
+ * (0 = no limit) it is asked to stop with SIGTERM, and killed
+ * EXEC_KILL_GRACE_MS later if it is still there. Sets *exit_code (124,
+ * like timeout(1), when it timed out). False if waiting failed.
+ *
+ * With `in_fd` >= 0 (Unix only), `input` is written to it meanwhile:
+ * the non-blocking write end of the command's stdin, closed here.
+ *
+ * On Unix a command with a timeout leads its own process group (see
+ * exec_start), which is what gets signalled. That also keeps it from
+ * the terminal's Ctrl-C, so SIGINT/SIGTERM are passed on to it here and
+ * raised again once it is gone.
+ */
+static bool exec_wait_feeding(Nob_Proc proc, int in_fd, const char* input, int timeout_ms, int* exit_code, bool* timed_out) {
+    *timed_out = false;
+    if (proc == NOB_INVALID_PROC) return false;
+    
+#ifdef _WIN32
+    (void)in_fd;
+    (void)input;
+    DWORD result = WaitForSingleObject(proc, timeout_ms > 0 ? (DWORD)timeout_ms : INFINITE);
+    if (result == WAIT_TIMEOUT) {
+        *timed_out = true;
+        TerminateProcess(proc, EXEC_TIMEOUT_EXIT_CODE);
+        result = WaitForSingleObject(proc, INFINITE);
+    }
+    DWORD status = 0;
+    bool ok = result != WAIT_FAILED && GetExitCodeProcess(proc, &status);
+    CloseHandle(proc);
+    if (!ok) return false;
+    *exit_code = *timed_out ? EXEC_TIMEOUT_EXIT_CODE : (int)status;
+    return true;
+#else
+    Reaper reaper;
+    reaper_init(&reaper);
+    reaper_add(&reaper, proc, -1, NULL);
+    if (in_fd >= 0) reaper_feed(&reaper, proc, in_fd, input, strlen(input));
+    
+    struct sigaction old_sigint, old_sigterm;
+    if (timeout_ms > 0) {
+        g_exec_signal = 0;
+        reaper.interrupt = &g_exec_signal;
+        struct sigaction on_signal = {0};
+        on_signal.sa_handler = exec_on_signal;
+        sigemptyset(&on_signal.sa_mask);
+        sigaction(SIGINT, &on_signal, &old_sigint);
+        sigaction(SIGTERM, &on_signal, &old_sigterm);
+        /* Ignored stays ignored, as it is for the command itself */
+        if (old_sigint.sa_handler == SIG_IGN) sigaction(SIGINT, &old_sigint, NULL);
+        if (old_sigterm.sa_handler == SIG_IGN) sigaction(SIGTERM, &old_sigterm, NULL);
+    }
+    
+    int wstatus = 0;
+    pid_t pid = exec_reap(&reaper, proc, timeout_ms > 0 ? timeout_ms : -1, &wstatus);
+    if (pid == 0) {
+        *timed_out = true;
+        exec_kill(proc, SIGTERM);
+        pid = exec_reap(&reaper, proc, EXEC_KILL_GRACE_MS, &wstatus);
+        if (pid == 0) {
+            exec_kill(proc, SIGKILL);
+            pid = exec_reap(&reaper, proc, -1, &wstatus);
+        }
+    }
+    reaper_free(&reaper);
+    
+    if (timeout_ms > 0) {
+        sigaction(SIGINT, &old_sigint, NULL);
+        sigaction(SIGTERM, &old_sigterm, NULL);
+        if (g_exec_signal) raise(g_exec_signal);
+    }
+    if (pid < 0) return false;
+    
+    if (*timed_out) {
+        *exit_code = EXEC_TIMEOUT_EXIT_CODE;
+    } else if (WIFEXITED(wstatus)) {
+        *exit_code = WEXITSTATUS(wstatus);
+    } else if (WIFSIGNALED(wstatus)) {
+        *exit_code = 128 + WTERMSIG(wstatus);
+    } else {
+        *exit_code = -1;
+    }
+    return true;
+#endif
+}
+
+static bool exec_wait(Nob_Proc proc, int timeout_ms, int* exit_code, bool* timed_out) {
+    return exec_wait_feeding(proc, -1, NULL, timeout_ms, exit_code, timed_out);
+}
+
+/*
+ * Start `cmd` with stdout/stderr going to the files at `stdout_path` /
+ * `stderr_path` (NULL = inherited), as nob_cmd_run_opt does with async.
+ * On Unix a command with a timeout (`timeout_ms` > 0) leads its own
+ * process group, the way jobs and watch runs do, so the timeout reaches
+ * everything it started and not just the shell.
+ */
+static Nob_Proc exec_start(Cmd cmd, const char* stdout_path, const char* stderr_path, int timeout_ms) {
+#ifndef _WIN32
+    if (timeout_ms > 0) {
+        String_Builder rendered = {0};
+        nob_cmd_render(cmd, &rendered);
+        sb_append_null(&rendered);
+        nob_log(NOB_INFO, "CMD: %s", rendered.items);
+        sb_free(rendered);
+        
+        int out_fd = -1;
+        int err_fd = -1;
+        if (stdout_path && (out_fd = open(stdout_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+            nob_log(NOB_ERROR, "Could not open file %s: %s", stdout_path, strerror(errno));
+            return NOB_INVALID_PROC;
+        }
+        if (stderr_path && (err_fd = open(stderr_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+            nob_log(NOB_ERROR, "Could not open file %s: %s", stderr_path, strerror(errno));
+            if (out_fd >= 0) close(out_fd);
+            return NOB_INVALID_PROC;
+        }
+        
+        Cmd argv = {0};
+        da_append_many(&argv, cmd.items, cmd.count);
+        da_append(&argv, NULL);
+        
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid < 0) {
+            nob_log(NOB_ERROR, "Could not fork: %s", strerror(errno));
+        } else if (pid == 0) {
+            setpgid(0, 0);
+            if (out_fd >= 0) dup2(out_fd, STDOUT_FILENO);
+            if (err_fd >= 0) dup2(err_fd, STDERR_FILENO);
+            execvp(argv.items[0], (char* const*)argv.items);
+            fprintf(stderr, "Could not run %s: %s\n", argv.items[0], strerror(errno));
+            _exit(127);
+        } else {
+            /* Also here, so a timeout right after the fork can't miss the group */
+            setpgid(pid, pid);
+        }
+        
+        cmd_free(argv);
+        if (out_fd >= 0) close(out_fd);
+        if (err_fd >= 0) close(err_fd);
+        return pid < 0 ? NOB_INVALID_PROC : pid;
+    }
+#else
+    (void)timeout_ms;
+#endif
+    Nob_Cmd_Opt opt = {0};
+    opt.dont_reset = true;
+    opt.stdout_path = stdout_path;
+    opt.stderr_path = stderr_path;
+    Nob_Procs procs = {0};
+    opt.async = &procs;
+    Nob_Proc proc = nob_cmd_run_opt(&cmd, opt) ? procs.items[0] : NOB_INVALID_PROC;
+    da_free(procs);
+    return proc;
+}
+
+/*
+ * Run `cmd` through `shell` (NULL = /bin/sh) with `data` written to its
+ * stdin. The write end is non-blocking and fed from the same loop that
+ * waits for the child, so a child that reads slowly (or not at all)
+ * never stalls us on a full pipe, and #timeout still applies.
+ */
+static bool run_with_stdin(const char* shell, const char* cmd, const char* data, int timeout_ms, int* exit_code, bool* timed_out) {
+#ifdef _WIN32
+    size_t len = strlen(data);
+    char input_path[MAX_PATH];
+    snprintf(input_path, sizeof(input_path), "%s\\mewo_stdin_%d.tmp",
+             getenv("TEMP") ? getenv("TEMP") : ".", getpid());
+    if (!write_entire_file(input_path, data, len)) return false;
+    
+    Cmd nob_cmd = {0};
+    if (shell && strstr(shell, "%s")) {
+        nob_cmd_append(&nob_cmd, temp_sprintf(shell, cmd));
+    } else {
+        nob_cmd_append(&nob_cmd, shell ? shell : "cmd.exe", "/c", cmd);
+    }
+    
+    Nob_Cmd_Opt opt = {0};
+    opt.stdin_path = input_path;
+    
+    Nob_Procs procs = {0};
+    opt.async = &procs;
+    bool ok = nob_cmd_run_opt(&nob_cmd, opt) && exec_wait(procs.items[0], timeout_ms, exit_code, timed_out);
+    da_free(procs);
+    cmd_free(nob_cmd);
+    nob_delete_file(input_path);
+    if (!ok) *exit_code = 127;
+    return true;
+#else
+    int fds[2];
+    if (pipe(fds) < 0) {
+        nob_log(NOB_ERROR, "Could not create stdin pipe: %s", strerror(errno));
         return false;
     }
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
     
+    fflush(stdout);
+    fflush(stderr);
+    
+    pid_t pid = fork();
+    if (pid < 0) {
+        nob_log(NOB_ERROR, "Could not fork: %s", strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    
+    if (pid == 0) {
+        /* Its own process group for the timeout, as in exec_start */
+        if (timeout_ms > 0) setpgid(0, 0);
+        dup2(fds[0], STDIN_FILENO);
+        close(fds[0]);
+        
+        if (shell && strstr(shell, "%s")) {
+            char buffer[1024];
+            snprintf(buffer, sizeof(buffer), shell, cmd);
+            execl("/bin/sh", "sh", "-c", buffer, (char*)NULL);
+        } else {
+            const char* sh = shell ? shell : "/bin/sh";
+            execlp(sh, sh, "-c", cmd, (char*)NULL);
+        }
+        fprintf(stderr, "Could not run %s: %s\n", shell ? shell : "/bin/sh", strerror(errno));
+        _exit(127);
+    }
+    
+    if (timeout_ms > 0) setpgid(pid, pid);
+    close(fds[0]);
+    
+    /* A command that stops reading makes the write fail with EPIPE instead */
+    void (*old_sigpipe)(int) = signal(SIGPIPE, SIG_IGN);
+    bool ok = exec_wait_feeding(pid, fds[1], data, timeout_ms, exit_code, timed_out);
+    signal(SIGPIPE, old_sigpipe);
+    return ok;
+#endif
+}
+
+/*
+ * The CPUs of a #cpuset(list[, exclusive]) attribute. The list's commas
+ * split it into parameters, so they are joined back here.
+ */
+static bool cpuset_from_attr(Stmt* attr, CpuMask* mask, bool* exclusive) {
+    *exclusive = false;
+    
+    /* All of the parameters as one list, so a variable may hold several CPUs or "exclusive" too */
+    String_Builder raw = {0};
+    for (int i = 0; i < attr->attr.param_count; i++) {
+        if (i > 0) sb_append_cstr(&raw, ",");
+        sb_append_cstr(&raw, attr->attr.parameters[i]->command.raw_line);
+    }
+    sb_append_null(&raw);
+    char* text = interpolate(raw.items, attr->line_number);
+    sb_free(raw);
+    if (!text) return false;
+    
+    String_Builder list = {0};
+    bool ok = true;
+    for (char* part = text; ok;) {
+        char* end = strchr(part, ',');
+        if (end) *end = '\0';
+        char* item = str_trim(part);
+        if (strcmp(item, "exclusive") == 0) {
+            *exclusive = true;
+        } else {
+            if (list.count > 0) sb_append_cstr(&list, ",");
+            sb_append_cstr(&list, item);
+            ok = item[0] != '\0';
+        }
+        free(item);
+        if (!end) break;
+        part = end + 1;
+    }
+    sb_append_null(&list);
+    
+    ok = ok && cpuset_parse(list.items, mask);
+    if (!ok) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Invalid #cpuset '%s', expected a CPU list like 0-7,16", text);
+        set_error(ERROR_RUNTIME, msg, attr->line_number);
+    }
+    free(text);
+    sb_free(list);
+    return ok;
+}
+
+static bool exec_command_run(ExecContext* ctx, CmdAttrs* attrs, const char* raw_cmd, size_t line_number);
+
+static void exec_event_skip(const char* cmd, size_t line_number, const char* reason) {
+    if (!events_begin("command_skip")) return;
+    events_int("line", (long long)line_number);
+    events_str("command", cmd);
+    events_str("reason", reason);
+    events_end();
+}
+
+static bool exec_command(ExecContext* ctx, const char* raw_cmd, size_t line_number) {
     CmdAttrs attrs;
     cmd_attrs_init(&attrs);
     apply_pending_attrs(ctx, &attrs);
     
+    /* Before interpolating, so the command can use ${scratch} */
+    ScratchScope scratch;
+    if (attrs.scratch && !scratch_enter(&scratch, ctx->dry_run, line_number)) {
+        cmd_attrs_free(&attrs);
+        return false;
+    }
+    
+    bool ok = exec_command_run(ctx, &attrs, raw_cmd, line_number);
+    
+    if (attrs.scratch) scratch_leave(&scratch, ok);
+    cmd_attrs_free(&attrs);
+    return ok;
+}
+
+static bool exec_command_run(ExecContext* ctx, CmdAttrs* attrs, const char* raw_cmd, size_t line_number) {
+    char* cmd = interpolate(raw_cmd, line_number);
+    if (!cmd) {
+        return false;
+    }
+    
+    if (attrs->pool && !pool_exists(attrs->pool)) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Unknown pool '%s', declare it with #pool(%s, size)", attrs->pool, attrs->pool);
+        set_error(ERROR_RUNTIME, msg, line_number);
+        free(cmd);
+        return false;
+    }
+    
+    CpuMask cpus;
+    bool cpus_exclusive = false;
+    if (attrs->cpuset && !cpuset_from_attr(attrs->cpuset, &cpus, &cpus_exclusive)) {
+        free(cmd);
+        return false;
+    }
+    
     if (ctx->dry_run) {
         printf("[dry-run] %s\n", cmd);
         free(cmd);
-        cmd_attrs_free(&attrs);
         return true;
     }
     
+    const char* use_shell = NULL;
+    if (!attrs->use_system_shell) {
+        use_shell = attrs->shell ? attrs->shell : get_global_shell();
+    }
+    
+    unsigned char deps_id[20];
+    DepsFiles dep_files = {0};
+    if (attrs->traced && !trace_supported()) {
+        static bool warned = false;
+        if (!warned) nob_log(NOB_WARNING, "#traced is only supported on Linux, commands always run");
+        warned = true;
+        attrs->traced = false;
+    }
+    if (attrs->depfile) {
+        char* depfile = interpolate(attrs->depfile, line_number);
+        if (!depfile) {
+            free(cmd);
+            return false;
+        }
+        free(attrs->depfile);
+        attrs->depfile = depfile;
+    }
+    unsigned char journal_id[20];
+    bool journaled = false;
+    if (journal_active()) {
+        char* input = attrs->stdin_var ? stdin_contents(attrs->stdin_var, line_number) : NULL;
+        journal_key(attrs->cwd, use_shell, cmd, input, line_number, journal_id);
+        free(input);
+        journaled = journal_skip(journal_id, line_number);
+        /* #save still has to set its variable */
+        if (journaled && !attrs->save_var) {
+            if (ctx->echo) {
+                printf("%s (done, resuming)\n", cmd);
+            }
+            nob_log(NOB_INFO, "Skipping command completed before --resume: %s", cmd);
+            exec_event_skip(cmd, line_number, "resumed");
+            set_last_exit_code(0);
+            free(cmd);
+            return true;
+        }
+    }
+    
+    if (attrs->traced || attrs->depfile) {
+        deps_key(attrs->cwd, use_shell, cmd, deps_id);
+        if (deps_up_to_date(deps_id)) {
+            if (ctx->echo) {
+                printf("%s (up to date)\n", cmd);
+            }
+            nob_log(NOB_INFO, "Skipping up-to-date command: %s", cmd);
+            exec_event_skip(cmd, line_number, "up_to_date");
+            if (journal_active() && !journaled) journal_record(journal_id, line_number);
+            set_last_exit_code(0);
+            free(cmd);
+            return true;
+        }
+    }
+    
+    int pool_slot = attrs->pool ? pool_acquire(attrs->pool) : -1;
+    CpusetScope cpus_scope;
+    if (attrs->cpuset) cpuset_enter(&cpus, cpus_exclusive, &cpus_scope);
+    if (events_begin("command_start")) {
+        events_int("line", (long long)line_number);
+        events_str("command", cmd);
+        events_str("cwd", attrs->cwd);
+        events_end();
+    }
+    uint64_t start_ns = nob_nanos_since_unspecified_epoch();
+    RUsage usage_start;
+    rusage_begin(&usage_start);
+    /* Builtins can't be interrupted, so a command with #timeout always runs the real tool */
+    bool try_builtin = !attrs->external && !attrs->save_stream && !attrs->stdin_var && !attrs->traced &&
+                       attrs->timeout_ms == 0 && builtin_shell_compatible(use_shell);
+    RUsage self_start;
+    if (try_builtin) rusage_begin_self(&self_start);
+    bool ran_builtin = false;
+    PerfStat perf;
+    bool counting = attrs->perfstat && perfstat_start(&perf);
+    
     char* old_cwd = NULL;
-    if (attrs.cwd) {
+    if (attrs->cwd) {
         old_cwd = malloc(4096);
         if (old_cwd) {
             getcwd(old_cwd, 4096);
-            chdir(attrs.cwd);
+            chdir(attrs->cwd);
         }
     }
     
     bool success = true;
+    bool timed_out = false;
     int exit_code = 0;
     
-    const char* use_shell = NULL;
-    if (!attrs.use_system_shell) {
-        use_shell = attrs.shell ? attrs.shell : get_global_shell();
-    }
-    
-    if (use_shell) {
+    if (try_builtin && builtin_run(cmd, ctx->echo, &exit_code)) {
+        ran_builtin = true;
+        success = (exit_code == 0);
+    } else if (attrs->traced) {
+        if (ctx->echo) {
+            printf("%s\n", cmd);
+        }
+        if (!trace_run(old_cwd ? old_cwd : ".", use_shell, cmd, attrs->timeout_ms, &exit_code, &timed_out, &dep_files)) {
+            nob_log(NOB_ERROR, "Could not trace: %s", cmd);
+            exit_code = 127;
+        }
+        success = (exit_code == 0);
+    } else if (attrs->stdin_var) {
+        if (ctx->echo) {
+            printf("%s < ${%s}\n", cmd, attrs->stdin_var);
+        }
+        
+        char* input = stdin_contents(attrs->stdin_var, line_number);
+        if (!input) {
+            if (counting) perfstat_stop(&perf, NULL, 0);
+            if (attrs->cpuset) cpuset_leave(&cpus_scope);
+            if (attrs->pool) pool_release(attrs->pool, pool_slot);
+            free(cmd);
+            if (old_cwd) {
+                chdir(old_cwd);
+                free(old_cwd);
+            }
+            return false;
+        }
+        
+        if (!run_with_stdin(use_shell, cmd, input, attrs->timeout_ms, &exit_code, &timed_out)) {
+            exit_code = 127;
+        }
+        success = (exit_code == 0);
+        free(input);
+    } else if (use_shell) {
         Cmd nob_cmd = {0};
         if (strstr(use_shell, "%s")) {
             char buffer[1024];
@@ -523,82 +1114,135 @@ static bool exec_command(ExecContext* ctx, const char* raw_cmd, size_t line_numb
             }
         }
         
-        if (attrs.save_stream && attrs.save_var) {
-            char temp_file[256];
-#ifdef _WIN32
-            snprintf(temp_file, sizeof(temp_file), "%s\\mewo_capture_%d.tmp", 
-                     getenv("TEMP") ? getenv("TEMP") : ".", (int)GetCurrentProcessId());
-#else
-            snprintf(temp_file, sizeof(temp_file), "/tmp/mewo_capture_%d.tmp", getpid());
-#endif
-            
-            Nob_Cmd_Opt opt = {0};
-            opt.dont_reset = true;
-            if (strcmp(attrs.save_stream, "stdout") == 0) {
-                opt.stdout_path = temp_file;
-            } else if (strcmp(attrs.save_stream, "stderr") == 0) {
-                opt.stderr_path = temp_file;
-            }
+        if (attrs->save_stream && attrs->save_var) {
+            char* capture_dir = scratch_create(line_number);
+            const char* temp_file = capture_dir ? temp_sprintf("%s/capture", capture_dir) : NULL;
             
-            success = nob_cmd_run_opt(&nob_cmd, opt);
+            bool to_stdout = strcmp(attrs->save_stream, "stdout") == 0;
+            bool to_stderr = strcmp(attrs->save_stream, "stderr") == 0;
+            success = capture_dir &&
+                      exec_wait(exec_start(nob_cmd, to_stdout ? temp_file : NULL, to_stderr ? temp_file : NULL, attrs->timeout_ms),
+                                attrs->timeout_ms, &exit_code, &timed_out);
+            if (!success) exit_code = 127;
             
             String_Builder sb = {0};
-            if (read_entire_file(temp_file, &sb)) {
+            if (capture_dir && read_entire_file(temp_file, &sb)) {
                 sb_append_null(&sb);
-                vars_set_string(attrs.save_var, sb.items ? sb.items : "");
+                vars_set_string(attrs->save_var, sb.items ? sb.items : "");
                 sb_free(sb);
             } else {
-                vars_set_string(attrs.save_var, "");
+                vars_set_string(attrs->save_var, "");
             }
-            nob_delete_file(temp_file);
+            scratch_destroy(capture_dir, true);
         } else {
-            Nob_Proc proc = nob_cmd_run_async(nob_cmd);
+            Nob_Proc proc = exec_start(nob_cmd, NULL, NULL, attrs->timeout_ms);
             if (ctx->echo) {
                 printf("[async] %s\n", cmd);
             }
-            success = nob_proc_wait(proc);
+            if (!exec_wait(proc, attrs->timeout_ms, &exit_code, &timed_out)) exit_code = 127;
         }
         
         cmd_free(nob_cmd);
-        exit_code = success ? 0 : 1;
+        success = (exit_code == 0);
     } else {
         if (ctx->echo) {
             printf("%s\n", cmd);
         }
-        exit_code = system(cmd);
 #ifdef _WIN32
-        success = (exit_code == 0);
+        if (attrs->timeout_ms > 0) {
+            Cmd nob_cmd = {0};
+            nob_cmd_append(&nob_cmd, "cmd.exe", "/c", cmd);
+            if (!exec_wait(nob_cmd_run_async(nob_cmd), attrs->timeout_ms, &exit_code, &timed_out)) exit_code = 127;
+            cmd_free(nob_cmd);
+        } else {
+            exit_code = system(cmd);
+        }
 #else
-        success = (WIFEXITED(exit_code) && WEXITSTATUS(exit_code) == 0);
-        exit_code = WIFEXITED(exit_code) ? WEXITSTATUS(exit_code) : -1;
+        /* What system() does, but waited for through the reaper */
+        Cmd nob_cmd = {0};
+        nob_cmd_append(&nob_cmd, "/bin/sh", "-c", cmd);
+        if (!exec_wait(exec_start(nob_cmd, NULL, NULL, attrs->timeout_ms), attrs->timeout_ms, &exit_code, &timed_out)) exit_code = 127;
+        cmd_free(nob_cmd);
 #endif
+        success = (exit_code == 0);
     }
     
+    if (attrs->cpuset) cpuset_leave(&cpus_scope);
+    if (attrs->pool) pool_release(attrs->pool, pool_slot);
     set_last_exit_code(exit_code);
     
-    if (attrs.has_expect) {
-        success = (exit_code == attrs.expect_code);
+    RUsage usage;
+    rusage_end(ran_builtin ? &self_start : &usage_start, &usage);
+    rusage_set_last(&usage);
+    char usage_summary[512];
+    rusage_format(&usage, usage_summary, sizeof(usage_summary));
+    nob_log(NOB_INFO, "%zu: %s: %s", line_number, usage_summary, cmd);
+    
+    if (attrs->perfstat) {
+        char counters[512] = "";
+        if (counting) {
+            perfstat_stop(&perf, counters, sizeof(counters));
+            printf("[perfstat] %s\n", counters);
+            fflush(stdout);
+        }
+        if (attrs->perfstat_var) vars_set_string(attrs->perfstat_var, counters);
+    }
+    
+    if (attrs->has_expect) {
+        success = (exit_code == attrs->expect_code);
         if (!success) {
             char msg[256];
             snprintf(msg, sizeof(msg), "Expected exit code %d but got %d", 
-                     attrs.expect_code, exit_code);
+                     attrs->expect_code, exit_code);
             set_error(ERROR_RUNTIME, msg, line_number);
+            journal_command_failed();
         }
-    } else if (!success && !attrs.ignore_fail) {
+    } else if (timed_out && !attrs->ignore_fail) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Command timed out after %d ms", attrs->timeout_ms);
+        set_error(ERROR_RUNTIME, msg, line_number);
+        journal_command_failed();
+    } else if (!success && !attrs->ignore_fail) {
         char msg[256];
         snprintf(msg, sizeof(msg), "Command failed with exit code %d", exit_code);
         set_error(ERROR_RUNTIME, msg, line_number);
+        journal_command_failed();
     }
     
-    if (attrs.ignore_fail) success = true;
+    if (attrs->ignore_fail) success = true;
+    if (events_begin("command_end")) {
+        events_int("line", (long long)line_number);
+        events_str("command", cmd);
+        events_int("exit_code", exit_code);
+        events_bool("ok", success);
+        if (timed_out) events_bool("timed_out", true);
+        events_num("duration_ms", (double)(nob_nanos_since_unspecified_epoch() - start_ns) / 1000000.0);
+        events_num("cpu_ms", (usage.user_s + usage.sys_s) * 1000.0);
+        if (usage.max_rss_kb > 0) events_int("max_rss_kb", (long long)usage.max_rss_kb);
+        events_end();
+    }
+    if (success && journal_active() && !journaled) journal_record(journal_id, line_number);
     
     if (old_cwd) {
         chdir(old_cwd);
         free(old_cwd);
     }
     
+    if (attrs->traced || attrs->depfile) {
+        bool known = (exit_code == 0);
+        if (known && attrs->depfile && !deps_parse_depfile(attrs->depfile, attrs->cwd, &dep_files)) {
+            nob_log(NOB_WARNING, "%zu: could not read depfile %s", line_number, attrs->depfile);
+            known = false;
+        }
+        if (known) {
+            deps_record(deps_id, &dep_files);
+        } else {
+            deps_forget(deps_id);
+        }
+        deps_files_free(&dep_files);
+    }
+    
     free(cmd);
-    cmd_attrs_free(&attrs);
     
     return success;
 }
@@ -749,6 +1393,311 @@ static bool eval_condition(const char* condition, size_t line_number, bool* resu
     return true;
 }
 
+/*
+ * #copy(src, dst) and #install(src, dst[, mode])
+ */
+static bool exec_copy_attr(ExecContext* ctx, Stmt* stmt, size_t line_number) {
+    bool install = strcmp(stmt->attr.name, "install") == 0;
+    
+    if (stmt->attr.param_count < 2) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "#%s requires a source and a destination", stmt->attr.name);
+        set_error(ERROR_SYNTAX, msg, line_number);
+        ctx_clear_pending_attrs(ctx);
+        return false;
+    }
+    
+    char* src = interpolate(stmt->attr.parameters[0]->command.raw_line, line_number);
+    char* dst = src ? interpolate(stmt->attr.parameters[1]->command.raw_line, line_number) : NULL;
+    char* mode_str = NULL;
+    if (dst && stmt->attr.param_count > 2) {
+        mode_str = interpolate(stmt->attr.parameters[2]->command.raw_line, line_number);
+    }
+    bool ok = src && dst && (stmt->attr.param_count <= 2 || mode_str);
+    
+    CopyOpts opts = { .atomic = install, .mode = -1 };
+    if (ok && mode_str) {
+        char* end = NULL;
+        long mode = strtol(mode_str, &end, 8);
+        if (end == mode_str || *end != '\0' || mode < 0 || mode > 07777) {
+            char msg[256];
+            snprintf(msg, sizeof(msg), "Invalid mode '%s' for #%s, expected octal like 755", mode_str, stmt->attr.name);
+            set_error(ERROR_RUNTIME, msg, line_number);
+            ok = false;
+        }
+        opts.mode = (int)mode;
+    }
+    
+    if (ok) {
+        if (ctx->dry_run) {
+            printf("[dry-run] %s %s %s\n", stmt->attr.name, src, dst);
+        } else {
+            if (ctx->echo) {
+                printf("%s %s %s\n", stmt->attr.name, src, dst);
+            }
+            
+            CopyStats stats = {0};
+            ok = copy_path(src, dst, &opts, jobs_default_max(), &stats);
+            nob_log(NOB_INFO, "%s %s -> %s: %zu copied (%zu reflinked), %zu up to date, %" PRIu64 " KiB",
+                    stmt->attr.name, src, dst, stats.copied, stats.reflinked, stats.skipped, stats.bytes / 1024);
+            if (!ok) {
+                char msg[512];
+                snprintf(msg, sizeof(msg), "#%s failed: %s -> %s", stmt->attr.name, src, dst);
+                set_error(ERROR_RUNTIME, msg, line_number);
+            }
+        }
+    }
+    
+    free(src);
+    free(dst);
+    free(mode_str);
+    ctx_clear_pending_attrs(ctx);
+    return ok;
+}
+
+#define PIPELINE_MAX_STAGES 16
+
+/*
+ * Run labels as a pipeline: every stage runs concurrently in its own
+ * child, with its stdout connected to the next stage's stdin.
+ * The pipeline succeeds only if every stage succeeds.
+ */
+static bool exec_pipeline(ExecContext* ctx, char** stages, size_t count, size_t line_number) {
+    for (size_t i = 0; i < count; i++) {
+        if (find_label_index(ctx, stages[i]) < 0) {
+            char msg[256];
+            snprintf(msg, sizeof(msg), "Unknown label '%s' in pipeline", stages[i]);
+            set_error(ERROR_RUNTIME, msg, line_number);
+            return false;
+        }
+    }
+    
+    if (ctx->dry_run) {
+        for (size_t i = 0; i < count; i++) {
+            printf("[dry-run] %s%s\n", i > 0 ? "| " : "", stages[i]);
+            if (!exec_label(ctx, stages[i], line_number)) return false;
+        }
+        return true;
+    }
+    
+#ifdef _WIN32
+    /* No fork: run the stages one after another through temp files */
+    bool ok = true;
+    char* prev_path = NULL;
+    for (size_t i = 0; i < count && ok; i++) {
+        char* out_path = NULL;
+        int saved_in = -1, saved_out = -1;
+        
+        fflush(stdout);
+        if (prev_path) {
+            FILE* in = fopen(prev_path, "rb");
+            if (in) {
+                saved_in = _dup(_fileno(stdin));
+                _dup2(_fileno(in), _fileno(stdin));
+                fclose(in);
+            }
+        }
+        if (i + 1 < count) {
+            out_path = str_dup(temp_sprintf("%s\\mewo_pipe_%d_%zu.tmp",
+                                            getenv("TEMP") ? getenv("TEMP") : ".", getpid(), i));
+            FILE* out = fopen(out_path, "wb");
+            if (out) {
+                saved_out = _dup(_fileno(stdout));
+                _dup2(_fileno(out), _fileno(stdout));
+                fclose(out);
+            }
+        }
+        
+        ok = exec_label(ctx, stages[i], line_number);
+        
+        fflush(stdout);
+        if (saved_out >= 0) {
+            _dup2(saved_out, _fileno(stdout));
+            _close(saved_out);
+        }
+        if (saved_in >= 0) {
+            _dup2(saved_in, _fileno(stdin));
+            _close(saved_in);
+        }
+        if (prev_path) {
+            nob_delete_file(prev_path);
+            free(prev_path);
+        }
+        prev_path = out_path;
+    }
+    if (prev_path) {
+        nob_delete_file(prev_path);
+        free(prev_path);
+    }
+    return ok;
+#else
+    pid_t pids[PIPELINE_MAX_STAGES];
+    FILE* errors[PIPELINE_MAX_STAGES];
+    size_t started = 0;
+    int prev_read = -1;
+    bool ok = true;
+    
+    fflush(stdout);
+    fflush(stderr);
+    
+    for (size_t i = 0; i < count; i++) {
+        int data[2] = {-1, -1};
+        int err[2] = {-1, -1};
+        if ((i + 1 < count && pipe(data) < 0) || pipe(err) < 0) {
+            nob_log(NOB_ERROR, "Could not create pipe: %s", strerror(errno));
+            if (data[0] >= 0) {
+                close(data[0]);
+                close(data[1]);
+            }
+            ok = false;
+            break;
+        }
+        
+        pid_t pid = fork();
+        if (pid < 0) {
+            nob_log(NOB_ERROR, "Could not fork pipeline stage '%s': %s", stages[i], strerror(errno));
+            if (data[0] >= 0) {
+                close(data[0]);
+                close(data[1]);
+            }
+            close(err[0]);
+            close(err[1]);
+            ok = false;
+            break;
+        }
+        
+        if (pid == 0) {
+            close(err[0]);
+            if (prev_read >= 0) {
+                dup2(prev_read, STDIN_FILENO);
+                close(prev_read);
+            }
+            if (data[1] >= 0) {
+                dup2(data[1], STDOUT_FILENO);
+                close(data[1]);
+                close(data[0]);
+            }
+            for (size_t j = 0; j < started; j++) {
+                fclose(errors[j]);
+            }
+            
+            bool stage_ok = exec_label(ctx, stages[i], line_number);
+            fflush(stdout);
+            fflush(stderr);
+            
+            FILE* err_out = fdopen(err[1], "w");
+            if (err_out) {
+                if (!stage_ok) error_save(err_out);
+                fclose(err_out);
+            }
+            events_finish();
+            _exit(stage_ok ? 0 : 1);
+        }
+        
+        close(err[1]);
+        errors[started] = fdopen(err[0], "r");
+        pids[started++] = pid;
+        
+        if (prev_read >= 0) close(prev_read);
+        if (data[1] >= 0) close(data[1]);
+        prev_read = data[0];
+    }
+    
+    if (prev_read >= 0) close(prev_read);
+    
+    for (size_t i = 0; i < started; i++) {
+        int wstatus = 0;
+        while (waitpid(pids[i], &wstatus, 0) < 0 && errno == EINTR) {}
+        
+        bool stage_ok = WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0;
+        if (!stage_ok && ok) {
+            if (!errors[i] || !error_load(errors[i])) {
+                char msg[256];
+                snprintf(msg, sizeof(msg), "Pipeline stage '%s' failed", stages[i]);
+                set_error(ERROR_RUNTIME, msg, line_number);
+            }
+            ok = false;
+        }
+        if (errors[i]) fclose(errors[i]);
+    }
+    
+    return ok;
+#endif
+}
+
+/*
+ * Split "a | b | c" into trimmed label names. Returns the stage count,
+ * or 0 if the text is not a pipeline. Stops after `max` stages; `*more`
+ * tells whether there were more.
+ */
+static size_t split_pipeline(const char* text, char** stages, size_t max, bool* more) {
+    *more = false;
+    if (!strchr(text, '|')) return 0;
+    
+    size_t count = 0;
+    const char* p = text;
+    for (;;) {
+        if (count == max) {
+            *more = true;
+            break;
+        }
+        const char* end = strchr(p, '|');
+        if (!end) end = p + strlen(p);
+        
+        char* part = malloc(end - p + 1);
+        memcpy(part, p, end - p);
+        part[end - p] = '\0';
+        stages[count++] = str_trim(part);
+        free(part);
+        
+        if (*end == '\0') break;
+        p = end + 1;
+    }
+    return count;
+}
+
+static bool exec_pipeline_text(ExecContext* ctx, const char** parts, size_t part_count, size_t line_number) {
+    char* stages[PIPELINE_MAX_STAGES];
+    size_t count = 0;
+    bool too_many = false;
+    
+    for (size_t i = 0; i < part_count && !too_many; i++) {
+        size_t n = split_pipeline(parts[i], stages + count, PIPELINE_MAX_STAGES - count, &too_many);
+        if (n == 0 && !too_many) {
+            if (count == PIPELINE_MAX_STAGES) {
+                too_many = true;
+                break;
+            }
+            stages[count] = str_dup(parts[i]);
+            n = 1;
+        }
+        count += n;
+    }
+    
+    bool ok = true;
+    if (too_many) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "A pipeline has at most %d stages", PIPELINE_MAX_STAGES);
+        set_error(ERROR_SYNTAX, msg, line_number);
+        ok = false;
+    }
+    for (size_t i = 0; i < count && ok; i++) {
+        if (stages[i][0] == '\0') {
+            set_error(ERROR_SYNTAX, "Empty stage in pipeline", line_number);
+            ok = false;
+        }
+    }
+    if (ok && count < 2) {
+        set_error(ERROR_SYNTAX, "A pipeline needs at least two labels", line_number);
+        ok = false;
+    }
+    
+    if (ok) ok = exec_pipeline(ctx, stages, count, line_number);
+    
+    for (size_t i = 0; i < count; i++) free(stages[i]);
+    return ok;
+}
+
 static bool exec_stmt(ExecContext* ctx, Stmt* stmt, size_t stmt_index) {
     size_t line_number = stmt->line_number;
 
@@ -804,6 +1753,42 @@ static bool exec_stmt(ExecContext* ctx, Stmt* stmt, size_t stmt_index) {
                 }
                 return true;
             }
+            if (strcmp(stmt->attr.name, "copy") == 0 || strcmp(stmt->attr.name, "install") == 0) {
+                return exec_copy_attr(ctx, stmt, line_number);
+            }
+            
+            if (strcmp(stmt->attr.name, "pool") == 0 && stmt->attr.param_count >= 2) {
+                const char* name = stmt->attr.parameters[0]->command.raw_line;
+                char* size_str = interpolate(stmt->attr.parameters[1]->command.raw_line, line_number);
+                if (!size_str) return false;
+                char* end = NULL;
+                unsigned long size = strtoul(size_str, &end, 10);
+                bool valid = end != size_str && *end == '\0' && pool_declare(name, (size_t)size);
+                if (!valid) {
+                    char msg[256];
+                    snprintf(msg, sizeof(msg), "Invalid pool #pool(%s, %s), expected a name and a size of at least 1", name, size_str);
+                    set_error(ERROR_RUNTIME, msg, line_number);
+                }
+                free(size_str);
+                return valid;
+            }
+            
+            if (strcmp(stmt->attr.name, "watch") == 0) {
+                /* Only read by --watch */
+                return true;
+            }
+            
+            if (strcmp(stmt->attr.name, "pipe") == 0) {
+                const char** parts = malloc((stmt->attr.param_count + 1) * sizeof(char*));
+                for (int i = 0; i < stmt->attr.param_count; i++) {
+                    parts[i] = stmt->attr.parameters[i]->command.raw_line;
+                }
+                ctx_clear_pending_attrs(ctx);
+                bool ok = exec_pipeline_text(ctx, parts, stmt->attr.param_count, line_number);
+                free(parts);
+                return ok;
+            }
+            
             if (is_conditional_attr(stmt->attr.name)) {
                 ctx_clear_pending_attrs(ctx);
             }
@@ -881,6 +1866,7 @@ static bool exec_stmt(ExecContext* ctx, Stmt* stmt, size_t stmt_index) {
             return true;
         
         case STMT_LABEL_ALIAS:
+        case STMT_PATTERN:
             ctx_clear_pending_attrs(ctx);
             return true;
             
@@ -912,6 +1898,10 @@ static bool exec_stmt(ExecContext* ctx, Stmt* stmt, size_t stmt_index) {
         
         case STMT_CALL: {
             ctx_clear_pending_attrs(ctx);
+            if (strchr(stmt->call_stmt.target, '|')) {
+                const char* target = stmt->call_stmt.target;
+                return exec_pipeline_text(ctx, &target, 1, line_number);
+            }
             return exec_label(ctx, stmt->call_stmt.target, line_number);
         }
 
@@ -1000,43 +1990,431 @@ static bool exec_range(ExecContext* ctx, size_t start, size_t end, int base_inde
     return true;
 }
 
-static bool exec_label(ExecContext* ctx, const char* label_name, size_t caller_line) {
-    int label_idx = find_label_index(ctx, label_name);
-    if (label_idx < 0) {
+typedef struct {
+    ExecContext* ctx;
+    int label_index;
+    size_t start;
+    size_t end;
+    const PatternInstance** insts;
+    size_t count;
+} PatternJob;
+
+/*
+ * Run a pattern label's body for one file, with ${in}, ${out} and
+ * ${stem} set, or for a #batch of files with ${ins} and ${outs} set.
+ * Runs in a forked job, so the variables stay local to it.
+ */
+static bool pattern_run_job(void* data) {
+    PatternJob* job = data;
+    ExecContext* ctx = job->ctx;
+    size_t line_number = ctx->ast->stmts[job->start - 1]->line_number;
+    
+    if (job->count == 1) {
+        vars_set_string("in", job->insts[0]->in);
+        vars_set_string("out", job->insts[0]->out);
+        vars_set_string("stem", job->insts[0]->stem);
+    }
+    
+    char* rsp_ins = NULL;
+    char* rsp_outs = NULL;
+    if (!ctx->dry_run && mkdir_if_not_exists(MEWO_STATE_DIR)) {
+        rsp_ins = str_dup(temp_sprintf("%s/batch-%d-%p-ins.rsp", MEWO_STATE_DIR, (int)getpid(), (void*)job));
+        rsp_outs = str_dup(temp_sprintf("%s/batch-%d-%p-outs.rsp", MEWO_STATE_DIR, (int)getpid(), (void*)job));
+    }
+    char* ins = pattern_word_list(job->insts, job->count, false, rsp_ins);
+    char* outs = pattern_word_list(job->insts, job->count, true, rsp_outs);
+    vars_set_string("ins", ins);
+    vars_set_string("outs", outs);
+    free(ins);
+    free(outs);
+    
+    bool ok = true;
+    for (size_t i = 0; ok && !ctx->dry_run && i < job->count; i++) {
+        if (!copy_mkdir_parents(job->insts[i]->out)) {
+            char msg[512];
+            snprintf(msg, sizeof(msg), "Could not create the directory for %s", job->insts[i]->out);
+            set_error(ERROR_RUNTIME, msg, line_number);
+            ok = false;
+        }
+    }
+    
+    if (ok) {
+        int prev_label = ctx->current_label_index;
+        ctx->current_label_index = job->label_index;
+        ctx_clear_pending_attrs(ctx);
+        
+        ok = exec_range(ctx, job->start, job->end, 1);
+        
+        ctx->current_label_index = prev_label;
+    }
+    
+    if (rsp_ins && nob_file_exists(rsp_ins)) nob_delete_file(rsp_ins);
+    if (rsp_outs && nob_file_exists(rsp_outs)) nob_delete_file(rsp_outs);
+    free(rsp_ins);
+    free(rsp_outs);
+    return ok;
+}
+
+#ifdef _WIN32
+static bool pattern_run_job_in_process(void* data) {
+    Variables snap = vars_snapshot();
+    bool ok = pattern_run_job(data);
+    vars_restore(&snap);
+    return ok;
+}
+#endif
+
+/*
+ * The attribute `name` placed on the label at stmt_idx, or NULL.
+ */
+static Stmt* label_attr(ExecContext* ctx, size_t stmt_idx, const char* name) {
+    for (size_t i = stmt_idx; i > 0; i--) {
+        Stmt* attr = ctx->ast->stmts[i - 1];
+        if (attr->type != STMT_ATTR || attr->indent_level != 0) break;
+        if (strcmp(attr->attr.name, name) == 0) return attr;
+    }
+    return NULL;
+}
+
+/*
+ * The pool a label runs in from its #pool(name) attribute, or NULL.
+ */
+static bool label_pool(ExecContext* ctx, size_t stmt_idx, const char** out) {
+    *out = NULL;
+    Stmt* attr = label_attr(ctx, stmt_idx, "pool");
+    if (!attr || attr->attr.param_count != 1) return true;
+    
+    const char* name = attr->attr.parameters[0]->command.raw_line;
+    if (!pool_exists(name)) {
         char msg[256];
-        snprintf(msg, sizeof(msg), "Unknown label '%s'", label_name);
-        set_error(ERROR_RUNTIME, msg, caller_line);
+        snprintf(msg, sizeof(msg), "Unknown pool '%s', declare it with #pool(%s, size)", name, name);
+        set_error(ERROR_RUNTIME, msg, attr->line_number);
         return false;
     }
+    *out = name;
+    return true;
+}
+
+/*
+ * Files per invocation from a #batch(max_files) attribute on the pattern
+ * label: 1 without one, 0 (no limit) for a bare #batch.
+ */
+static bool pattern_batch_size(ExecContext* ctx, size_t stmt_idx, size_t* out) {
+    *out = 1;
+    Stmt* attr = label_attr(ctx, stmt_idx, "batch");
+    if (!attr) return true;
+    
+    *out = 0;
+    if (attr->attr.param_count == 0) return true;
+    
+    char* value = interpolate(attr->attr.parameters[0]->command.raw_line, attr->line_number);
+    if (!value) return false;
+    char* end = NULL;
+    unsigned long n = strtoul(value, &end, 10);
+    bool valid = end != value && *end == '\0';
+    if (!valid) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Invalid #batch size '%s', expected a number of files", value);
+        set_error(ERROR_RUNTIME, msg, attr->line_number);
+    }
+    free(value);
+    *out = (size_t)n;
+    return valid;
+}
+
+/*
+ * Expand a pattern label over the files matching its source pattern and
+ * run the body for the targets that are out of date: once per target, or
+ * per chunk of targets with #batch.
+ */
+static bool exec_pattern(ExecContext* ctx, int label_idx) {
+    size_t stmt_idx = ctx->labels.indices[label_idx];
+    Stmt* stmt = ctx->ast->stmts[stmt_idx];
+    size_t line_number = stmt->line_number;
+    size_t body_end = find_label_end(ctx, stmt_idx);
+    int prereq_count = stmt->pattern.prereq_count;
     
-    if (!exec_top_level_except_calls_and_gotos(ctx)) {
-        return false;
+    size_t batch = 1;
+    if (!pattern_batch_size(ctx, stmt_idx, &batch)) return false;
+    const char* pool = NULL;
+    if (!label_pool(ctx, stmt_idx, &pool)) return false;
+    if (ctx->dry_run) pool = NULL;
+    
+    char* target = interpolate(stmt->pattern.target, line_number);
+    char** prereqs = calloc(prereq_count, sizeof(char*));
+    bool ok = target != NULL;
+    for (int k = 0; ok && k < prereq_count; k++) {
+        prereqs[k] = interpolate(stmt->pattern.prereqs[k], line_number);
+        ok = prereqs[k] != NULL;
     }
     
+    PatternInstances insts = {0};
+    if (ok && !pattern_expand(target, prereqs[0], (const char**)prereqs + 1, prereq_count - 1, &insts)) {
+        char msg[512];
+        snprintf(msg, sizeof(msg), "Could not search for files matching %s", prereqs[0]);
+        set_error(ERROR_RUNTIME, msg, line_number);
+        ok = false;
+    }
+    if (ok && insts.count == 0) {
+        nob_log(NOB_WARNING, "%s: no files match %s", stmt->pattern.name, prereqs[0]);
+    }
+    
+    /* Bodies with #depfile or #traced commands know better than mtimes */
+    bool self_checked = false;
+    for (size_t i = stmt_idx + 1; i < body_end; i++) {
+        Stmt* s = ctx->ast->stmts[i];
+        if (s->type == STMT_ATTR && (strcmp(s->attr.name, "depfile") == 0 || strcmp(s->attr.name, "traced") == 0)) {
+            self_checked = true;
+        }
+    }
+    
+    const PatternInstance** stale = calloc(insts.count ? insts.count : 1, sizeof(PatternInstance*));
+    size_t stale_count = 0;
+    for (size_t i = 0; ok && i < insts.count; i++) {
+        if (self_checked || pattern_stale(&insts.items[i])) stale[stale_count++] = &insts.items[i];
+    }
+    
+    /* Spread a batch over the job slots rather than leave them idle */
+    size_t chunk = 1;
+    if (batch != 1 && stale_count > 0) {
+        size_t slots = jobs_default_max();
+        chunk = (stale_count + slots - 1) / slots;
+        if (batch > 0 && chunk > batch) chunk = batch;
+    }
+    
+    Jobs jobs = {0};
+    jobs.capture_output = true;
+    jobs.history_prefix = temp_sprintf("pattern:%s:", stmt->pattern.name);
+    PatternJob* runs = calloc(stale_count ? stale_count : 1, sizeof(PatternJob));
+    
+    for (size_t i = 0; i < stale_count; i += chunk) {
+        PatternJob* run = &runs[jobs.count];
+        run->ctx = ctx;
+        run->label_index = label_idx;
+        run->start = stmt_idx + 1;
+        run->end = body_end;
+        run->insts = stale + i;
+        run->count = stale_count - i < chunk ? stale_count - i : chunk;
+        
+        const char* name = stale[i]->out;
+        if (run->count > 1) name = temp_sprintf("%s +%zu", stale[i]->out, run->count - 1);
+#ifdef _WIN32
+        jobs_add_pooled(&jobs, name, pool, pattern_run_job_in_process, run);
+#else
+        jobs_add_pooled(&jobs, name, pool, pattern_run_job, run);
+#endif
+    }
+    
+    if (ok) {
+        nob_log(NOB_INFO, "%s: %zu of %zu targets out of date, %zu jobs", stmt->pattern.name,
+                stale_count, insts.count, jobs.count);
+        if (stale_count == 0 && insts.count > 0 && ctx->echo) {
+            printf("%s (up to date)\n", stmt->pattern.name);
+        }
+        if (events_begin("pattern")) {
+            events_str("label", stmt->pattern.name);
+            events_int("targets", (long long)insts.count);
+            events_int("stale", (long long)stale_count);
+            events_int("jobs", (long long)jobs.count);
+            events_end();
+        }
+        
+        bool all_ok = jobs_run(&jobs);
+        
+        /* A batch answers for each of its files: those it did bring up to date count as built */
+        size_t failed = 0;
+        size_t cancelled = 0;
+        for (size_t j = 0; j < jobs.count; j++) {
+            PatternJob* run = &runs[j];
+            if (jobs.items[j].cancelled) {
+                cancelled += run->count;
+                continue;
+            }
+            for (size_t i = 0; i < run->count; i++) {
+                bool built = jobs.items[j].ok;
+                if (run->count > 1 && !self_checked && !ctx->dry_run) {
+                    built = !pattern_stale(run->insts[i]);
+                    if (!built && jobs.items[j].ok) {
+                        nob_log(NOB_WARNING, "%s: %s was not updated by its batch", stmt->pattern.name, run->insts[i]->out);
+                        built = true;
+                    }
+                }
+                if (!built) failed++;
+            }
+        }
+        
+        if (!all_ok) {
+            char msg[512];
+            if (jobs_interrupted()) {
+                snprintf(msg, sizeof(msg), "Interrupted, %zu of %zu targets of '%s' not built", failed + cancelled,
+                         stale_count, stmt->pattern.name);
+            } else if (cancelled > 0) {
+                snprintf(msg, sizeof(msg), "%zu of %zu targets of '%s' failed, %zu cancelled", failed, stale_count,
+                         stmt->pattern.name, cancelled);
+            } else {
+                snprintf(msg, sizeof(msg), "%zu of %zu targets of '%s' failed", failed, stale_count, stmt->pattern.name);
+            }
+            set_error(ERROR_RUNTIME, msg, line_number);
+            journal_command_failed();
+            ok = false;
+        }
+    }
+    
+    jobs_free(&jobs);
+    free(runs);
+    free(stale);
+    pattern_instances_free(&insts);
+    for (int k = 0; k < prereq_count; k++) free(prereqs[k]);
+    free(prereqs);
+    free(target);
+    return ok;
+}
+
+/*
+ * The priority class of a label from its #priority(class) attribute.
+ */
+static bool label_priority(ExecContext* ctx, size_t stmt_idx, Priority* out) {
+    *out = PRIORITY_NORMAL;
+    Stmt* attr = label_attr(ctx, stmt_idx, "priority");
+    if (!attr) return true;
+    
+    const char* name = attr->attr.param_count > 0 ? attr->attr.parameters[0]->command.raw_line : "";
+    if (!priority_parse(name, out)) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Invalid #priority '%s', expected high, normal or background", name);
+        set_error(ERROR_RUNTIME, msg, attr->line_number);
+        return false;
+    }
+    return true;
+}
+
+typedef struct {
+    ExecContext* ctx;
+    int label_index;
+    size_t caller_line;
+} LabelRun;
+
+static bool exec_label_body(void* data) {
+    LabelRun* run = data;
+    ExecContext* ctx = run->ctx;
+    int label_idx = run->label_index;
+    size_t caller_line = run->caller_line;
     size_t label_stmt_idx = ctx->labels.indices[label_idx];
     Stmt* label_stmt = ctx->ast->stmts[label_stmt_idx];
     
+    if (label_stmt->type == STMT_PATTERN) {
+        return exec_pattern(ctx, label_idx);
+    }
+    
     if (label_stmt->type == STMT_LABEL_ALIAS) {
+        size_t target_count = label_stmt->label_alias.target_count;
+        bool* selected = malloc((target_count + 1) * sizeof(bool));
+        if (shard_active() && !ctx->shard_applied) {
+            ctx->shard_applied = true;
+            shard_select((const char**)label_stmt->label_alias.targets, target_count, "label:", selected);
+        } else {
+            for (size_t k = 0; k < target_count; k++) selected[k] = true;
+        }
+
         bool success = true;
-        for (size_t k = 0; k < label_stmt->label_alias.target_count; k++) {
-            success = exec_label(ctx, label_stmt->label_alias.targets[k], caller_line);
-            if (!success) break;
+        for (size_t k = 0; k < target_count; k++) {
+            const char* target = label_stmt->label_alias.targets[k];
+            if (!selected[k]) {
+                nob_log(NOB_INFO, "Skipping '%s': assigned to another shard", target);
+                continue;
+            }
+
+            uint64_t start = nob_nanos_since_unspecified_epoch();
+            RUsage usage_start, usage;
+            rusage_begin(&usage_start);
+            if (!exec_label(ctx, target, caller_line)) {
+                success = false;
+                if (!jobs_keep_going() || jobs_interrupted()) break;
+                /* --keep-going: the other targets don't depend on this one */
+                error_collect(target, false);
+                continue;
+            }
+
+            if (!ctx->dry_run) {
+                double ms = (double)(nob_nanos_since_unspecified_epoch() - start) / 1000000.0;
+                history_set(&g_timings, temp_sprintf("label:%s", target), ms);
+                rusage_end(&usage_start, &usage);
+                history_set(&g_timings, temp_sprintf("label-cpu:%s", target), (usage.user_s + usage.sys_s) * 1000.0);
+                history_set(&g_timings, temp_sprintf("label-read:%s", target), (double)usage.read_bytes);
+                history_set(&g_timings, temp_sprintf("label-write:%s", target), (double)usage.write_bytes);
+            }
         }
+        free(selected);
         return success;
     } else {
         size_t label_end = find_label_end(ctx, label_stmt_idx);
         
+        const char* pool = NULL;
+        if (!label_pool(ctx, label_stmt_idx, &pool)) return false;
+        int pool_slot = (pool && !ctx->dry_run) ? pool_acquire(pool) : -1;
+        
         int prev_label = ctx->current_label_index;
         ctx->current_label_index = label_idx;
         
         bool success = exec_range(ctx, label_stmt_idx + 1, label_end, 1);
         
         ctx->current_label_index = prev_label;
+        if (pool && !ctx->dry_run) pool_release(pool, pool_slot);
         
         return success;
     }
 }
 
+static bool exec_label(ExecContext* ctx, const char* label_name, size_t caller_line) {
+    int label_idx = find_label_index(ctx, label_name);
+    if (label_idx < 0) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Unknown label '%s'", label_name);
+        set_error(ERROR_RUNTIME, msg, caller_line);
+        return false;
+    }
+    
+    if (!exec_top_level_except_calls_and_gotos(ctx)) {
+        return false;
+    }
+    
+    size_t label_stmt_idx = ctx->labels.indices[label_idx];
+    Priority priority = PRIORITY_NORMAL;
+    if (!label_priority(ctx, label_stmt_idx, &priority)) return false;
+    
+    Stmt* cpuset_attr = label_attr(ctx, label_stmt_idx, "cpuset");
+    CpuMask cpus;
+    bool cpus_exclusive = false;
+    if (cpuset_attr && !cpuset_from_attr(cpuset_attr, &cpus, &cpus_exclusive)) return false;
+    
+    Stmt* scratch_attr = label_attr(ctx, label_stmt_idx, "scratch");
+    ScratchScope scratch;
+    if (scratch_attr && !scratch_enter(&scratch, ctx->dry_run, scratch_attr->line_number)) return false;
+    
+    CpusetScope cpus_scope = {0};
+    if (cpuset_attr && !ctx->dry_run) cpuset_enter(&cpus, cpus_exclusive, &cpus_scope);
+    
+    LabelRun run = { .ctx = ctx, .label_index = label_idx, .caller_line = caller_line };
+    if (events_begin("label_start")) {
+        events_str("label", label_name);
+        events_end();
+    }
+    uint64_t start_ns = nob_nanos_since_unspecified_epoch();
+    journal_enter_label(label_name);
+    bool ok = priority_run(ctx->dry_run ? PRIORITY_NORMAL : priority, exec_label_body, &run);
+    journal_leave_label();
+    if (events_begin("label_end")) {
+        events_str("label", label_name);
+        events_bool("ok", ok);
+        events_num("duration_ms", (double)(nob_nanos_since_unspecified_epoch() - start_ns) / 1000000.0);
+        events_end();
+    }
+    
+    cpuset_leave(&cpus_scope);
+    if (scratch_attr) scratch_leave(&scratch, ok);
+    return ok;
+}
+
 static bool register_all_labels(ExecContext* ctx) {
     for (size_t i = 0; i < ctx->ast->stmts_count; i++) {
         Stmt* stmt = ctx->ast->stmts[i];
@@ -1061,6 +2439,11 @@ static bool register_all_labels(ExecContext* ctx) {
                 return false;
             }
         }
+        if (stmt->type == STMT_PATTERN && stmt->indent_level == 0) {
+            if (!ctx_register_label(ctx, stmt->pattern.name, i)) {
+                return false;
+            }
+        }
     }
     return true;
 }
@@ -1071,7 +2454,8 @@ static bool exec_top_level(ExecContext* ctx) {
     while (i < ctx->ast->stmts_count) {
         Stmt* stmt = ctx->ast->stmts[i];
 
-        if ((stmt->type == STMT_LABEL || stmt->type == STMT_LABEL_ALIAS) && stmt->indent_level == 0) {
+        if ((stmt->type == STMT_LABEL || stmt->type == STMT_LABEL_ALIAS || stmt->type == STMT_PATTERN) &&
+            stmt->indent_level == 0) {
             if (stmt->type == STMT_LABEL && stmt->label.name[0] == '\0') {
                 size_t end = find_label_end(ctx, i);
                 if (check_pending_conditionals(ctx, stmt)) {
@@ -1163,7 +2547,8 @@ static bool exec_top_level_except_calls_and_gotos(ExecContext* ctx) {
     while (i < ctx->ast->stmts_count) {
         Stmt* stmt = ctx->ast->stmts[i];
 
-        if ((stmt->type == STMT_LABEL || stmt->type == STMT_LABEL_ALIAS) && stmt->indent_level == 0) {
+        if ((stmt->type == STMT_LABEL || stmt->type == STMT_LABEL_ALIAS || stmt->type == STMT_PATTERN) &&
+            stmt->indent_level == 0) {
             if (stmt->type == STMT_LABEL && stmt->label.name[0] == '\0') {
                 size_t end = find_label_end(ctx, i);
                 if (check_pending_conditionals(ctx, stmt)) {
@@ -1283,6 +2668,8 @@ bool execute(AST* ast, const char* label, bool dry_run, bool echo, const char* s
     
     vars_init();
     features_init();
+    history_load(&g_timings, TIMINGS_PATH);
+    fsmonitor_begin_run();
     
     for (size_t i = 0; i < enabled_count; i++) {
         feature_enable(enabled_features[i]);
@@ -1296,6 +2683,8 @@ bool execute(AST* ast, const char* label, bool dry_run, bool echo, const char* s
         ctx_free(&ctx);
         vars_free();
         features_free();
+        history_free(&g_timings);
+        fsmonitor_end_run(false);
         return false;
     }
     
@@ -1308,6 +2697,9 @@ bool execute(AST* ast, const char* label, bool dry_run, bool echo, const char* s
     }
     
     ctx_free(&ctx);
+    history_save(&g_timings, TIMINGS_PATH);
+    history_free(&g_timings);
+    fsmonitor_end_run(success && !dry_run);
     
     return success;
 }
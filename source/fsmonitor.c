@@ -0,0 +1,619 @@
+/*
+ * fsmonitor.c - File system monitor daemon for Mewo
+ *
+ * Features:
+ *   - Optional background process that watches the project with inotify
+ *     and remembers which paths changed, numbered by a sequence counter
+ *   - Clients ask "what changed since <token>" over a unix socket in
+ *     .mewo/ and only stat those paths instead of scanning every input
+ *   - Tokens carry the daemon's instance id: after a restart, a queue
+ *     overflow or too many changes the answer is "full", meaning the
+ *     client must fall back to a full scan
+ *   - Answers are relative to the last successful run; state recorded
+ *     before that (deps records carry their token) is scanned instead
+ *   - --fsmonitor=on starts the daemon on demand; start, stop and status
+ *     manage it by hand
+ *   - Linux only; elsewhere every query answers "full"
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - str_dup() from error.c
+ *   - MEWO_STATE_DIR from history.c
+ *   - nob.h utilities
+ *   - events_detach() from events.c
+ */
+
+#ifdef __linux__
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+
+#define FSMONITOR_SOCKET MEWO_STATE_DIR "/fsmonitor.sock"
+#define FSMONITOR_LOG MEWO_STATE_DIR "/fsmonitor.log"
+#define FSMONITOR_TOKEN_PATH MEWO_STATE_DIR "/fsmonitor.token"
+#define FSMONITOR_MAX_ENTRIES (1u << 20)
+
+/* ---- Client side ---- */
+
+/* A point in the daemon's change history; zero means none */
+typedef struct {
+    uint64_t instance;
+    uint64_t seq;
+} FsToken;
+
+typedef struct {
+    bool active;        /* a query succeeded for this run */
+    bool full;          /* everything must be treated as changed */
+    char** paths;
+    size_t count;
+    size_t capacity;
+    char* token;        /* token to store after a successful run */
+    FsToken since;      /* what `paths` are relative to */
+    FsToken now;        /* the daemon's token when it answered */
+} FsChanges;
+
+static FsChanges g_fs_changes = {0};
+static bool g_fsmonitor_enabled = false;
+
+void fsmonitor_set_enabled(bool enabled) {
+    g_fsmonitor_enabled = enabled;
+}
+
+static void fs_changes_add(FsChanges* changes, const char* path) {
+    if (changes->count >= changes->capacity) {
+        size_t new_cap = changes->capacity == 0 ? 64 : changes->capacity * 2;
+        char** new_paths = realloc(changes->paths, new_cap * sizeof(char*));
+        if (!new_paths) return;
+        changes->paths = new_paths;
+        changes->capacity = new_cap;
+    }
+    changes->paths[changes->count++] = str_dup(path);
+}
+
+static int fs_path_cmp(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+void fs_changes_free(FsChanges* changes) {
+    for (size_t i = 0; i < changes->count; i++) {
+        free(changes->paths[i]);
+    }
+    free(changes->paths);
+    free(changes->token);
+    memset(changes, 0, sizeof(FsChanges));
+}
+
+static bool fs_token_parse(const char* s, FsToken* token) {
+    memset(token, 0, sizeof(FsToken));
+    return sscanf(s, "%" SCNu64 ":%" SCNu64, &token->instance, &token->seq) == 2;
+}
+
+/*
+ * The token of this run's query, for state recorded now: a later run can
+ * trust the monitor about it only from this point on. Zero without one.
+ */
+FsToken fs_current_token(void) {
+    FsToken none = {0};
+    return g_fs_changes.active ? g_fs_changes.now : none;
+}
+
+/*
+ * Whether this run's answer covers state recorded at `recorded`. It only
+ * lists what changed since the last successful run, so state recorded
+ * before that is not covered.
+ */
+bool fs_token_covered(FsToken recorded) {
+    return g_fs_changes.active && !g_fs_changes.full && recorded.instance != 0 &&
+           recorded.instance == g_fs_changes.since.instance && recorded.seq >= g_fs_changes.since.seq;
+}
+
+/*
+ * Whether `path` may have changed since `recorded`, the token current
+ * when its state was recorded. True when the answer doesn't cover it.
+ */
+bool fs_maybe_changed(const char* path, FsToken recorded) {
+    if (!fs_token_covered(recorded)) return true;
+    while (path[0] == '.' && path[1] == '/') path += 2;
+    return bsearch(&path, g_fs_changes.paths, g_fs_changes.count, sizeof(char*), fs_path_cmp) != NULL;
+}
+
+#ifdef __linux__
+
+static int fsmonitor_connect(void) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", FSMONITOR_SOCKET);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Send one request line and read the whole reply into `sb`.
+ */
+static bool fsmonitor_request(const char* request, String_Builder* sb) {
+    int fd = fsmonitor_connect();
+    if (fd < 0) return false;
+
+    size_t len = strlen(request);
+    if (write(fd, request, len) != (ssize_t)len) {
+        close(fd);
+        return false;
+    }
+    shutdown(fd, SHUT_WR);
+
+    char buf[4096];
+    for (;;) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        sb_append_buf(sb, buf, (size_t)n);
+    }
+    close(fd);
+    sb_append_null(sb);
+    return true;
+}
+
+#endif
+
+static void fsmonitor_daemon(void);
+
+/*
+ * Start the daemon in the background unless it already runs.
+ */
+bool fsmonitor_start(void) {
+#ifdef __linux__
+    int fd = fsmonitor_connect();
+    if (fd >= 0) {
+        close(fd);
+        return true;
+    }
+
+    if (!mkdir_if_not_exists(MEWO_STATE_DIR)) return false;
+    unlink(FSMONITOR_SOCKET);
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        nob_log(NOB_ERROR, "Could not start fsmonitor: %s", strerror(errno));
+        return false;
+    }
+    if (pid == 0) {
+        setsid();
+        if (fork() != 0) _exit(0);
+        events_detach();
+
+        int null_fd = open("/dev/null", O_RDONLY);
+        int log_fd = open(FSMONITOR_LOG, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (null_fd >= 0) dup2(null_fd, STDIN_FILENO);
+        if (log_fd >= 0) {
+            dup2(log_fd, STDOUT_FILENO);
+            dup2(log_fd, STDERR_FILENO);
+        }
+        fsmonitor_daemon();
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+
+    for (int i = 0; i < 100; i++) {
+        fd = fsmonitor_connect();
+        if (fd >= 0) {
+            close(fd);
+            return true;
+        }
+        usleep(10 * 1000);
+    }
+    nob_log(NOB_ERROR, "fsmonitor did not come up, see %s", FSMONITOR_LOG);
+    return false;
+#else
+    nob_log(NOB_ERROR, "fsmonitor is only supported on Linux");
+    return false;
+#endif
+}
+
+bool fsmonitor_stop(void) {
+#ifdef __linux__
+    String_Builder sb = {0};
+    bool ok = fsmonitor_request("stop\n", &sb);
+    sb_free(sb);
+    printf(ok ? "fsmonitor stopped\n" : "fsmonitor is not running\n");
+    return true;
+#else
+    return true;
+#endif
+}
+
+bool fsmonitor_status(void) {
+#ifdef __linux__
+    String_Builder sb = {0};
+    if (!fsmonitor_request("status\n", &sb)) {
+        printf("fsmonitor is not running\n");
+        sb_free(sb);
+        return true;
+    }
+    printf("%s", sb.items);
+    sb_free(sb);
+    return true;
+#else
+    printf("fsmonitor is only supported on Linux\n");
+    return true;
+#endif
+}
+
+/*
+ * Ask the daemon what changed since the token stored by the last
+ * successful run, filling g_fs_changes. Starts the daemon if needed.
+ * On any failure g_fs_changes stays inactive and callers scan fully.
+ */
+void fsmonitor_begin_run(void) {
+    fs_changes_free(&g_fs_changes);
+    if (!g_fsmonitor_enabled) return;
+
+#ifdef __linux__
+    if (!fsmonitor_start()) return;
+
+    String_Builder token = {0};
+    if (nob_file_exists(FSMONITOR_TOKEN_PATH) && read_entire_file(FSMONITOR_TOKEN_PATH, &token)) {
+        while (token.count > 0 && (token.items[token.count - 1] == '\n' || token.items[token.count - 1] == ' ')) token.count--;
+    }
+    sb_append_null(&token);
+
+    String_Builder reply = {0};
+    char* request = temp_sprintf("since %s\n", token.count > 1 ? token.items : "none");
+    FsToken since;
+    fs_token_parse(token.items, &since);
+    sb_free(token);
+    if (!fsmonitor_request(request, &reply)) {
+        sb_free(reply);
+        return;
+    }
+
+    /* Reply: "<token> full|changes\n" followed by one path per line */
+    char* line = reply.items;
+    char* nl = strchr(line, '\n');
+    if (!nl) {
+        sb_free(reply);
+        return;
+    }
+    *nl = '\0';
+    char* space = strchr(line, ' ');
+    if (!space) {
+        sb_free(reply);
+        return;
+    }
+    *space = '\0';
+
+    g_fs_changes.token = str_dup(line);
+    g_fs_changes.full = strcmp(space + 1, "full") == 0 || !fs_token_parse(line, &g_fs_changes.now);
+    g_fs_changes.since = since;
+    g_fs_changes.active = true;
+
+    for (char* p = nl + 1; *p;) {
+        char* end = strchr(p, '\n');
+        if (!end) break;
+        *end = '\0';
+        if (*p) fs_changes_add(&g_fs_changes, p);
+        p = end + 1;
+    }
+    qsort(g_fs_changes.paths, g_fs_changes.count, sizeof(char*), fs_path_cmp);
+
+    nob_log(NOB_INFO, "fsmonitor: %s", g_fs_changes.full ? "full scan required" : temp_sprintf("%zu changed paths", g_fs_changes.count));
+    sb_free(reply);
+#endif
+}
+
+/*
+ * Remember the token of this run so the next one only sees newer changes.
+ * Only called after a successful run, so failed work is rechecked.
+ */
+void fsmonitor_end_run(bool success) {
+    if (success && g_fs_changes.active && g_fs_changes.token) {
+        String_Builder sb = {0};
+        sb_appendf(&sb, "%s\n", g_fs_changes.token);
+        write_entire_file(FSMONITOR_TOKEN_PATH, sb.items, sb.count);
+        sb_free(sb);
+    }
+    fs_changes_free(&g_fs_changes);
+}
+
+/* ---- Daemon ---- */
+
+#ifdef __linux__
+
+typedef struct {
+    char* path;
+    uint64_t seq;
+} FsEntry;
+
+typedef struct {
+    int inotify_fd;
+    int listen_fd;
+    uint64_t instance;
+    uint64_t seq;
+    uint64_t valid_since;   /* tokens older than this get a full answer */
+    bool scanning;
+
+    struct {
+        int* wds;
+        char** dirs;
+        size_t count;
+        size_t capacity;
+    } watches;
+
+    FsEntry* table;         /* open addressing, keyed by path */
+    size_t table_capacity;
+    size_t table_count;
+} FsMonitor;
+
+static uint64_t fsmonitor_hash(const char* s) {
+    uint64_t h = 14695981039346656037ULL;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void fsmonitor_clear(FsMonitor* m) {
+    for (size_t i = 0; i < m->table_capacity; i++) {
+        free(m->table[i].path);
+        m->table[i].path = NULL;
+    }
+    m->table_count = 0;
+    m->valid_since = ++m->seq;
+}
+
+static void fsmonitor_record(FsMonitor* m, const char* path) {
+    while (path[0] == '.' && path[1] == '/') path += 2;
+
+    if (m->table_count >= FSMONITOR_MAX_ENTRIES) {
+        printf("fsmonitor: too many changed paths, forcing a full scan\n");
+        fsmonitor_clear(m);
+    }
+
+    if ((m->table_count + 1) * 2 > m->table_capacity) {
+        size_t new_cap = m->table_capacity == 0 ? 1024 : m->table_capacity * 2;
+        FsEntry* new_table = calloc(new_cap, sizeof(FsEntry));
+        if (!new_table) return;
+        for (size_t i = 0; i < m->table_capacity; i++) {
+            if (!m->table[i].path) continue;
+            size_t j = fsmonitor_hash(m->table[i].path) & (new_cap - 1);
+            while (new_table[j].path) j = (j + 1) & (new_cap - 1);
+            new_table[j] = m->table[i];
+        }
+        free(m->table);
+        m->table = new_table;
+        m->table_capacity = new_cap;
+    }
+
+    size_t i = fsmonitor_hash(path) & (m->table_capacity - 1);
+    while (m->table[i].path && strcmp(m->table[i].path, path) != 0) {
+        i = (i + 1) & (m->table_capacity - 1);
+    }
+    if (!m->table[i].path) {
+        m->table[i].path = str_dup(path);
+        m->table_count++;
+    }
+    m->table[i].seq = ++m->seq;
+}
+
+static bool fsmonitor_ignored(const char* name) {
+    return name[0] == '.' && strcmp(name, ".") != 0;
+}
+
+static void fsmonitor_watch_dir(FsMonitor* m, const char* dir);
+
+static bool fsmonitor_watch_visit(Nob_Walk_Entry entry) {
+    FsMonitor* m = entry.data;
+    if (entry.level > 0 && fsmonitor_ignored(nob_path_name(entry.path))) {
+        *entry.action = NOB_WALK_SKIP;
+        return true;
+    }
+    if (entry.type == NOB_FILE_DIRECTORY) {
+        fsmonitor_watch_dir(m, entry.path);
+    } else if (entry.level > 0 && !m->scanning) {
+        /* Files that appeared inside a new directory before its watch existed */
+        fsmonitor_record(m, entry.path);
+    }
+    return true;
+}
+
+static void fsmonitor_watch_dir(FsMonitor* m, const char* dir) {
+    /* IN_MODIFY too: a file written while a run is going, but not closed yet, has changed all the same */
+    uint32_t mask = IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                    IN_ATTRIB | IN_DELETE_SELF | IN_ONLYDIR;
+    int wd = inotify_add_watch(m->inotify_fd, dir, mask);
+    if (wd < 0) {
+        printf("fsmonitor: could not watch %s: %s\n", dir, strerror(errno));
+        return;
+    }
+
+    for (size_t i = 0; i < m->watches.count; i++) {
+        if (m->watches.wds[i] == wd) {
+            free(m->watches.dirs[i]);
+            m->watches.dirs[i] = str_dup(dir);
+            return;
+        }
+    }
+
+    if (m->watches.count >= m->watches.capacity) {
+        size_t new_cap = m->watches.capacity == 0 ? 256 : m->watches.capacity * 2;
+        m->watches.wds = realloc(m->watches.wds, new_cap * sizeof(int));
+        m->watches.dirs = realloc(m->watches.dirs, new_cap * sizeof(char*));
+        m->watches.capacity = new_cap;
+    }
+    m->watches.wds[m->watches.count] = wd;
+    m->watches.dirs[m->watches.count] = str_dup(dir);
+    m->watches.count++;
+}
+
+static const char* fsmonitor_dir_of(FsMonitor* m, int wd) {
+    for (size_t i = 0; i < m->watches.count; i++) {
+        if (m->watches.wds[i] == wd) return m->watches.dirs[i];
+    }
+    return NULL;
+}
+
+static void fsmonitor_read_events(FsMonitor* m) {
+    char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t len = read(m->inotify_fd, buf, sizeof(buf));
+        if (len <= 0) return;
+
+        for (char* p = buf; p < buf + len;) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                printf("fsmonitor: event queue overflow, forcing a full scan\n");
+                fsmonitor_clear(m);
+                continue;
+            }
+
+            const char* dir = fsmonitor_dir_of(m, ev->wd);
+            if (!dir || ev->len == 0 || fsmonitor_ignored(ev->name)) continue;
+
+            size_t mark = temp_save();
+            const char* path = strcmp(dir, ".") == 0 ? ev->name : temp_sprintf("%s/%s", dir, ev->name);
+            fsmonitor_record(m, path);
+            if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO))) {
+                nob_walk_dir(path, fsmonitor_watch_visit, .data = m);
+            }
+            temp_rewind(mark);
+        }
+    }
+}
+
+static void fsmonitor_serve(FsMonitor* m, int client, bool* stop) {
+    char request[256];
+    size_t len = 0;
+    struct pollfd pfd = { .fd = client, .events = POLLIN };
+    while (len < sizeof(request) - 1 && poll(&pfd, 1, 1000) > 0) {
+        ssize_t n = read(client, request + len, sizeof(request) - 1 - len);
+        if (n <= 0) break;
+        len += (size_t)n;
+        if (memchr(request, '\n', len)) break;
+    }
+    request[len] = '\0';
+    char* nl = strchr(request, '\n');
+    if (nl) *nl = '\0';
+
+    /* Pick up everything that happened before answering */
+    fsmonitor_read_events(m);
+
+    String_Builder sb = {0};
+    if (strcmp(request, "stop") == 0) {
+        sb_append_cstr(&sb, "stopping\n");
+        *stop = true;
+    } else if (strcmp(request, "status") == 0) {
+        sb_appendf(&sb, "fsmonitor running (pid %d)\n", (int)getpid());
+        sb_appendf(&sb, "  token:       %" PRIu64 ":%" PRIu64 "\n", m->instance, m->seq);
+        sb_appendf(&sb, "  directories: %zu\n", m->watches.count);
+        sb_appendf(&sb, "  changed:     %zu paths\n", m->table_count);
+    } else if (strncmp(request, "since ", 6) == 0) {
+        uint64_t instance = 0, since = 0;
+        bool known = sscanf(request + 6, "%" SCNu64 ":%" SCNu64, &instance, &since) == 2 &&
+                     instance == m->instance && since >= m->valid_since;
+
+        sb_appendf(&sb, "%" PRIu64 ":%" PRIu64 " %s\n", m->instance, m->seq, known ? "changes" : "full");
+        if (known) {
+            for (size_t i = 0; i < m->table_capacity; i++) {
+                if (m->table[i].path && m->table[i].seq > since) {
+                    sb_appendf(&sb, "%s\n", m->table[i].path);
+                }
+            }
+        }
+    } else {
+        sb_append_cstr(&sb, "error unknown request\n");
+    }
+
+    for (size_t off = 0; off < sb.count;) {
+        ssize_t n = write(client, sb.items + off, sb.count - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        off += (size_t)n;
+    }
+    sb_free(sb);
+}
+
+static void fsmonitor_daemon(void) {
+    signal(SIGPIPE, SIG_IGN);
+
+    FsMonitor m = {0};
+    m.instance = nob_nanos_since_unspecified_epoch() ^ ((uint64_t)getpid() << 32);
+    m.seq = 1;
+    m.valid_since = 1;
+
+    m.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m.inotify_fd < 0) {
+        printf("fsmonitor: inotify unavailable: %s\n", strerror(errno));
+        return;
+    }
+    m.scanning = true;
+    nob_walk_dir(".", fsmonitor_watch_visit, .data = &m);
+    m.scanning = false;
+    fsmonitor_clear(&m);
+
+    m.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", FSMONITOR_SOCKET);
+    if (m.listen_fd < 0 || bind(m.listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(m.listen_fd, 16) < 0) {
+        printf("fsmonitor: could not listen on %s: %s\n", FSMONITOR_SOCKET, strerror(errno));
+        return;
+    }
+    printf("fsmonitor: started (pid %d), watching %zu directories\n", (int)getpid(), m.watches.count);
+    fflush(stdout);
+
+    bool stop = false;
+    while (!stop) {
+        struct pollfd fds[2] = {
+            { .fd = m.inotify_fd, .events = POLLIN },
+            { .fd = m.listen_fd, .events = POLLIN },
+        };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) fsmonitor_read_events(&m);
+
+        if (fds[1].revents & POLLIN) {
+            int client = accept(m.listen_fd, NULL, NULL);
+            if (client >= 0) {
+                fcntl(client, F_SETFD, FD_CLOEXEC);
+                fsmonitor_serve(&m, client, &stop);
+                close(client);
+            }
+        }
+
+        /* The project (or our socket) went away */
+        if (!nob_file_exists(FSMONITOR_SOCKET)) break;
+        fflush(stdout);
+    }
+
+    close(m.listen_fd);
+    unlink(FSMONITOR_SOCKET);
+    printf("fsmonitor: stopped\n");
+    fflush(stdout);
+}
+
+#else
+
+static void fsmonitor_daemon(void) {}
+
+#endif
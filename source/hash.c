@@ -0,0 +1,463 @@
+/*
+ * hash.c - Content hashing for Mewo
+ *
+ * Features:
+ *   - SHA-1 and git blob ids ("blob <size>\0<content>"), so hashes match
+ *     `git hash-object`
+ *   - Optional git index fast path (--git-index): .git/index is read
+ *     directly (versions 2, 3 and 4, no git process) and a tracked file
+ *     whose stat data still matches its index entry gets the recorded
+ *     blob id without being read
+ *   - Racily clean entries (modified in the same second the index was
+ *     written), conflicts, intent-to-add and split indexes are never
+ *     trusted; those files are hashed
+ *   - ${#hash(path)} exposes the id to Mewofiles
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - str_dup() from error.c
+ *   - nob.h utilities
+ */
+
+#include <sys/stat.h>
+
+/* ---- SHA-1 ---- */
+
+typedef struct {
+    uint32_t state[5];
+    uint64_t length;
+    unsigned char buffer[64];
+    size_t buffer_len;
+} Sha1;
+
+#define SHA1_ROL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+static void sha1_block(Sha1* s, const unsigned char* block) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+               ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        w[i] = SHA1_ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = s->state[0], b = s->state[1], c = s->state[2], d = s->state[3], e = s->state[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t t = SHA1_ROL(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = SHA1_ROL(b, 30);
+        b = a;
+        a = t;
+    }
+
+    s->state[0] += a;
+    s->state[1] += b;
+    s->state[2] += c;
+    s->state[3] += d;
+    s->state[4] += e;
+}
+
+void sha1_init(Sha1* s) {
+    s->state[0] = 0x67452301;
+    s->state[1] = 0xEFCDAB89;
+    s->state[2] = 0x98BADCFE;
+    s->state[3] = 0x10325476;
+    s->state[4] = 0xC3D2E1F0;
+    s->length = 0;
+    s->buffer_len = 0;
+}
+
+void sha1_update(Sha1* s, const void* data, size_t len) {
+    const unsigned char* p = data;
+    s->length += len;
+
+    if (s->buffer_len > 0) {
+        size_t take = 64 - s->buffer_len < len ? 64 - s->buffer_len : len;
+        memcpy(s->buffer + s->buffer_len, p, take);
+        s->buffer_len += take;
+        p += take;
+        len -= take;
+        if (s->buffer_len == 64) {
+            sha1_block(s, s->buffer);
+            s->buffer_len = 0;
+        }
+    }
+    while (len >= 64) {
+        sha1_block(s, p);
+        p += 64;
+        len -= 64;
+    }
+    if (len > 0) {
+        memcpy(s->buffer, p, len);
+        s->buffer_len = len;
+    }
+}
+
+void sha1_final(Sha1* s, unsigned char out[20]) {
+    uint64_t bits = s->length * 8;
+    unsigned char pad = 0x80;
+    sha1_update(s, &pad, 1);
+    unsigned char zero = 0;
+    while (s->buffer_len != 56) sha1_update(s, &zero, 1);
+
+    unsigned char len_be[8];
+    for (int i = 0; i < 8; i++) len_be[i] = (unsigned char)(bits >> (56 - i * 8));
+    sha1_update(s, len_be, 8);
+
+    for (int i = 0; i < 5; i++) {
+        out[i * 4] = (unsigned char)(s->state[i] >> 24);
+        out[i * 4 + 1] = (unsigned char)(s->state[i] >> 16);
+        out[i * 4 + 2] = (unsigned char)(s->state[i] >> 8);
+        out[i * 4 + 3] = (unsigned char)s->state[i];
+    }
+}
+
+static void hash_to_hex(const unsigned char id[20], char hex[41]) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < 20; i++) {
+        hex[i * 2] = digits[id[i] >> 4];
+        hex[i * 2 + 1] = digits[id[i] & 0xF];
+    }
+    hex[40] = '\0';
+}
+
+/*
+ * git blob id of a file on disk, computed by reading it.
+ */
+static bool hash_file_blob(const char* path, unsigned char id[20]) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+
+    struct stat st;
+    if (fstat(fileno(f), &st) < 0) {
+        fclose(f);
+        return false;
+    }
+
+    Sha1 s;
+    sha1_init(&s);
+    char header[64];
+    int header_len = snprintf(header, sizeof(header), "blob %llu", (unsigned long long)st.st_size);
+    sha1_update(&s, header, (size_t)header_len + 1);
+
+    char buf[64 * 1024];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        sha1_update(&s, buf, n);
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+
+    if (ok) sha1_final(&s, id);
+    return ok;
+}
+
+/* ---- git index ---- */
+
+typedef struct {
+    char* path;
+    unsigned char id[20];
+    uint32_t mtime_sec;
+    uint32_t mtime_nsec;
+    uint32_t ino;
+    uint32_t size;
+    bool trusted;
+} GitIndexEntry;
+
+typedef struct {
+    bool enabled;
+    bool loaded;
+    bool usable;
+    char* root;             /* absolute work tree path */
+    GitIndexEntry* entries;
+    size_t count;
+    size_t capacity;
+    size_t hits;
+    size_t misses;
+} GitIndex;
+
+static GitIndex g_git_index = {0};
+
+void gitindex_set_enabled(bool enabled) {
+    g_git_index.enabled = enabled;
+}
+
+static uint32_t gitindex_be32(const unsigned char* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void gitindex_push(GitIndex* gi, GitIndexEntry* entry) {
+    if (gi->count >= gi->capacity) {
+        size_t new_cap = gi->capacity == 0 ? 1024 : gi->capacity * 2;
+        GitIndexEntry* new_entries = realloc(gi->entries, new_cap * sizeof(GitIndexEntry));
+        if (!new_entries) return;
+        gi->entries = new_entries;
+        gi->capacity = new_cap;
+    }
+    gi->entries[gi->count++] = *entry;
+}
+
+/*
+ * Parse the index at `path`. See Documentation/gitformat-index.txt.
+ */
+static bool gitindex_parse(GitIndex* gi, const char* path) {
+    String_Builder sb = {0};
+    if (!read_entire_file(path, &sb)) return false;
+
+    const unsigned char* data = (const unsigned char*)sb.items;
+    size_t size = sb.count;
+    bool ok = false;
+
+    struct stat index_st;
+    if (stat(path, &index_st) < 0) goto done;
+    if (size < 12 + 20 || memcmp(data, "DIRC", 4) != 0) goto done;
+
+    uint32_t version = gitindex_be32(data + 4);
+    uint32_t count = gitindex_be32(data + 8);
+    if (version < 2 || version > 4) goto done;
+
+    size_t end = size - 20;
+    size_t off = 12;
+    char* prev = str_dup("");
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (off + 62 > end) {
+            free(prev);
+            goto done;
+        }
+        const unsigned char* e = data + off;
+
+        GitIndexEntry entry = {0};
+        entry.mtime_sec = gitindex_be32(e + 8);
+        entry.mtime_nsec = gitindex_be32(e + 12);
+        entry.ino = gitindex_be32(e + 20);
+        uint32_t mode = gitindex_be32(e + 24);
+        entry.size = gitindex_be32(e + 36);
+        memcpy(entry.id, e + 40, 20);
+        uint16_t flags = (uint16_t)((e[60] << 8) | e[61]);
+        size_t header = 62;
+
+        uint16_t ext_flags = 0;
+        if (version >= 3 && (flags & 0x4000)) {
+            ext_flags = (uint16_t)((e[62] << 8) | e[63]);
+            header += 2;
+        }
+
+        const unsigned char* name = e + header;
+        char* entry_path;
+        size_t name_len;
+
+        if (version == 4) {
+            /* Prefix compression: varint of bytes to drop from the previous path */
+            size_t drop = 0;
+            const unsigned char* q = name;
+            unsigned char c = *q++;
+            drop = c & 0x7F;
+            while (c & 0x80) {
+                c = *q++;
+                drop = ((drop + 1) << 7) | (c & 0x7F);
+            }
+            size_t prev_len = strlen(prev);
+            if (drop > prev_len) {
+                free(prev);
+                goto done;
+            }
+            const unsigned char* nul = memchr(q, 0, end - (size_t)(q - data));
+            if (!nul) {
+                free(prev);
+                goto done;
+            }
+            size_t suffix_len = (size_t)(nul - q);
+            name_len = prev_len - drop + suffix_len;
+            entry_path = malloc(name_len + 1);
+            memcpy(entry_path, prev, prev_len - drop);
+            memcpy(entry_path + prev_len - drop, q, suffix_len);
+            entry_path[name_len] = '\0';
+            off = (size_t)(nul - data) + 1;
+        } else {
+            const unsigned char* nul = memchr(name, 0, end - (size_t)(name - data));
+            if (!nul) {
+                free(prev);
+                goto done;
+            }
+            name_len = (size_t)(nul - name);
+            entry_path = malloc(name_len + 1);
+            memcpy(entry_path, name, name_len);
+            entry_path[name_len] = '\0';
+            /* Entries are NUL padded to a multiple of 8 bytes */
+            size_t entry_len = header + name_len;
+            off += (entry_len + 8) & ~(size_t)7;
+        }
+
+        free(prev);
+        prev = str_dup(entry_path);
+
+        bool stage = (flags & 0x3000) != 0;
+        bool intent_to_add = (ext_flags & 0x2000) != 0;
+        bool skip_worktree = (ext_flags & 0x4000) != 0;
+        bool regular = (mode & 0170000) == 0100000;
+        bool racy = entry.mtime_sec >= (uint32_t)index_st.st_mtime;
+
+        entry.path = entry_path;
+        entry.trusted = regular && !stage && !intent_to_add && !skip_worktree && !racy;
+        gitindex_push(gi, &entry);
+    }
+    free(prev);
+
+    /* A split index only holds part of the entries; don't trust it */
+    while (off + 8 <= end) {
+        uint32_t ext_size = gitindex_be32(data + off + 4);
+        if (memcmp(data + off, "link", 4) == 0) goto done;
+        off += 8 + ext_size;
+    }
+
+    ok = true;
+
+done:
+    sb_free(sb);
+    return ok;
+}
+
+static char* gitindex_find_root(void) {
+#ifdef _WIN32
+    return NULL;
+#else
+    char* dir = realpath(".", NULL);
+    if (!dir) return NULL;
+
+    for (;;) {
+        char* git = temp_sprintf("%s/.git", strcmp(dir, "/") == 0 ? "" : dir);
+        if (nob_file_exists(git)) return dir;
+
+        char* slash = strrchr(dir, '/');
+        if (!slash || slash == dir) break;
+        *slash = '\0';
+    }
+    free(dir);
+    return NULL;
+#endif
+}
+
+static void gitindex_load(GitIndex* gi) {
+    gi->loaded = true;
+    gi->root = gitindex_find_root();
+    if (!gi->root) {
+        nob_log(NOB_INFO, "git index: not inside a git work tree");
+        return;
+    }
+
+    char* index_path = temp_sprintf("%s/.git/index", gi->root);
+    if (nob_get_file_type(temp_sprintf("%s/.git", gi->root)) != NOB_FILE_DIRECTORY) {
+        /* Worktrees and submodules keep .git as a "gitdir: <path>" file */
+        String_Builder sb = {0};
+        if (read_entire_file(temp_sprintf("%s/.git", gi->root), &sb) && sb.count > 8 &&
+            memcmp(sb.items, "gitdir: ", 8) == 0) {
+            while (sb.count > 0 && (sb.items[sb.count - 1] == '\n' || sb.items[sb.count - 1] == '\r')) sb.count--;
+            sb_append_null(&sb);
+            const char* gitdir = sb.items + 8;
+            index_path = gitdir[0] == '/' ? temp_sprintf("%s/index", gitdir)
+                                          : temp_sprintf("%s/%s/index", gi->root, gitdir);
+        }
+        sb_free(sb);
+    }
+
+    if (!nob_file_exists(index_path) || !gitindex_parse(gi, index_path)) {
+        nob_log(NOB_WARNING, "git index: could not use %s, hashing files directly", index_path);
+        return;
+    }
+    gi->usable = true;
+    nob_log(NOB_INFO, "git index: %zu entries from %s", gi->count, index_path);
+}
+
+static GitIndexEntry* gitindex_lookup(GitIndex* gi, const char* rel) {
+    size_t lo = 0, hi = gi->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(gi->entries[mid].path, rel);
+        if (cmp == 0) return &gi->entries[mid];
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return NULL;
+}
+
+/*
+ * The blob id recorded in the index for `path`, if the file provably
+ * still has that content.
+ */
+static bool gitindex_get(GitIndex* gi, const char* path, unsigned char id[20]) {
+#ifdef _WIN32
+    (void)gi;
+    (void)path;
+    (void)id;
+    return false;
+#else
+    if (!gi->loaded) gitindex_load(gi);
+    if (!gi->usable) return false;
+
+    char* abs = realpath(path, NULL);
+    if (!abs) return false;
+
+    size_t root_len = strlen(gi->root);
+    bool inside = strncmp(abs, gi->root, root_len) == 0 && abs[root_len] == '/';
+    GitIndexEntry* entry = inside ? gitindex_lookup(gi, abs + root_len + 1) : NULL;
+    free(abs);
+    if (!entry || !entry->trusted) return false;
+
+    struct stat st;
+    if (stat(path, &st) < 0) return false;
+    if ((uint32_t)st.st_mtime != entry->mtime_sec ||
+#ifdef __APPLE__
+        (uint32_t)st.st_mtimespec.tv_nsec != entry->mtime_nsec ||
+#else
+        (uint32_t)st.st_mtim.tv_nsec != entry->mtime_nsec ||
+#endif
+        (uint32_t)st.st_size != entry->size ||
+        (uint32_t)st.st_ino != entry->ino) {
+        return false;
+    }
+
+    memcpy(id, entry->id, 20);
+    return true;
+#endif
+}
+
+/*
+ * Content id of a file (its git blob id).
+ * Uses the git index when --git-index is on, otherwise reads the file.
+ */
+bool file_content_id(const char* path, unsigned char id[20]) {
+    if (g_git_index.enabled && gitindex_get(&g_git_index, path, id)) {
+        g_git_index.hits++;
+        return true;
+    }
+    g_git_index.misses++;
+    return hash_file_blob(path, id);
+}
+
+/*
+ * Same as file_content_id(), as 40 hex digits.
+ */
+bool file_content_hash(const char* path, char hex[41]) {
+    unsigned char id[20];
+    if (!file_content_id(path, id)) return false;
+    hash_to_hex(id, hex);
+    return true;
+}
@@ -0,0 +1,138 @@
+/*
+ * history.c - Persistent key/value history for Mewo
+ *
+ * Features:
+ *   - Stores one number per key (durations, sizes, ...) between runs
+ *   - Line based "value key" text format; later lines win, so history
+ *     files from several machines can be merged with plain concatenation
+ *   - Atomic save (write to a per-process temp file, then rename), so
+ *     parallel jobs saving the same file don't trip over each other
+ *   - State lives under .mewo/ next to the Mewofile
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - str_dup() from error.c
+ *   - nob.h utilities
+ */
+
+#ifdef _WIN32
+#include <process.h>
+#define history_getpid _getpid
+#else
+#include <unistd.h>
+#define history_getpid getpid
+#endif
+
+#define MEWO_STATE_DIR ".mewo"
+
+typedef struct {
+    char** keys;
+    double* values;
+    size_t count;
+    size_t capacity;
+    bool dirty;
+} History;
+
+static int history_find_index(History* h, const char* key) {
+    for (size_t i = 0; i < h->count; i++) {
+        if (strcmp(h->keys[i], key) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+bool history_get(History* h, const char* key, double* out) {
+    int idx = history_find_index(h, key);
+    if (idx < 0) return false;
+    *out = h->values[idx];
+    return true;
+}
+
+void history_set(History* h, const char* key, double value) {
+    int idx = history_find_index(h, key);
+    if (idx >= 0) {
+        h->values[idx] = value;
+        h->dirty = true;
+        return;
+    }
+
+    if (h->count >= h->capacity) {
+        size_t new_cap = h->capacity == 0 ? 16 : h->capacity * 2;
+        char** new_keys = realloc(h->keys, new_cap * sizeof(char*));
+        if (!new_keys) return;
+        h->keys = new_keys;
+        double* new_values = realloc(h->values, new_cap * sizeof(double));
+        if (!new_values) return;
+        h->values = new_values;
+        h->capacity = new_cap;
+    }
+
+    h->keys[h->count] = str_dup(key);
+    h->values[h->count] = value;
+    h->count++;
+    h->dirty = true;
+}
+
+void history_free(History* h) {
+    for (size_t i = 0; i < h->count; i++) {
+        free(h->keys[i]);
+    }
+    free(h->keys);
+    free(h->values);
+    memset(h, 0, sizeof(History));
+}
+
+/*
+ * Load history from `path`. A missing file is not an error.
+ */
+bool history_load(History* h, const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return errno == ENOENT;
+
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        size_t len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+
+        char* end = NULL;
+        double value = strtod(line, &end);
+        if (end == line || *end != ' ' || end[1] == '\0') continue;
+
+        history_set(h, end + 1, value);
+    }
+
+    fclose(f);
+    h->dirty = false;
+    return true;
+}
+
+bool history_save(History* h, const char* path) {
+    if (!h->dirty) return true;
+
+    const char* slash = strrchr(path, '/');
+    if (slash) {
+        char dir[1024];
+        size_t dir_len = (size_t)(slash - path);
+        if (dir_len < sizeof(dir)) {
+            memcpy(dir, path, dir_len);
+            dir[dir_len] = '\0';
+            mkdir_if_not_exists(dir);
+        }
+    }
+
+    String_Builder sb = {0};
+    for (size_t i = 0; i < h->count; i++) {
+        sb_appendf(&sb, "%.3f %s\n", h->values[i], h->keys[i]);
+    }
+
+    /* Last writer wins, but every writer's file is whole */
+    char* tmp_path = temp_sprintf("%s.%d.tmp", path, (int)history_getpid());
+    bool ok = write_entire_file(tmp_path, sb.items ? sb.items : "", sb.count);
+    sb_free(sb);
+    if (ok) ok = nob_rename(tmp_path, path);
+    if (ok) h->dirty = false;
+    else remove(tmp_path);
+    return ok;
+}
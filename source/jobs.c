@@ -0,0 +1,765 @@
+/*
+ * jobs.c - Parallel job runner for Mewo
+ *
+ * Features:
+ *   - Runs independent units of work in forked children of the interpreter
+ *   - Each job sees the parsed AST, variables and features copy-on-write,
+ *     so jobs are isolated from each other without re-parsing the Mewofile
+ *   - Bounded concurrency (max_jobs, 0 = -j, or the number of CPUs)
+ *   - Optional per-job output capture, replayed as one block when the job ends
+ *   - Jobs in a resource pool only start when the pool has a free slot;
+ *     meanwhile jobs behind them in other pools (or none) go first
+ *   - Memory-aware admission: each job's peak RSS is kept in .mewo/rss and
+ *     a job only starts while the predicted total fits the memory budget
+ *     (--mem-budget, or MemAvailable / the cgroup limit on Linux)
+ *   - --numa-spread places jobs on the NUMA nodes round-robin
+ *   - Finished jobs are picked up through reaper.c as soon as they exit,
+ *     and only our own jobs are reaped
+ *   - Fail-fast: every job is its own process group; after the first
+ *     failure, or on Ctrl-C / SIGTERM, the running ones get SIGTERM and
+ *     SIGKILL JOBS_KILL_GRACE_MS later, and the rest don't start
+ *   - --keep-going runs everything anyway and collects each job's error
+ *     for the summary at the end
+ *   - --progress: a status line (done/running/pending, running jobs and an
+ *     ETA from each job's duration in earlier runs, kept in
+ *     .mewo/durations) redrawn every JOBS_PROGRESS_MS on a terminal, or
+ *     one line per finished job when stderr is not a terminal
+ *   - job_start / job_end events for --events
+ *   - Sequential in-process fallback on Windows
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - str_dup(), has_error(), print_error(), error_save(), error_collect() from error.c
+ *   - nob.h utilities
+ *   - pool_try_admit(), pool_return(), pool_release() from pool.c
+ *   - History, MEWO_STATE_DIR from history.c
+ *   - cpuset_spread() from cpuset.c
+ *   - reaper_add(), reaper_wait() from reaper.c
+ *   - events_begin(), events_end(), events_finish() from events.c
+ */
+
+#include <signal.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#endif
+
+#define JOBS_RSS_PATH MEWO_STATE_DIR "/rss"
+#define JOBS_DURATIONS_PATH MEWO_STATE_DIR "/durations"
+#define JOBS_KILL_GRACE_MS 2000
+#define JOBS_PROGRESS_MS 250
+
+typedef bool (*Job_Func)(void* data);
+
+typedef struct {
+    char* name;
+    char* pool;
+    bool pool_lent;         /* runs in the pool slot the caller holds (pool_try_admit) */
+    Job_Func func;
+    void* data;
+    bool ok;
+    bool started;
+    bool cancelled;         /* stopped, or never started, because another job failed */
+    uint64_t duration_ns;
+    size_t predicted_kb;
+    uint64_t predicted_ns;  /* 0 if unknown */
+    size_t peak_rss_kb;     /* 0 if unknown */
+
+    int pid;
+    int pgid;               /* stays set after the job is reaped */
+    FILE* output;
+    FILE* error;            /* the job's error, for --keep-going's summary */
+    uint64_t start_ns;
+} Job;
+
+typedef struct {
+    Job* items;
+    size_t count;
+    size_t capacity;
+
+    size_t max_jobs;
+    bool capture_output;
+    const char* error_file;
+    const char* history_prefix; /* peak RSS history key prefix, NULL to not keep any */
+    bool keep_going;            /* never cancel on a failure, even without --keep-going */
+} Jobs;
+
+static size_t g_jobs_max = 0;
+static const char* g_jobs_error_file = "Mewofile";
+static size_t g_jobs_mem_budget_mib = 0;
+static bool g_jobs_numa_spread = false;
+static bool g_jobs_keep_going = false;
+static bool g_jobs_progress = false;
+static volatile sig_atomic_t g_jobs_signal = 0;
+
+/*
+ * Defaults for job sets that don't choose their own: the -j limit and
+ * the Mewofile named in the errors failed jobs print.
+ */
+void jobs_set_defaults(size_t max_jobs, const char* error_file) {
+    g_jobs_max = max_jobs;
+    if (error_file) g_jobs_error_file = error_file;
+}
+
+/*
+ * Memory the jobs of one set may use together, in MiB (0 = find out).
+ */
+void jobs_set_mem_budget(size_t mib) {
+    g_jobs_mem_budget_mib = mib;
+}
+
+void jobs_set_numa_spread(bool spread) {
+    g_jobs_numa_spread = spread;
+}
+
+void jobs_set_progress(bool progress) {
+    g_jobs_progress = progress;
+}
+
+void jobs_set_keep_going(bool keep_going) {
+    g_jobs_keep_going = keep_going;
+}
+
+bool jobs_keep_going(void) {
+    return g_jobs_keep_going;
+}
+
+/*
+ * The signal (SIGINT, SIGTERM) that cancelled running jobs, 0 if none.
+ */
+int jobs_interrupted(void) {
+    return g_jobs_signal;
+}
+
+/*
+ * How many jobs run at once when a job set doesn't set max_jobs.
+ */
+size_t jobs_default_max(void) {
+    size_t max_jobs = g_jobs_max > 0 ? g_jobs_max : (size_t)nob_nprocs();
+    return max_jobs > 0 ? max_jobs : 1;
+}
+
+/*
+ * Add a job that holds a slot of `pool` (NULL for none) while it runs.
+ */
+void jobs_add_pooled(Jobs* jobs, const char* name, const char* pool, Job_Func func, void* data) {
+    if (jobs->count >= jobs->capacity) {
+        size_t new_cap = jobs->capacity == 0 ? 8 : jobs->capacity * 2;
+        Job* new_items = realloc(jobs->items, new_cap * sizeof(Job));
+        if (!new_items) return;
+        jobs->items = new_items;
+        jobs->capacity = new_cap;
+    }
+
+    Job* job = &jobs->items[jobs->count++];
+    memset(job, 0, sizeof(Job));
+    job->name = str_dup(name);
+    job->pool = pool ? str_dup(pool) : NULL;
+    job->func = func;
+    job->data = data;
+    job->pid = -1;
+}
+
+void jobs_add(Jobs* jobs, const char* name, Job_Func func, void* data) {
+    jobs_add_pooled(jobs, name, NULL, func, data);
+}
+
+void jobs_free(Jobs* jobs) {
+    for (size_t i = 0; i < jobs->count; i++) {
+        free(jobs->items[i].name);
+        free(jobs->items[i].pool);
+    }
+    free(jobs->items);
+    jobs->items = NULL;
+    jobs->count = 0;
+    jobs->capacity = 0;
+}
+
+static void job_replay_output(Job* job) {
+    if (!job->output) return;
+
+    fflush(job->output);
+    bool has_output = ftell(job->output) > 0;
+    rewind(job->output);
+
+    if (has_output) printf("[%s]\n", job->name);
+
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), job->output)) > 0) {
+        fwrite(buf, 1, n, stdout);
+    }
+    fflush(stdout);
+
+    fclose(job->output);
+    job->output = NULL;
+}
+
+static void jobs_event_start(Job* job) {
+    if (!events_begin("job_start")) return;
+    events_str("name", job->name);
+    events_str("pool", job->pool);
+    events_end();
+}
+
+static void jobs_event_end(Job* job) {
+    if (!events_begin("job_end")) return;
+    events_str("name", job->name);
+    events_bool("ok", job->ok);
+    events_bool("cancelled", job->cancelled);
+    events_num("duration_ms", (double)job->duration_ns / 1000000.0);
+    if (job->peak_rss_kb > 0) events_int("max_rss_kb", (long long)job->peak_rss_kb);
+    events_end();
+}
+
+#ifdef _WIN32
+
+bool jobs_run(Jobs* jobs) {
+    bool keep_going = jobs->keep_going || g_jobs_keep_going;
+    bool all_ok = true;
+    for (size_t i = 0; i < jobs->count; i++) {
+        Job* job = &jobs->items[i];
+        if (!all_ok && !keep_going) {
+            job->cancelled = true;
+            continue;
+        }
+        job->started = true;
+        jobs_event_start(job);
+        job->start_ns = nob_nanos_since_unspecified_epoch();
+        job->ok = job->func(job->data);
+        job->duration_ns = nob_nanos_since_unspecified_epoch() - job->start_ns;
+        jobs_event_end(job);
+        if (!job->ok) {
+            if (has_error()) print_error(jobs->error_file ? jobs->error_file : g_jobs_error_file, stderr);
+            if (g_jobs_keep_going) error_collect(job->name, true);
+            clear_error();
+            all_ok = false;
+        }
+    }
+    return all_ok;
+}
+
+#else
+
+static struct sigaction g_jobs_old_sigint;
+static struct sigaction g_jobs_old_sigterm;
+
+static void jobs_on_signal(int sig) {
+    g_jobs_signal = sig;
+}
+
+static bool job_start(Jobs* jobs, Job* job) {
+    if (jobs->capture_output) {
+        job->output = tmpfile();
+    }
+    if (g_jobs_keep_going) {
+        job->error = tmpfile();
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+
+    jobs_event_start(job);
+    job->start_ns = nob_nanos_since_unspecified_epoch();
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        nob_log(NOB_ERROR, "Could not fork job '%s': %s", job->name, strerror(errno));
+        if (job->output) {
+            fclose(job->output);
+            job->output = NULL;
+        }
+        if (job->error) {
+            fclose(job->error);
+            job->error = NULL;
+        }
+        return false;
+    }
+
+    if (pid == 0) {
+        /* Progress is drawn by the top-level scheduler only */
+        g_jobs_progress = false;
+        /* Its own process group, so cancelling it reaches everything it started */
+        setpgid(0, 0);
+        sigaction(SIGINT, &g_jobs_old_sigint, NULL);
+        sigaction(SIGTERM, &g_jobs_old_sigterm, NULL);
+        if (g_jobs_numa_spread) cpuset_spread((size_t)(job - jobs->items));
+        if (job->pool) pool_return(job->pool);
+        if (job->output) {
+            dup2(fileno(job->output), STDOUT_FILENO);
+            dup2(fileno(job->output), STDERR_FILENO);
+        }
+
+        bool ok = job->func(job->data);
+        if (!ok && has_error()) {
+            print_error(jobs->error_file ? jobs->error_file : g_jobs_error_file, stderr);
+            if (job->error) error_save(job->error);
+        }
+
+        fflush(NULL);
+        events_finish();
+        _exit(ok ? 0 : 1);
+    }
+
+    /* Also here, so a cancel right after the fork can't miss the group */
+    setpgid(pid, pid);
+    job->pid = pid;
+    job->pgid = pid;
+    return true;
+}
+
+/*
+ * First number in the file at `path`, false if it has none (like "max").
+ */
+static bool jobs_read_number(const char* path, unsigned long long* out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    bool ok = fscanf(f, "%llu", out) == 1;
+    fclose(f);
+    return ok;
+}
+
+/*
+ * Memory jobs can use right now in KiB, or 0 if unknown: MemAvailable,
+ * lowered to what is left under our cgroup's memory.max if there is one.
+ */
+static size_t jobs_mem_available_kb(void) {
+    size_t available_kb = 0;
+
+    FILE* f = fopen("/proc/meminfo", "rb");
+    if (f) {
+        char line[256];
+        unsigned long long kb;
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "MemAvailable: %llu kB", &kb) == 1) {
+                available_kb = (size_t)kb;
+                break;
+            }
+        }
+        fclose(f);
+    }
+
+    f = fopen("/proc/self/cgroup", "rb");
+    if (f) {
+        char line[1024];
+        while (fgets(line, sizeof(line), f)) {
+            if (strncmp(line, "0::", 3) != 0) continue;
+            line[strcspn(line, "\n")] = '\0';
+            unsigned long long max, current;
+            if (jobs_read_number(temp_sprintf("/sys/fs/cgroup%s/memory.max", line + 3), &max) &&
+                jobs_read_number(temp_sprintf("/sys/fs/cgroup%s/memory.current", line + 3), &current)) {
+                size_t left_kb = max > current ? (size_t)((max - current) / 1024) : 0;
+                if (available_kb == 0 || left_kb < available_kb) available_kb = left_kb;
+            }
+            break;
+        }
+        fclose(f);
+    }
+
+    return available_kb;
+}
+
+/*
+ * Predict every job's peak RSS from the last run of a job with its name.
+ * Jobs never seen before are guessed at the average of the known ones.
+ */
+static void jobs_predict_rss(Jobs* jobs, History* rss) {
+    size_t known = 0;
+    double total_kb = 0;
+    for (size_t i = 0; i < jobs->count; i++) {
+        double kb;
+        if (history_get(rss, temp_sprintf("%s%s", jobs->history_prefix, jobs->items[i].name), &kb)) {
+            jobs->items[i].predicted_kb = (size_t)kb;
+            total_kb += kb;
+            known++;
+        }
+    }
+    for (size_t i = 0; known > 0 && i < jobs->count; i++) {
+        double kb;
+        if (!history_get(rss, temp_sprintf("%s%s", jobs->history_prefix, jobs->items[i].name), &kb)) {
+            jobs->items[i].predicted_kb = (size_t)(total_kb / known);
+        }
+    }
+}
+
+/*
+ * Predict every job's duration from the last run of a job with its name.
+ */
+static void jobs_predict_durations(Jobs* jobs, History* durations) {
+    for (size_t i = 0; i < jobs->count; i++) {
+        double ms;
+        if (history_get(durations, temp_sprintf("%s%s", jobs->history_prefix, jobs->items[i].name), &ms)) {
+            jobs->items[i].predicted_ns = (uint64_t)(ms * 1000000.0);
+        }
+    }
+}
+
+typedef struct {
+    bool tty;
+    bool drawn;
+    uint64_t last_draw_ns;
+    size_t done;
+} JobsProgress;
+
+static void jobs_format_duration(uint64_t ns, char* buf, size_t size) {
+    uint64_t s = (ns + NOB_NANOS_PER_SEC / 2) / NOB_NANOS_PER_SEC;
+    if (s >= 3600) {
+        snprintf(buf, size, "%uh%02um", (unsigned)(s / 3600), (unsigned)(s / 60 % 60));
+    } else if (s >= 60) {
+        snprintf(buf, size, "%um%02us", (unsigned)(s / 60), (unsigned)(s % 60));
+    } else if (s >= 10) {
+        snprintf(buf, size, "%us", (unsigned)s);
+    } else {
+        snprintf(buf, size, "%.1fs", (double)ns / NOB_NANOS_PER_SEC);
+    }
+}
+
+/*
+ * Time left for the jobs still to finish, or false if there is nothing
+ * to go by. Jobs without a recorded duration are assumed to take as
+ * long as the others did on average.
+ */
+static bool jobs_eta(Jobs* jobs, size_t max_jobs, uint64_t now, uint64_t* eta_ns) {
+    uint64_t known_ns = 0;
+    size_t known = 0;
+    for (size_t i = 0; i < jobs->count; i++) {
+        Job* job = &jobs->items[i];
+        bool finished = job->started && job->pid <= 0 && !job->cancelled;
+        uint64_t ns = finished ? job->duration_ns : job->predicted_ns;
+        if (ns > 0) {
+            known_ns += ns;
+            known++;
+        }
+    }
+    if (known == 0) return false;
+    uint64_t average_ns = known_ns / known;
+
+    uint64_t left_ns = 0;
+    uint64_t longest_ns = 0;
+    size_t left = 0;
+    for (size_t i = 0; i < jobs->count; i++) {
+        Job* job = &jobs->items[i];
+        if (job->started && job->pid <= 0) continue;
+        uint64_t ns = job->predicted_ns > 0 ? job->predicted_ns : average_ns;
+        if (job->pid > 0) {
+            uint64_t elapsed_ns = now - job->start_ns;
+            ns = ns > elapsed_ns ? ns - elapsed_ns : 0;
+        }
+        left_ns += ns;
+        if (ns > longest_ns) longest_ns = ns;
+        left++;
+    }
+
+    size_t slots = left < max_jobs ? left : max_jobs;
+    *eta_ns = slots > 0 ? left_ns / slots : 0;
+    if (*eta_ns < longest_ns) *eta_ns = longest_ns;
+    return true;
+}
+
+static void jobs_progress_clear(JobsProgress* progress) {
+    if (!progress->tty || !progress->drawn) return;
+    fprintf(stderr, "\r\033[K");
+    fflush(stderr);
+    progress->drawn = false;
+}
+
+/*
+ * Redraw the status line: "[done/total] running, pending, ETA: names".
+ */
+static void jobs_progress_draw(Jobs* jobs, JobsProgress* progress, size_t max_jobs, uint64_t now) {
+    size_t running = 0;
+    size_t pending = 0;
+    String_Builder names = {0};
+    for (size_t i = 0; i < jobs->count; i++) {
+        Job* job = &jobs->items[i];
+        if (!job->started) pending++;
+        if (job->pid <= 0) continue;
+        running++;
+        if (names.count > 0) sb_append_cstr(&names, ", ");
+        sb_append_cstr(&names, job->name);
+    }
+
+    char eta[32] = "ETA ?";
+    uint64_t eta_ns;
+    if (jobs_eta(jobs, max_jobs, now, &eta_ns)) {
+        memcpy(eta, "ETA ", 4);
+        jobs_format_duration(eta_ns, eta + 4, sizeof(eta) - 4);
+    }
+
+    char line[1024];
+    int len = snprintf(line, sizeof(line), "[%zu/%zu] %zu running, %zu pending, %s: %.*s", progress->done,
+                       jobs->count, running, pending, eta, (int)names.count, names.items ? names.items : "");
+    sb_free(names);
+
+    struct winsize ws;
+    size_t width = (ioctl(STDERR_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) ? ws.ws_col : 80;
+    if (len > 0 && (size_t)len >= width) {
+        len = (int)width - 1;
+        if (len > 3) memcpy(line + len - 3, "...", 3);
+    }
+
+    fprintf(stderr, "\r%.*s\033[K", len > 0 ? len : 0, line);
+    fflush(stderr);
+    progress->drawn = true;
+    progress->last_draw_ns = now;
+}
+
+/*
+ * Without a terminal, one line per finished job.
+ */
+static void jobs_progress_line(Jobs* jobs, JobsProgress* progress, Job* job, size_t max_jobs) {
+    char took[32];
+    jobs_format_duration(job->duration_ns, took, sizeof(took));
+    uint64_t eta_ns;
+    if (progress->done < jobs->count && jobs_eta(jobs, max_jobs, nob_nanos_since_unspecified_epoch(), &eta_ns)) {
+        char eta[32];
+        jobs_format_duration(eta_ns, eta, sizeof(eta));
+        fprintf(stderr, "[%zu/%zu] %s %s in %s, ETA %s\n", progress->done, jobs->count, job->name,
+                job->ok ? "done" : "failed", took, eta);
+    } else {
+        fprintf(stderr, "[%zu/%zu] %s %s in %s\n", progress->done, jobs->count, job->name,
+                job->ok ? "done" : "failed", took);
+    }
+    fflush(stderr);
+}
+
+/*
+ * Send `sig` to the process group of every running job.
+ */
+static void jobs_signal_running(Jobs* jobs, int sig) {
+    for (size_t i = 0; i < jobs->count; i++) {
+        Job* job = &jobs->items[i];
+        if (job->pid <= 0) continue;
+        kill(-job->pid, sig);
+        job->cancelled = true;
+    }
+}
+
+/*
+ * Processes a cancelled job started can outlive it. Give them the rest
+ * of the grace period, then kill whatever is left of their groups.
+ */
+static void jobs_finish_cancel(Jobs* jobs, uint64_t cancel_ns) {
+    for (;;) {
+        bool alive = false;
+        for (size_t i = 0; i < jobs->count; i++) {
+            Job* job = &jobs->items[i];
+            if (!job->cancelled || job->pgid <= 0) continue;
+            if (kill(-job->pgid, 0) == 0) {
+                alive = true;
+            } else {
+                job->pgid = 0;
+            }
+        }
+        if (!alive) return;
+
+        if ((nob_nanos_since_unspecified_epoch() - cancel_ns) / 1000000 >= JOBS_KILL_GRACE_MS) {
+            for (size_t i = 0; i < jobs->count; i++) {
+                Job* job = &jobs->items[i];
+                if (job->cancelled && job->pgid > 0) kill(-job->pgid, SIGKILL);
+            }
+            return;
+        }
+        usleep(POOL_POLL_MS * 1000);
+    }
+}
+
+static Job* jobs_find_by_pid(Jobs* jobs, pid_t pid) {
+    for (size_t i = 0; i < jobs->count; i++) {
+        if (jobs->items[i].pid == pid) return &jobs->items[i];
+    }
+    return NULL;
+}
+
+bool jobs_run(Jobs* jobs) {
+    size_t max_jobs = jobs->max_jobs > 0 ? jobs->max_jobs : jobs_default_max();
+
+    History rss = {0};
+    History durations = {0};
+    size_t budget_kb = 0;
+    if (jobs->history_prefix) {
+        history_load(&rss, JOBS_RSS_PATH);
+        jobs_predict_rss(jobs, &rss);
+        history_load(&durations, JOBS_DURATIONS_PATH);
+        jobs_predict_durations(jobs, &durations);
+        budget_kb = g_jobs_mem_budget_mib > 0 ? g_jobs_mem_budget_mib * 1024 : jobs_mem_available_kb();
+        if (budget_kb > 0) nob_log(NOB_INFO, "Memory budget for jobs: %zu MiB", budget_kb / 1024);
+    }
+
+    Reaper reaper;
+    reaper_init(&reaper);
+    reaper.interrupt = &g_jobs_signal;
+
+    struct sigaction on_signal = {0};
+    on_signal.sa_handler = jobs_on_signal;
+    sigemptyset(&on_signal.sa_mask);
+    sigaction(SIGINT, &on_signal, &g_jobs_old_sigint);
+    sigaction(SIGTERM, &on_signal, &g_jobs_old_sigterm);
+    /* Keep ignoring what we were told to ignore (nohup, background jobs) */
+    if (g_jobs_old_sigint.sa_handler == SIG_IGN) sigaction(SIGINT, &g_jobs_old_sigint, NULL);
+    if (g_jobs_old_sigterm.sa_handler == SIG_IGN) sigaction(SIGTERM, &g_jobs_old_sigterm, NULL);
+
+    JobsProgress progress = {0};
+    progress.tty = isatty(STDERR_FILENO);
+
+    bool keep_going = jobs->keep_going || g_jobs_keep_going;
+    size_t first = 0;   /* no job before this one is waiting to start */
+    size_t running = 0;
+    size_t running_kb = 0;
+    bool all_ok = true;
+    bool cancelling = false;
+    bool killed = false;
+    uint64_t cancel_ns = 0;
+
+    while (first < jobs->count || running > 0) {
+        if (!cancelling && (g_jobs_signal || (!all_ok && !keep_going))) {
+            cancelling = true;
+            cancel_ns = nob_nanos_since_unspecified_epoch();
+            reaper.interrupt = NULL;    /* another Ctrl-C changes nothing now */
+            all_ok = false;
+            for (size_t i = first; i < jobs->count; i++) {
+                if (jobs->items[i].started) continue;
+                jobs->items[i].started = true;
+                jobs->items[i].cancelled = true;
+                progress.done++;
+            }
+            first = jobs->count;
+            if (running > 0) {
+                fprintf(stderr, "Cancelling %zu running job%s%s\n", running, running == 1 ? "" : "s",
+                        g_jobs_signal ? "" : " after a failure (use -k to keep going)");
+                jobs_signal_running(jobs, SIGTERM);
+            }
+        }
+
+        bool blocked = false;
+        for (size_t i = first; i < jobs->count && running < max_jobs; i++) {
+            Job* job = &jobs->items[i];
+            if (job->started) continue;
+            /* Something always runs, even a job predicted to need more than the budget */
+            if (budget_kb > 0 && running > 0 && running_kb + job->predicted_kb > budget_kb) continue;
+
+            int slot = -1;
+            if (job->pool && !pool_try_admit(job->pool, &slot, &job->pool_lent)) {
+                blocked = true;
+                continue;
+            }
+            job->started = true;
+
+            bool started = job_start(jobs, job);
+            /* The child has its own copy of the slot and holds it until it exits */
+            if (job->pool && !job->pool_lent) pool_release(job->pool, slot);
+            if (!started) {
+                if (job->pool_lent) pool_return(job->pool);
+                job->ok = false;
+                all_ok = false;
+                progress.done++;
+                jobs_event_end(job);
+                continue;
+            }
+            reaper_add(&reaper, job->pid, -1, NULL);
+            running++;
+            running_kb += job->predicted_kb;
+        }
+        while (first < jobs->count && jobs->items[first].started) first++;
+
+        if (running == 0) {
+            if (!blocked) break;
+            /* Every free slot is held by some other process */
+            usleep(POOL_POLL_MS * 1000);
+            continue;
+        }
+
+        /* While a job waits for a pool slot held elsewhere, look again every POOL_POLL_MS */
+        int timeout_ms = blocked ? POOL_POLL_MS : -1;
+        if (cancelling && !killed) {
+            uint64_t waited_ms = (nob_nanos_since_unspecified_epoch() - cancel_ns) / 1000000;
+            if (waited_ms >= JOBS_KILL_GRACE_MS) {
+                jobs_signal_running(jobs, SIGKILL);
+                killed = true;
+            } else {
+                timeout_ms = JOBS_KILL_GRACE_MS - (int)waited_ms;
+            }
+        }
+
+        /* The status line is only redrawn between events, at most every JOBS_PROGRESS_MS */
+        if (g_jobs_progress && progress.tty) {
+            uint64_t now = nob_nanos_since_unspecified_epoch();
+            if (!progress.drawn || now - progress.last_draw_ns >= JOBS_PROGRESS_MS * 1000000ull) {
+                jobs_progress_draw(jobs, &progress, max_jobs, now);
+            }
+            if (timeout_ms < 0 || timeout_ms > JOBS_PROGRESS_MS) timeout_ms = JOBS_PROGRESS_MS;
+        }
+
+        int wstatus = 0;
+        struct rusage usage = {0};
+        pid_t pid = reaper_wait(&reaper, timeout_ms, &wstatus, &usage);
+        if (pid == 0) continue;
+        if (pid < 0) {
+            /* A signal: cancel at the top of the loop */
+            if (errno == EINTR) continue;
+            all_ok = false;
+            break;
+        }
+
+        Job* job = jobs_find_by_pid(jobs, pid);
+        if (!job) continue;
+
+        running--;
+        running_kb -= job->predicted_kb;
+        job->pid = -1;
+        if (job->pool_lent) pool_return(job->pool);
+#ifdef __APPLE__
+        job->peak_rss_kb = (size_t)usage.ru_maxrss / 1024;
+#else
+        job->peak_rss_kb = (size_t)usage.ru_maxrss;
+#endif
+        job->duration_ns = nob_nanos_since_unspecified_epoch() - job->start_ns;
+        job->ok = WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0;
+        if (job->ok) job->cancelled = false;
+        if (!job->ok) all_ok = false;
+        progress.done++;
+
+        if (g_jobs_progress) jobs_progress_clear(&progress);
+        job_replay_output(job);
+        if (g_jobs_progress && !progress.tty && !job->cancelled) jobs_progress_line(jobs, &progress, job, max_jobs);
+        if (job->cancelled) fprintf(stderr, "Cancelled %s\n", job->name);
+        jobs_event_end(job);
+        if (job->error) {
+            if (!job->ok && !job->cancelled) {
+                rewind(job->error);
+                if (error_load(job->error)) error_collect(job->name, true);
+            }
+            fclose(job->error);
+            job->error = NULL;
+        }
+    }
+
+    reaper_free(&reaper);
+    if (g_jobs_progress) jobs_progress_clear(&progress);
+    if (cancelling) jobs_finish_cancel(jobs, cancel_ns);
+    sigaction(SIGINT, &g_jobs_old_sigint, NULL);
+    sigaction(SIGTERM, &g_jobs_old_sigterm, NULL);
+
+    if (jobs->history_prefix) {
+        for (size_t i = 0; i < jobs->count; i++) {
+            Job* job = &jobs->items[i];
+            if (job->ok) {
+                history_set(&durations, temp_sprintf("%s%s", jobs->history_prefix, job->name),
+                            (double)job->duration_ns / 1000000.0);
+            }
+            if (job->peak_rss_kb == 0) continue;
+            history_set(&rss, temp_sprintf("%s%s", jobs->history_prefix, job->name), (double)job->peak_rss_kb);
+        }
+        history_save(&rss, JOBS_RSS_PATH);
+        history_free(&rss);
+        history_save(&durations, JOBS_DURATIONS_PATH);
+        history_free(&durations);
+    }
+
+    return all_ok;
+}
+
+#endif
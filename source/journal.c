@@ -0,0 +1,237 @@
+/*
+ * journal.c - Run journal for resuming a failed run (--resume)
+ *
+ * Features:
+ *   - Every command that completes appends one line to .mewo/journal:
+ *     a key over the label path, the statement line and the interpolated
+ *     command (so the values of the variables it used), its directory,
+ *     shell and #stdin data
+ *   - --resume skips commands while they match the journal in order and
+ *     runs everything from the first one that doesn't, so a step whose
+ *     command or variables changed, and all after it, run again
+ *   - The journal belongs to one label; it is removed once a run succeeds
+ *   - A run that fails in a command, with steps journaled, hints at
+ *     --resume; errors before any command ran (syntax, unknown label)
+ *     and runs already started with --resume don't
+ *   - Only the main process writes it; parallel jobs of pattern labels
+ *     have their own up-to-date checks
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - str_dup() from error.c
+ *   - nob.h utilities
+ *   - MEWO_STATE_DIR from history.c
+ *   - Sha1, hash_to_hex() from hash.c
+ */
+
+#ifdef _WIN32
+#include <process.h>
+#define journal_getpid _getpid
+#else
+#include <unistd.h>
+#define journal_getpid getpid
+#endif
+
+#define JOURNAL_PATH MEWO_STATE_DIR "/journal"
+#define JOURNAL_MAGIC "mewo-journal 1"
+
+typedef struct {
+    unsigned char key[20];
+} JournalEntry;
+
+static struct {
+    bool active;
+    int pid;                /* the process that writes the journal */
+    FILE* file;
+    size_t recorded;
+    bool resumed;           /* started with --resume */
+    bool command_failed;    /* the run failed in a command, not before */
+
+    /* Steps of the run being resumed, in order */
+    JournalEntry* items;
+    size_t count;
+    size_t capacity;
+    size_t cursor;
+    bool replaying;
+
+    String_Builder label_path;
+    size_t* path_marks;
+    size_t path_depth;
+    size_t path_capacity;
+} g_journal = {0};
+
+static bool journal_load(const char* label) {
+    FILE* f = fopen(JOURNAL_PATH, "rb");
+    if (!f) {
+        printf("Nothing to resume, running '%s' from the start\n", label);
+        return false;
+    }
+
+    char line[4096];
+    bool ok = fgets(line, sizeof(line), f) != NULL;
+    line[strcspn(line, "\r\n")] = '\0';
+    const char* magic_end = ok ? line + strlen(JOURNAL_MAGIC) : NULL;
+    if (!ok || strncmp(line, JOURNAL_MAGIC, strlen(JOURNAL_MAGIC)) != 0 || *magic_end != ' ' ||
+        strcmp(magic_end + 1, label) != 0) {
+        printf("The journal is not of a run of '%s', running it from the start\n", label);
+        fclose(f);
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        JournalEntry entry;
+        bool valid = strlen(line) > 40;
+        for (size_t i = 0; valid && i < 20; i++) {
+            unsigned int byte;
+            valid = sscanf(line + 2 * i, "%2x", &byte) == 1;
+            entry.key[i] = (unsigned char)byte;
+        }
+        if (valid) da_append(&g_journal, entry);
+    }
+    fclose(f);
+    return true;
+}
+
+/*
+ * Start journaling a run of `label` (NULL for the top level). With
+ * `resume`, completed steps of the last run of the same label are
+ * skipped.
+ */
+void journal_begin(const char* label, bool resume) {
+    const char* name = label ? label : "(top level)";
+    g_journal.replaying = resume && journal_load(name) && g_journal.count > 0;
+    g_journal.cursor = 0;
+    g_journal.resumed = resume;
+    g_journal.command_failed = false;
+
+    if (!mkdir_if_not_exists(MEWO_STATE_DIR)) return;
+    g_journal.file = fopen(JOURNAL_PATH, "wb");
+    if (!g_journal.file) {
+        nob_log(NOB_WARNING, "Could not write %s: %s", JOURNAL_PATH, strerror(errno));
+        return;
+    }
+    fprintf(g_journal.file, "%s %s\n", JOURNAL_MAGIC, name);
+    fflush(g_journal.file);
+    g_journal.active = true;
+    g_journal.pid = (int)journal_getpid();
+}
+
+/*
+ * Finish the run: a successful one leaves nothing to resume.
+ */
+void journal_end(bool ok) {
+    if (!g_journal.active) return;
+    fclose(g_journal.file);
+    g_journal.file = NULL;
+    g_journal.active = false;
+
+    if (ok) {
+        nob_delete_file(JOURNAL_PATH);
+    } else if (g_journal.command_failed && g_journal.recorded > 0 && !g_journal.resumed) {
+        fprintf(stderr, "%zu completed step%s journaled, rerun with --resume to skip %s\n", g_journal.recorded,
+                g_journal.recorded == 1 ? "" : "s", g_journal.recorded == 1 ? "it" : "them");
+    }
+
+    free(g_journal.items);
+    g_journal.items = NULL;
+    g_journal.count = 0;
+    g_journal.capacity = 0;
+    sb_free(g_journal.label_path);
+    memset(&g_journal.label_path, 0, sizeof(g_journal.label_path));
+    free(g_journal.path_marks);
+    g_journal.path_marks = NULL;
+    g_journal.path_depth = 0;
+    g_journal.path_capacity = 0;
+}
+
+static bool journal_writing(void) {
+    return g_journal.active && g_journal.pid == (int)journal_getpid();
+}
+
+void journal_enter_label(const char* name) {
+    if (!g_journal.active) return;
+    if (g_journal.path_depth >= g_journal.path_capacity) {
+        size_t new_cap = g_journal.path_capacity == 0 ? 16 : g_journal.path_capacity * 2;
+        size_t* new_marks = realloc(g_journal.path_marks, new_cap * sizeof(size_t));
+        if (!new_marks) return;
+        g_journal.path_marks = new_marks;
+        g_journal.path_capacity = new_cap;
+    }
+    g_journal.path_marks[g_journal.path_depth++] = g_journal.label_path.count;
+    sb_append_cstr(&g_journal.label_path, "/");
+    sb_append_cstr(&g_journal.label_path, name);
+}
+
+void journal_leave_label(void) {
+    if (!g_journal.active || g_journal.path_depth == 0) return;
+    g_journal.label_path.count = g_journal.path_marks[--g_journal.path_depth];
+}
+
+/*
+ * The journal key of a command about to run at `line_number`. `input`
+ * is what it gets on stdin (NULL for none).
+ */
+void journal_key(const char* cwd, const char* shell, const char* cmd, const char* input,
+                 size_t line_number, unsigned char key[20]) {
+    char line[32];
+    snprintf(line, sizeof(line), "%zu", line_number);
+
+    Sha1 s;
+    sha1_init(&s);
+    sha1_update(&s, g_journal.label_path.items ? g_journal.label_path.items : "", g_journal.label_path.count);
+    sha1_update(&s, "", 1);
+    sha1_update(&s, line, strlen(line) + 1);
+    sha1_update(&s, cwd ? cwd : "", strlen(cwd ? cwd : "") + 1);
+    sha1_update(&s, shell ? shell : "", strlen(shell ? shell : "") + 1);
+    sha1_update(&s, cmd, strlen(cmd) + 1);
+    if (input) sha1_update(&s, input, strlen(input));
+    sha1_final(&s, key);
+}
+
+/*
+ * Note a completed command.
+ */
+void journal_record(const unsigned char key[20], size_t line_number) {
+    if (!journal_writing()) return;
+    char hex[41];
+    hash_to_hex(key, hex);
+    fprintf(g_journal.file, "%s %zu %.*s\n", hex, line_number, (int)g_journal.label_path.count,
+            g_journal.label_path.items ? g_journal.label_path.items : "");
+    fflush(g_journal.file);
+    g_journal.recorded++;
+}
+
+/*
+ * Note that a command (or a parallel job) failed, so what was journaled
+ * before it is worth resuming from.
+ */
+void journal_command_failed(void) {
+    if (!journal_writing()) return;
+    g_journal.command_failed = true;
+}
+
+/*
+ * Whether the command with `key` was completed by the run being resumed.
+ * The first command that wasn't ends the resume; it and everything after
+ * it run.
+ */
+bool journal_skip(const unsigned char key[20], size_t line_number) {
+    if (!g_journal.replaying || !journal_writing()) return false;
+
+    if (g_journal.cursor < g_journal.count && memcmp(g_journal.items[g_journal.cursor].key, key, 20) == 0) {
+        g_journal.cursor++;
+        journal_record(key, line_number);
+        return true;
+    }
+
+    g_journal.replaying = false;
+    printf("Resuming after %zu completed step%s at line %zu\n", g_journal.cursor,
+           g_journal.cursor == 1 ? "" : "s", line_number);
+    fflush(stdout);
+    return false;
+}
+
+bool journal_active(void) {
+    return journal_writing();
+}
@@ -8,6 +8,24 @@
  *   - Feature enable/disable flags (+F/-F)
  *   - Variable override flags (-D)
  *   - Dry-run mode for testing
+ *   - Feature matrix runs (--matrix)
+ *   - CI sharding of alias targets (--shard K/N)
+ *   - Watch mode (--watch)
+ *   - File system monitor daemon (--fsmonitor)
+ *   - Git index aware content hashing (--git-index)
+ *   - Traced commands skipped while their inputs are unchanged (#traced)
+ *   - Pattern rules (build/%.o: src/%.c) run in parallel (-j)
+ *   - Named resource pools limiting heavyweight steps (#pool)
+ *   - Per-command CPU, memory and I/O accounting (--debug, ${#rusage})
+ *   - Performance counters per command (#perfstat)
+ *   - Label priority classes (#priority)
+ *   - CPU affinity and NUMA placement (#cpuset, --numa-spread)
+ *   - Scratch directories on tmpfs (#scratch)
+ *   - Children waited for with pidfd and epoll; #timeout(ms) enforced
+ *   - Fail-fast cancellation of parallel jobs, or -k/--keep-going
+ *   - Run journal to resume a failed run (--resume)
+ *   - Progress and ETA of parallel jobs from earlier durations (--progress)
+ *   - NDJSON event stream for build dashboards (--events=FD|path)
  * 
  * Usage: mewo [LABEL] [OPTIONS] [-- ARGS]
  */
@@ -28,10 +46,31 @@
 #define NOBDEF static inline
 #include "../thirdparty/nob.h"
 
+#include "events.c"
 #include "error.c"
+#include "history.c"
+#include "rusage.c"
+#include "reaper.c"
+#include "shard.c"
+#include "fsmonitor.c"
+#include "hash.c"
+#include "deps.c"
+#include "journal.c"
 #include "vars.c"
 #include "parser.c"
+#include "builtins.c"
+#include "copy.c"
+#include "scratch.c"
+#include "pattern.c"
+#include "trace.c"
+#include "pool.c"
+#include "cpuset.c"
+#include "perfstat.c"
+#include "priority.c"
+#include "jobs.c"
 #include "exec.c"
+#include "matrix.c"
+#include "watch.c"
 
 static const int VERSION = 0x0100;
 
@@ -142,9 +181,48 @@ static void free_lines(char** lines, size_t count) {
     free(lines);
 }
 
+/*
+ * Read and parse a Mewofile. Returns NULL (with the error reported) if
+ * it cannot be read or parsed.
+ */
+static AST* load_mewofile(const char* path) {
+    char** lines = NULL;
+    size_t lines_count = 0;
+    if (!read_lines_entire_file(path, &lines, &lines_count)) {
+        nob_log(NOB_ERROR, "Failed to read Mewofile %s", path);
+        free_lines(lines, lines_count);
+        return NULL;
+    }
+
+    AST* ast = parse((const char**)lines, lines_count);
+    free_lines(lines, lines_count);
+
+    if (has_error()) {
+        print_error(path, stderr);
+        clear_error();
+        free_ast(ast);
+        return NULL;
+    }
+    return ast;
+}
+
 static Nob_Log_Level current_log_level = NOB_INFO;
 
 void mewo_log_handler(Nob_Log_Level level, const char* fmt, va_list args) {
+    /* Warnings reach the event stream even when --debug doesn't show them */
+    if (level >= NOB_WARNING && events_enabled()) {
+        char message[1024];
+        va_list copy;
+        va_copy(copy, args);
+        vsnprintf(message, sizeof(message), fmt, copy);
+        va_end(copy);
+        if (events_begin("log")) {
+            events_str("level", level == NOB_WARNING ? "warning" : "error");
+            events_str("message", message);
+            events_end();
+        }
+    }
+
     if (level < current_log_level) {
         return;
     }
@@ -161,6 +239,14 @@ void mewo_log_handler(Nob_Log_Level level, const char* fmt, va_list args) {
     fprintf(stderr, "\n");
 }
 
+static void run_end_event(bool ok, int exit_code, uint64_t start_ns) {
+    if (!events_begin("run_end")) return;
+    events_bool("ok", ok);
+    events_int("exit_code", exit_code);
+    events_num("duration_ms", (double)(nob_nanos_since_unspecified_epoch() - start_ns) / 1000000.0);
+    events_end();
+}
+
 int main(int argc, char** argv) {
     bool*  help                 = flag_bool("help", false, "Show help", .short_name='h');
     bool*  version              = flag_bool("version", false, "Show version", .short_name='v');
@@ -172,6 +258,24 @@ int main(int argc, char** argv) {
     bool*  debug                = flag_bool("debug", false, "Enable debug output", .short_name='d');
     bool*  dry_run              = flag_bool("dry-run", false, "Print commands without executing");
     bool*  echo                 = flag_bool("echo", false, "Echo commands before executing them", .short_name='e');
+    char** matrix               = flag_str("matrix", "", "Run LABEL for every combination of the comma-separated features");
+    size_t* max_jobs            = flag_size("jobs", 0, "Maximum number of parallel jobs (0 = number of CPUs)", .short_name='j');
+    bool*  progress             = flag_bool("progress", false, "Show progress and an ETA of parallel jobs (a status line on terminals)");
+    bool*  resume               = flag_bool("resume", false, "Skip the steps the last failed run of LABEL completed");
+    bool*  keep_going           = flag_bool("keep-going", false, "Keep running independent work after a failure, then list every error", .short_name='k');
+    size_t* mem_budget          = flag_size("mem-budget", 0, "MiB of memory parallel jobs may use together (0 = what is available)");
+    bool*  numa_spread          = flag_bool("numa-spread", false, "Spread parallel jobs over the NUMA nodes, each pinned to one");
+    char** scratch_dir          = flag_str("scratch-dir", "", "Where #scratch directories are created (default /dev/shm, else $TMPDIR or /tmp)");
+    bool*  keep_scratch         = flag_bool("keep-scratch", false, "Keep the #scratch directories of failed steps");
+    char** shard                = flag_str("shard", "", "Run only shard K of N of the label's independent work (K/N)");
+    char** shard_timings        = flag_str("shard-timings", "", "Timing history shared by all shards, for duration-balanced sharding");
+    bool*  no_builtins          = flag_bool("no-builtins", false, "Always run echo/mkdir/rm/cp/touch as external commands");
+    bool*  watch                = flag_bool("watch", false, "Rerun LABEL whenever a watched file changes", .short_name='w');
+    size_t* debounce            = flag_size("debounce", 200, "Milliseconds of quiet after a change before rerunning (--watch)");
+    char** fsmonitor            = flag_str("fsmonitor", "", "Use the file system monitor daemon (on), or manage it (start, stop, status)");
+    bool*  watch_restart        = flag_bool("watch-restart", false, "Cancel a running build when files change instead of waiting for it (--watch)");
+    bool*  git_index            = flag_bool("git-index", false, "Take content hashes of unmodified tracked files from .git/index");
+    char** events               = flag_str("events", "", "Write NDJSON build events to a file descriptor number or a path");
 
     if (!flag_parse(argc, argv)) {
         flag_print_error(stderr);
@@ -202,6 +306,23 @@ int main(int argc, char** argv) {
         current_log_level = NOB_INFO;
     }
 
+    if (**fsmonitor) {
+        if (strcmp(*fsmonitor, "start") == 0) return fsmonitor_start() ? 0 : 1;
+        if (strcmp(*fsmonitor, "stop") == 0) return fsmonitor_stop() ? 0 : 1;
+        if (strcmp(*fsmonitor, "status") == 0) return fsmonitor_status() ? 0 : 1;
+        if (strcmp(*fsmonitor, "on") != 0) {
+            fprintf(stderr, "Error: Invalid --fsmonitor '%s', expected on, start, stop or status\n", *fsmonitor);
+            return 1;
+        }
+        fsmonitor_set_enabled(true);
+    }
+
+    if (**events) {
+        if (!events_open(*events)) return 1;
+        atexit(events_close);
+    }
+    uint64_t run_start_ns = nob_nanos_since_unspecified_epoch();
+
     int rest = flag_rest_argc();
     char** args = flag_rest_argv();
 
@@ -217,6 +338,19 @@ int main(int argc, char** argv) {
 
     argv_init(args, rest);
     vars_init();
+    builtins_set_enabled(!*no_builtins);
+    gitindex_set_enabled(*git_index);
+    jobs_set_defaults(*max_jobs, *mewofile);
+    jobs_set_mem_budget(*mem_budget);
+    jobs_set_numa_spread(*numa_spread);
+    jobs_set_keep_going(*keep_going);
+    jobs_set_progress(*progress);
+    scratch_set_options(*scratch_dir, *keep_scratch);
+
+    if (**shard && !shard_init(*shard, **shard_timings ? *shard_timings : NULL)) {
+        fprintf(stderr, "Error: Invalid --shard '%s', expected K/N with 1 <= K <= N\n", *shard);
+        return 1;
+    }
 
     for (size_t i = 0; i < overrides->count; i++) {
         const char* override = overrides->items[i];
@@ -249,6 +383,13 @@ int main(int argc, char** argv) {
 
     AST* ast = parse((const char**)lines, lines_count);
 
+    if (events_begin("run_start")) {
+        events_str("mewofile", *mewofile);
+        events_str("label", label);
+        events_bool("dry_run", *dry_run);
+        events_end();
+    }
+
     if (*debug) {
         if (label) {
             printf("Invoking label: %s\n", label);
@@ -261,22 +402,50 @@ int main(int argc, char** argv) {
 
     if (has_error()) {
         print_error(*mewofile, stderr);
+        run_end_event(false, 1, run_start_ns);
         free_lines(lines, lines_count);
         return 1;
     }
 
-    if (!execute_and_cleanup(ast, label, *dry_run, *echo, *shell && **shell ? *shell : NULL,
-                             (const char**)features_enable->items, features_enable->count,
-                             (const char**)features_disable->items, features_disable->count)) {
-        if (has_error()) {
+    if (*resume && (*watch || **matrix)) {
+        fprintf(stderr, "Warning: --resume has no effect with --watch or --matrix\n");
+    }
+
+    if (*watch) {
+        free_lines(lines, lines_count);
+        execute_watch(ast, label, *dry_run, *echo, *shell && **shell ? *shell : NULL,
+                      (const char**)features_enable->items, features_enable->count,
+                      (const char**)features_disable->items, features_disable->count,
+                      *mewofile, *debounce, *watch_restart, load_mewofile);
+        return 0;
+    }
+
+    bool ok;
+    if (**matrix) {
+        ok = execute_matrix(ast, label, *dry_run, *echo, *shell && **shell ? *shell : NULL,
+                            (const char**)features_enable->items, features_enable->count,
+                            (const char**)features_disable->items, features_disable->count,
+                            *matrix, *max_jobs, *mewofile);
+    } else {
+        if (!*dry_run) journal_begin(label, *resume);
+        ok = execute_and_cleanup(ast, label, *dry_run, *echo, *shell && **shell ? *shell : NULL,
+                                 (const char**)features_enable->items, features_enable->count,
+                                 (const char**)features_disable->items, features_disable->count);
+        journal_end(ok);
+    }
+
+    int exit_code = 0;
+    if (!ok) {
+        if (collected_error_count() > 0) {
+            print_error_summary(*mewofile, stderr);
+        } else if (has_error()) {
             print_error(*mewofile, stderr);
         }
-        free_ast(ast);
-        free_lines(lines, lines_count);
-        return 1;
+        exit_code = jobs_interrupted() ? 128 + jobs_interrupted() : 1;
     }
+    run_end_event(ok, exit_code, run_start_ns);
 
     free_ast(ast);
     free_lines(lines, lines_count);
-    return 0;
+    return exit_code;
 }
@@ -0,0 +1,192 @@
+/*
+ * matrix.c - Feature matrix execution for Mewo
+ *
+ * Features:
+ *   - Expands --matrix a,b,c into every on/off combination of the features
+ *   - Runs all combinations concurrently through the job runner, each with
+ *     its own feature set and variable state, from a single parse
+ *   - Exposes the combination name as ${#matrix_id} (e.g. "asan+lto")
+ *   - Prints a combined pass/fail table at the end
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - execute(), execute_and_cleanup() from exec.c
+ *   - Jobs from jobs.c
+ */
+
+#define MATRIX_MAX_FEATURES 16
+
+typedef struct {
+    AST* ast;
+    const char* label;
+    bool dry_run;
+    bool echo;
+    const char* shell;
+
+    char* id;
+    const char** enabled;
+    size_t enabled_count;
+    const char** disabled;
+    size_t disabled_count;
+} MatrixRun;
+
+static bool matrix_run_job(void* data) {
+    MatrixRun* run = data;
+    set_matrix_id(run->id);
+    return execute_and_cleanup(run->ast, run->label, run->dry_run, run->echo, run->shell,
+                               run->enabled, run->enabled_count,
+                               run->disabled, run->disabled_count);
+}
+
+#ifdef _WIN32
+static bool matrix_run_job_in_process(void* data) {
+    Variables snap = vars_snapshot();
+    bool ok = matrix_run_job(data);
+    vars_restore(&snap);
+    return ok;
+}
+#endif
+
+static size_t matrix_split(const char* list, char** out, size_t max) {
+    size_t count = 0;
+    const char* p = list;
+    while (*p) {
+        while (*p && (isspace(*p) || *p == ',')) p++;
+        if (*p == '+') p++;
+        const char* start = p;
+        while (*p && *p != ',') p++;
+        const char* end = p;
+        while (end > start && isspace(*(end - 1))) end--;
+
+        if (end > start) {
+            if (count >= max) return count + 1;
+            size_t len = end - start;
+            out[count] = malloc(len + 1);
+            memcpy(out[count], start, len);
+            out[count][len] = '\0';
+            count++;
+        }
+    }
+    return count;
+}
+
+/*
+ * Run a label once per combination of the features in `matrix`
+ *
+ * The CLI +F/-F features are the base of every combination; matrix
+ * features are then forced on or off on top of them.
+ *
+ * Returns:
+ *   true if every combination succeeded
+ */
+bool execute_matrix(AST* ast, const char* label, bool dry_run, bool echo, const char* shell,
+                    const char** enabled_features, size_t enabled_count,
+                    const char** disabled_features, size_t disabled_count,
+                    const char* matrix, size_t max_jobs, const char* mewofile) {
+    char* names[MATRIX_MAX_FEATURES];
+    size_t name_count = matrix_split(matrix, names, MATRIX_MAX_FEATURES);
+    if (name_count > MATRIX_MAX_FEATURES) {
+        for (size_t i = 0; i < MATRIX_MAX_FEATURES; i++) free(names[i]);
+        char msg[128];
+        snprintf(msg, sizeof(msg), "--matrix supports at most %d features", MATRIX_MAX_FEATURES);
+        set_error(ERROR_RUNTIME, msg, 0);
+        return false;
+    }
+    if (name_count == 0) {
+        set_error(ERROR_RUNTIME, "--matrix requires at least one feature", 0);
+        return false;
+    }
+
+    size_t combos = (size_t)1 << name_count;
+    MatrixRun* runs = calloc(combos, sizeof(MatrixRun));
+
+    Jobs jobs = {0};
+    jobs.max_jobs = max_jobs;
+    jobs.capture_output = true;
+    jobs.error_file = mewofile;
+    jobs.history_prefix = temp_sprintf("matrix:%s:", label ? label : "");
+
+    for (size_t c = 0; c < combos; c++) {
+        MatrixRun* run = &runs[c];
+        run->ast = ast;
+        run->label = label;
+        run->dry_run = dry_run;
+        run->echo = echo;
+        run->shell = shell;
+
+        run->enabled = malloc((enabled_count + name_count) * sizeof(char*));
+        run->disabled = malloc((disabled_count + name_count) * sizeof(char*));
+
+        for (size_t i = 0; i < enabled_count; i++) {
+            run->enabled[run->enabled_count++] = enabled_features[i];
+        }
+        for (size_t i = 0; i < disabled_count; i++) {
+            bool forced_on = false;
+            for (size_t j = 0; j < name_count; j++) {
+                if ((c & ((size_t)1 << j)) && strcmp(names[j], disabled_features[i]) == 0) {
+                    forced_on = true;
+                }
+            }
+            if (!forced_on) run->disabled[run->disabled_count++] = disabled_features[i];
+        }
+
+        String_Builder id = {0};
+        for (size_t j = 0; j < name_count; j++) {
+            if (c & ((size_t)1 << j)) {
+                run->enabled[run->enabled_count++] = names[j];
+                if (id.count > 0) sb_append_cstr(&id, "+");
+                sb_append_cstr(&id, names[j]);
+            } else {
+                run->disabled[run->disabled_count++] = names[j];
+            }
+        }
+        if (id.count == 0) sb_append_cstr(&id, "default");
+        sb_append_null(&id);
+        run->id = id.items;
+
+#ifdef _WIN32
+        jobs_add(&jobs, run->id, matrix_run_job_in_process, run);
+#else
+        jobs_add(&jobs, run->id, matrix_run_job, run);
+#endif
+    }
+
+    /* Every combination gets a result, one failing doesn't cancel the others */
+    jobs.keep_going = true;
+    bool all_ok = jobs_run(&jobs);
+
+    size_t passed = 0;
+    size_t id_width = 2;
+    for (size_t c = 0; c < jobs.count; c++) {
+        size_t len = strlen(jobs.items[c].name);
+        if (len > id_width) id_width = len;
+        if (jobs.items[c].ok) passed++;
+    }
+
+    printf("\nMatrix %s: %zu/%zu combinations passed\n", matrix, passed, jobs.count);
+    printf("  %-6s %-*s %s\n", "RESULT", (int)id_width, "ID", "TIME");
+    for (size_t c = 0; c < jobs.count; c++) {
+        Job* job = &jobs.items[c];
+        const char* result = job->ok ? "PASS" : job->cancelled ? "CANCEL" : "FAIL";
+        printf("  %-6s %-*s %.2fs\n", result, (int)id_width, job->name,
+               (double)job->duration_ns / NOB_NANOS_PER_SEC);
+    }
+    fflush(stdout);
+
+    jobs_free(&jobs);
+    for (size_t c = 0; c < combos; c++) {
+        free(runs[c].id);
+        free(runs[c].enabled);
+        free(runs[c].disabled);
+    }
+    free(runs);
+    for (size_t i = 0; i < name_count; i++) free(names[i]);
+
+    if (!all_ok) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "%zu of %zu matrix combinations failed", combos - passed, combos);
+        set_error(ERROR_RUNTIME, msg, 0);
+    }
+    return all_ok;
+}
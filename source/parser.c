@@ -5,6 +5,7 @@
  *   - Parse Mewofile into Abstract Syntax Tree (AST)
  *   - Statement types: variables, labels, commands, conditionals, control flow
  *   - Attribute parsing (#cwd, #ignorefail, #shell, #feature, etc.)
+ *   - Pattern labels (build/%.o: src/%.c, optionally named: objs: build/%.o: src/%.c)
  *   - Index access/assign syntax (arr[idx], arr[idx] = value)
  *   - Comment stripping (;) and indent tracking
  *   - Proper handling of quoted strings with special characters
@@ -32,6 +33,7 @@ typedef enum {
     STMT_ENDIF,
     STMT_GOTO,
     STMT_CALL,
+    STMT_PATTERN,
 } StmtType;
 
 typedef struct Stmt Stmt;
@@ -43,7 +45,7 @@ struct Stmt {
     union {
         struct {
             char* name;
-            Stmt* parameters[3];
+            Stmt** parameters;
             int param_count;
         } attr;
         struct {
@@ -79,6 +81,12 @@ struct Stmt {
         struct {
             char* target;
         } call_stmt;
+        struct {
+            char* name;
+            char* target;
+            char** prereqs;     /* prereqs[0] is the source pattern */
+            int prereq_count;
+        } pattern;
     };
 };
 
@@ -241,10 +249,11 @@ static Stmt* parse_attr(const char* line, size_t line_number) {
             param->command.raw_line = str_trim(content);
             free(content);
             
+            stmt->attr.parameters = malloc(sizeof(Stmt*));
             stmt->attr.parameters[0] = param;
             stmt->attr.param_count = 1;
         } else {
-            while (*p && *p != ')' && stmt->attr.param_count < 3) {
+            while (*p && *p != ')') {
                 while (*p && isspace(*p)) p++;
                 
                 const char* param_start = p;
@@ -266,6 +275,8 @@ static Stmt* parse_attr(const char* line, size_t line_number) {
                     param->command.raw_line = str_trim(param_str);
                     free(param_str);
                     
+                    stmt->attr.parameters = realloc(stmt->attr.parameters,
+                                                    (stmt->attr.param_count + 1) * sizeof(Stmt*));
                     stmt->attr.parameters[stmt->attr.param_count++] = param;
                 }
                 
@@ -438,6 +449,69 @@ static Stmt* parse_label(const char* line, size_t line_number) {
     return stmt;
 }
 
+/*
+ * Parse "target%: source% [prereqs...]" or "name: target%: source% [prereqs...]".
+ * Returns NULL without an error if the line is not a pattern label, so it
+ * can still be parsed as something else.
+ */
+static Stmt* parse_pattern(const char* line, size_t line_number) {
+    (void)line_number;
+    if (strchr(line, '"') || strchr(line, '\'') || strstr(line, "${#")) return NULL;
+
+    char* words[64];
+    int word_count = 0;
+    const char* p = line;
+    while (*p && word_count < 64) {
+        while (*p && isspace((unsigned char)*p)) p++;
+        if (!*p) break;
+        const char* start = p;
+        while (*p && !isspace((unsigned char)*p)) p++;
+        words[word_count] = malloc(p - start + 1);
+        memcpy(words[word_count], start, p - start);
+        words[word_count][p - start] = '\0';
+        word_count++;
+    }
+
+    /* The rule's ':' ends a word, so "C:/x" and "a:b" are not rules */
+    int name_word = -1;
+    int target_word = -1;
+    for (int w = 0; w < word_count && w < 2; w++) {
+        size_t len = strlen(words[w]);
+        if (len < 2 || words[w][len - 1] != ':') break;
+        words[w][len - 1] = '\0';
+        if (strchr(words[w], '%')) {
+            target_word = w;
+            break;
+        }
+        if (w == 0 && is_single_identifier_before_char(line, ':', false)) {
+            name_word = 0;
+        } else {
+            words[w][len - 1] = ':';
+            break;
+        }
+    }
+
+    bool is_pattern = target_word >= 0 && target_word + 1 < word_count &&
+                      strchr(words[target_word + 1], '%') &&
+                      strchr(words[target_word], ':') == NULL;
+
+    Stmt* stmt = NULL;
+    if (is_pattern) {
+        stmt = calloc(1, sizeof(Stmt));
+        stmt->type = STMT_PATTERN;
+        stmt->pattern.name = str_dup(name_word == 0 ? words[0] : words[target_word]);
+        stmt->pattern.target = str_dup(words[target_word]);
+        stmt->pattern.prereq_count = word_count - target_word - 1;
+        stmt->pattern.prereqs = malloc(sizeof(char*) * stmt->pattern.prereq_count);
+        for (int w = target_word + 1; w < word_count; w++) {
+            stmt->pattern.prereqs[w - target_word - 1] = str_dup(words[w]);
+        }
+    }
+
+    for (int w = 0; w < word_count; w++) free(words[w]);
+    return stmt;
+}
+
 static Stmt* parse_conditional(const char* line, size_t line_number) {
     const char* p = line;
     while (*p && isspace(*p)) p++;
@@ -539,6 +613,7 @@ AST* parse(const char** lines, size_t lines_count) {
             Stmt* attr = parse_attr(after_attrs, i + 1);
             if (attr) {
                 attr->indent_level = indent;
+                attr->line_number = i + 1;
                 add_stmt(ast, attr);
                 
                 after_attrs++;
@@ -583,6 +658,8 @@ AST* parse(const char** lines, size_t lines_count) {
                 free(line_no_comment);
                 return ast;
             }
+        } else if (indent == 0 && strchr(after_attrs, '%') && (stmt = parse_pattern(after_attrs, i + 1))) {
+            /* Pattern label */
         } else if (find_unquoted_char(after_attrs, ':') && indent == 0 && is_single_identifier_before_char(after_attrs, ':', true)) {
             stmt = parse_label(after_attrs, i + 1);
             if (!stmt && has_error()) {
@@ -682,6 +759,7 @@ void free_stmt(Stmt* stmt) {
             for (int i = 0; i < stmt->attr.param_count; i++) {
                 free_stmt(stmt->attr.parameters[i]);
             }
+            free(stmt->attr.parameters);
             break;
         case STMT_VAR_ASSIGN:
             free(stmt->var_assign.name);
@@ -718,6 +796,14 @@ void free_stmt(Stmt* stmt) {
         case STMT_CALL:
             free(stmt->call_stmt.target);
             break;
+        case STMT_PATTERN:
+            free(stmt->pattern.name);
+            free(stmt->pattern.target);
+            for (int k = 0; k < stmt->pattern.prereq_count; k++) {
+                free(stmt->pattern.prereqs[k]);
+            }
+            free(stmt->pattern.prereqs);
+            break;
         default:
             break;
     }
@@ -747,8 +833,9 @@ void print_ast_label(AST* ast, const char* target_label) {
     for (size_t i = 0; i < ast->stmts_count; i++) {
         Stmt* stmt = ast->stmts[i];
 
-        if (stmt->type == STMT_LABEL) {
-            if (strcmp(stmt->label.name, target_label) == 0) {
+        if (stmt->type == STMT_LABEL || stmt->type == STMT_PATTERN) {
+            const char* name = stmt->type == STMT_LABEL ? stmt->label.name : stmt->pattern.name;
+            if (strcmp(name, target_label) == 0) {
                 in_label_block = true;
             } else {
                 in_label_block = false;
@@ -816,6 +903,16 @@ void print_ast_label(AST* ast, const char* target_label) {
             case STMT_CALL:
                 printf("call %s\n", stmt->call_stmt.target);
                 break;
+            case STMT_PATTERN:
+                if (strcmp(stmt->pattern.name, stmt->pattern.target) != 0) {
+                    printf("%s: ", stmt->pattern.name);
+                }
+                printf("%s:", stmt->pattern.target);
+                for (int k = 0; k < stmt->pattern.prereq_count; k++) {
+                    printf(" %s", stmt->pattern.prereqs[k]);
+                }
+                printf("\n");
+                break;
             default:
                 printf("Unknown statement type\n");
                 break;
@@ -887,6 +984,16 @@ void print_ast(AST* ast) {
             case STMT_CALL:
                 printf("call %s\n", stmt->call_stmt.target);
                 break;
+            case STMT_PATTERN:
+                if (strcmp(stmt->pattern.name, stmt->pattern.target) != 0) {
+                    printf("%s: ", stmt->pattern.name);
+                }
+                printf("%s:", stmt->pattern.target);
+                for (int k = 0; k < stmt->pattern.prereq_count; k++) {
+                    printf(" %s", stmt->pattern.prereqs[k]);
+                }
+                printf("\n");
+                break;
             default:
                 printf("Unknown statement type\n");
                 break;
@@ -933,6 +1040,9 @@ void print_stmt(Stmt* stmt) {
         case STMT_CALL:
             printf("Call: %s\n", stmt->call_stmt.target);
             break;
+        case STMT_PATTERN:
+            printf("Pattern: %s (%s from %s)\n", stmt->pattern.name, stmt->pattern.target, stmt->pattern.prereqs[0]);
+            break;
         default:
             printf("Unknown statement type\n");
             break;
@@ -0,0 +1,269 @@
+/*
+ * pattern.c - Pattern rules for Mewo (build/%.o: src/%.c)
+ *
+ * Features:
+ *   - Expands a pattern label into one instance per source file that
+ *     matches its '%' pattern, found by walking the tree natively
+ *   - '%' matches any non-empty part of a path, including '/', like make;
+ *     hidden directories (.git, .mewo, ...) are not searched
+ *   - The target and any extra prerequisites get the same stem
+ *   - An instance is stale if its target is missing or older than one
+ *     of its prerequisites (nanosecond mtimes where available)
+ *   - Word lists of many instances for #batch, moved to a response file
+ *     (@file) when they would not fit on a command line
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - str_dup() from error.c
+ *   - nob.h utilities
+ *   - deps_stat() from deps.c
+ */
+
+typedef struct {
+    char* stem;
+    char* in;
+    char* out;
+    char** prereqs;
+    size_t prereq_count;
+} PatternInstance;
+
+#ifdef _WIN32
+#define PATTERN_ARG_LIMIT 7000      /* cmd.exe stops at 8191 characters */
+#else
+#define PATTERN_ARG_LIMIT 100000    /* Linux allows one argument (sh -c's command) 128 KiB */
+#endif
+
+typedef struct {
+    PatternInstance* items;
+    size_t count;
+    size_t capacity;
+} PatternInstances;
+
+typedef struct {
+    const char* prefix;
+    const char* suffix;
+    Nob_File_Paths stems;
+} PatternGlob;
+
+/*
+ * Replace the first '%' of `pattern` with `stem`.
+ */
+static char* pattern_subst(const char* pattern, const char* stem) {
+    const char* pct = strchr(pattern, '%');
+    if (!pct) return str_dup(pattern);
+
+    size_t head = (size_t)(pct - pattern);
+    size_t stem_len = strlen(stem);
+    size_t tail = strlen(pct + 1);
+    char* result = malloc(head + stem_len + tail + 1);
+    if (!result) return NULL;
+    memcpy(result, pattern, head);
+    memcpy(result + head, stem, stem_len);
+    memcpy(result + head + stem_len, pct + 1, tail + 1);
+    return result;
+}
+
+static bool pattern_glob_visit(Nob_Walk_Entry entry) {
+    PatternGlob* g = entry.data;
+    const char* name = nob_path_name(entry.path);
+
+    if (entry.type == NOB_FILE_DIRECTORY) {
+        if (entry.level > 0 && name[0] == '.') *entry.action = NOB_WALK_SKIP;
+        return true;
+    }
+    if (entry.type != NOB_FILE_REGULAR && entry.type != NOB_FILE_SYMLINK) return true;
+
+#ifdef _WIN32
+    char* norm = str_dup(entry.path);
+    for (char* c = norm; *c; c++) {
+        if (*c == '\\') *c = '/';
+    }
+    const char* path = norm;
+#else
+    const char* path = entry.path;
+#endif
+    while (path[0] == '.' && path[1] == '/') path += 2;
+
+    size_t len = strlen(path);
+    size_t prefix_len = strlen(g->prefix);
+    size_t suffix_len = strlen(g->suffix);
+    if (len > prefix_len + suffix_len &&
+        strncmp(path, g->prefix, prefix_len) == 0 &&
+        strcmp(path + len - suffix_len, g->suffix) == 0) {
+        size_t stem_len = len - prefix_len - suffix_len;
+        char* stem = malloc(stem_len + 1);
+        if (stem) {
+            memcpy(stem, path + prefix_len, stem_len);
+            stem[stem_len] = '\0';
+            da_append(&g->stems, stem);
+        }
+    }
+
+#ifdef _WIN32
+    free(norm);
+#endif
+    return true;
+}
+
+static int pattern_compare_stems(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+/*
+ * Find every file matching `source` (which contains one '%') and build
+ * the instances for `target` and the extra prerequisites `prereqs`.
+ * Instances are sorted by stem, so runs are reproducible.
+ */
+bool pattern_expand(const char* target, const char* source, const char** prereqs, size_t prereq_count,
+                    PatternInstances* out) {
+    const char* pct = strchr(source, '%');
+    if (!pct) return false;
+
+    char* prefix = malloc((size_t)(pct - source) + 1);
+    if (!prefix) return false;
+    memcpy(prefix, source, (size_t)(pct - source));
+    prefix[pct - source] = '\0';
+    while (prefix[0] == '.' && prefix[1] == '/') memmove(prefix, prefix + 2, strlen(prefix + 2) + 1);
+
+    /* Walk from the deepest directory the prefix names */
+    char* root = NULL;
+    const char* slash = strrchr(prefix, '/');
+    if (slash) {
+        size_t root_len = (size_t)(slash - prefix);
+        root = malloc(root_len + 2);
+        memcpy(root, prefix, root_len);
+        root[root_len] = '\0';
+        if (root_len == 0) strcpy(root, "/");
+    } else {
+        root = str_dup(".");
+    }
+
+    PatternGlob g = { .prefix = prefix, .suffix = pct + 1 };
+    bool ok = true;
+    if (nob_file_exists(root) && nob_get_file_type(root) == NOB_FILE_DIRECTORY) {
+        ok = nob_walk_dir(root, pattern_glob_visit, .data = &g);
+    }
+
+    if (g.stems.count > 1) {
+        qsort(g.stems.items, g.stems.count, sizeof(char*), pattern_compare_stems);
+    }
+
+    for (size_t i = 0; ok && i < g.stems.count; i++) {
+        PatternInstance inst = {0};
+        inst.stem = (char*)g.stems.items[i];
+        inst.in = pattern_subst(source, inst.stem);
+        inst.out = pattern_subst(target, inst.stem);
+        if (prereq_count > 0) {
+            inst.prereqs = malloc(prereq_count * sizeof(char*));
+            for (size_t k = 0; k < prereq_count; k++) inst.prereqs[k] = pattern_subst(prereqs[k], inst.stem);
+            inst.prereq_count = prereq_count;
+        }
+        da_append(out, inst);
+        g.stems.items[i] = NULL;
+    }
+
+    for (size_t i = 0; i < g.stems.count; i++) free((char*)g.stems.items[i]);
+    da_free(g.stems);
+    free(prefix);
+    free(root);
+    return ok;
+}
+
+void pattern_instances_free(PatternInstances* insts) {
+    for (size_t i = 0; i < insts->count; i++) {
+        PatternInstance* inst = &insts->items[i];
+        free(inst->stem);
+        free(inst->in);
+        free(inst->out);
+        for (size_t k = 0; k < inst->prereq_count; k++) free(inst->prereqs[k]);
+        free(inst->prereqs);
+    }
+    free(insts->items);
+    memset(insts, 0, sizeof(PatternInstances));
+}
+
+/*
+ * True if the instance's target is missing or older than its source or
+ * one of its extra prerequisites. A missing prerequisite also counts as
+ * stale; the command then decides whether that is an error.
+ */
+bool pattern_stale(const PatternInstance* inst) {
+    int64_t out_mtime;
+    uint64_t size;
+    if (!deps_stat(inst->out, &out_mtime, &size)) return true;
+
+    int64_t mtime;
+    if (!deps_stat(inst->in, &mtime, &size) || mtime > out_mtime) return true;
+    for (size_t k = 0; k < inst->prereq_count; k++) {
+        if (!deps_stat(inst->prereqs[k], &mtime, &size)) {
+            nob_log(NOB_INFO, "pattern: prerequisite %s of %s is missing", inst->prereqs[k], inst->out);
+            return true;
+        }
+        if (mtime > out_mtime) return true;
+    }
+    return false;
+}
+
+static void pattern_append_word(String_Builder* sb, const char* word, bool rsp) {
+    if (rsp) {
+        /* gcc, clang and javac all read double quotes with \ escapes */
+        sb_append_cstr(sb, "\"");
+        for (const char* c = word; *c; c++) {
+            if (*c == '"' || *c == '\\') da_append(sb, '\\');
+            da_append(sb, *c);
+        }
+        sb_append_cstr(sb, "\"\n");
+        return;
+    }
+
+#ifdef _WIN32
+    bool quote = strpbrk(word, " \t&|<>^()") != NULL;
+    if (quote) sb_append_cstr(sb, "\"");
+    sb_append_cstr(sb, word);
+    if (quote) sb_append_cstr(sb, "\"");
+#else
+    if (!strpbrk(word, " \t\n\"'\\$`&;|<>()*?[]#~!{}")) {
+        sb_append_cstr(sb, word);
+        return;
+    }
+    da_append(sb, '\'');
+    for (const char* c = word; *c; c++) {
+        if (*c == '\'') sb_append_cstr(sb, "'\\''");
+        else da_append(sb, *c);
+    }
+    da_append(sb, '\'');
+#endif
+}
+
+/*
+ * The sources (or targets) of `count` instances as shell words. If they
+ * would not fit on a command line and `rsp_path` is given, they are
+ * written there instead and "@rsp_path" is returned.
+ */
+char* pattern_word_list(const PatternInstance* const* insts, size_t count, bool targets, const char* rsp_path) {
+    String_Builder sb = {0};
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0) da_append(&sb, ' ');
+        pattern_append_word(&sb, targets ? insts[i]->out : insts[i]->in, false);
+    }
+
+    if (sb.count > PATTERN_ARG_LIMIT && rsp_path) {
+        String_Builder rsp = {0};
+        for (size_t i = 0; i < count; i++) {
+            pattern_append_word(&rsp, targets ? insts[i]->out : insts[i]->in, true);
+        }
+        bool written = write_entire_file(rsp_path, rsp.items, rsp.count);
+        sb_free(rsp);
+        if (written) {
+            sb.count = 0;
+            sb_append_cstr(&sb, "@");
+            sb_append_cstr(&sb, rsp_path);
+        } else {
+            nob_log(NOB_WARNING, "Could not write response file %s, passing %zu files directly", rsp_path, count);
+        }
+    }
+
+    sb_append_null(&sb);
+    return sb.items;
+}
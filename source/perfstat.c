@@ -0,0 +1,146 @@
+/*
+ * perfstat.c - Performance counters for #perfstat commands (Linux)
+ *
+ * Features:
+ *   - task-clock, context switches and page faults for every command,
+ *     plus cycles, instructions and cache misses when the CPU exposes
+ *     them (VMs often don't; those counters are just left out)
+ *   - Counters are opened on mewo itself with inherit set and enabled
+ *     only while the command runs, so every process it starts is counted
+ *     without wrapping the command line in `perf stat`
+ *   - Falls back to user space only counting when perf_event_paranoid
+ *     hides the kernel, and to nothing (with one warning) when it hides all
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - nob.h utilities
+ */
+
+typedef struct {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+} PerfCounter;
+
+#define PERFSTAT_MAX_COUNTERS 6
+
+typedef struct {
+    int fds[PERFSTAT_MAX_COUNTERS];
+    size_t count;
+} PerfStat;
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static const PerfCounter g_perf_counters[PERFSTAT_MAX_COUNTERS] = {
+    { "task-clock",       PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    { "context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+    { "page-faults",      PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+    { "cycles",           PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "cache-misses",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+};
+
+static int perfstat_open(const PerfCounter* counter, bool user_only) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counter->type;
+    attr.config = counter->config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = user_only;
+    attr.exclude_hv = user_only;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+/*
+ * Open and start the counters. False if none could be opened, in which
+ * case the command just runs uncounted.
+ */
+bool perfstat_start(PerfStat* ps) {
+    static bool user_only = false;
+    ps->count = 0;
+
+    for (size_t i = 0; i < PERFSTAT_MAX_COUNTERS; i++) {
+        int fd = perfstat_open(&g_perf_counters[i], user_only);
+        if (fd < 0 && (errno == EACCES || errno == EPERM) && !user_only) {
+            user_only = true;
+            fd = perfstat_open(&g_perf_counters[i], user_only);
+        }
+        /* Hardware counters missing in a VM are not an error */
+        ps->fds[i] = fd;
+        if (fd >= 0) ps->count++;
+    }
+
+    if (ps->count == 0) {
+        static bool warned = false;
+        if (!warned) nob_log(NOB_WARNING, "#perfstat: performance counters are not available (%s)", strerror(errno));
+        warned = true;
+        return false;
+    }
+
+    for (size_t i = 0; i < PERFSTAT_MAX_COUNTERS; i++) {
+        if (ps->fds[i] >= 0) ioctl(ps->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+    return true;
+}
+
+/*
+ * Stop the counters, close them and write "name=value ..." to buf (if
+ * not NULL). Counts of the command's processes are complete once they
+ * were reaped.
+ */
+void perfstat_stop(PerfStat* ps, char* buf, size_t size) {
+    uint64_t values[PERFSTAT_MAX_COUNTERS] = {0};
+    bool have[PERFSTAT_MAX_COUNTERS] = {0};
+
+    for (size_t i = 0; i < PERFSTAT_MAX_COUNTERS; i++) {
+        if (ps->fds[i] < 0) continue;
+        ioctl(ps->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        have[i] = read(ps->fds[i], &values[i], sizeof(values[i])) == sizeof(values[i]);
+        close(ps->fds[i]);
+        ps->fds[i] = -1;
+    }
+    ps->count = 0;
+    if (!buf) return;
+
+    size_t len = 0;
+    buf[0] = '\0';
+    for (size_t i = 0; i < PERFSTAT_MAX_COUNTERS && len < size; i++) {
+        if (!have[i]) continue;
+        const char* sep = len > 0 ? " " : "";
+        if (g_perf_counters[i].config == PERF_COUNT_SW_TASK_CLOCK && g_perf_counters[i].type == PERF_TYPE_SOFTWARE) {
+            len += snprintf(buf + len, size - len, "%s%s=%.3fms", sep, g_perf_counters[i].name, values[i] / 1e6);
+        } else {
+            len += snprintf(buf + len, size - len, "%s%s=%" PRIu64, sep, g_perf_counters[i].name, values[i]);
+        }
+    }
+    /* cycles and instructions */
+    if (have[3] && have[4] && values[3] > 0 && len < size) {
+        snprintf(buf + len, size - len, " ipc=%.2f", (double)values[4] / (double)values[3]);
+    }
+}
+
+#else
+
+bool perfstat_start(PerfStat* ps) {
+    static bool warned = false;
+    if (!warned) nob_log(NOB_WARNING, "#perfstat is only supported on Linux, commands run uncounted");
+    warned = true;
+    ps->count = 0;
+    return false;
+}
+
+void perfstat_stop(PerfStat* ps, char* buf, size_t size) {
+    (void)ps;
+    if (buf && size > 0) buf[0] = '\0';
+}
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ * pool.c - Named resource pools for Mewo (#pool(link, 2))
+ *
+ * Features:
+ *   - Pools are declared with a size and limit how many commands,
+ *     labels or pattern jobs in them run at the same time
+ *   - A slot is an flock() on .mewo/pools/<name>.<n>, so the limit holds
+ *     across forked jobs, matrix runs and even separate mewo processes,
+ *     and a crashed holder gives its slot back by exiting
+ *   - Re-entrant: a command in a pool inside a label in the same pool
+ *     doesn't wait for itself
+ *   - Parallel jobs each need a slot of their own, even when started from
+ *     a label in the same pool; that label's slot goes to one of them
+ *   - Pools mewo uses itself have names a #pool can't take
+ *   - No-op on Windows, where jobs already run one at a time
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - str_dup() from error.c
+ *   - nob.h utilities
+ *   - MEWO_STATE_DIR from history.c
+ */
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#endif
+
+#define POOL_DIR MEWO_STATE_DIR "/pools"
+#define POOL_POLL_MS 20
+
+typedef struct {
+    char* name;
+    size_t size;
+    size_t held;    /* slots this process (or the one that forked it) holds */
+    bool lent;      /* the held slot is in use by a job (pool_try_admit) */
+} Pool;
+
+static struct {
+    Pool* items;
+    size_t count;
+    size_t capacity;
+} g_pools = {0};
+
+static Pool* pool_find(const char* name) {
+    for (size_t i = 0; i < g_pools.count; i++) {
+        if (strcmp(g_pools.items[i].name, name) == 0) return &g_pools.items[i];
+    }
+    return NULL;
+}
+
+bool pool_exists(const char* name) {
+    return pool_find(name) != NULL;
+}
+
+static bool pool_add(const char* name, size_t size) {
+    Pool* pool = pool_find(name);
+    if (pool) {
+        pool->size = size;
+        return true;
+    }
+
+    Pool new_pool = { .name = str_dup(name), .size = size };
+    da_append(&g_pools, new_pool);
+    return true;
+}
+
+/*
+ * Declare a pool, or resize it if it exists. Names become file names,
+ * so only letters, digits, '_' and '-' are allowed.
+ */
+bool pool_declare(const char* name, size_t size) {
+    if (!*name || size == 0) return false;
+    for (const char* c = name; *c; c++) {
+        if (!isalnum((unsigned char)*c) && *c != '_' && *c != '-') return false;
+    }
+    return pool_add(name, size);
+}
+
+/*
+ * Declare a pool mewo uses itself, like the per-CPU locks of exclusive
+ * #cpuset scopes. Its name is `name` behind a '.', which a #pool name
+ * can't have, so a user's pool never resizes or shares it. Returns the
+ * full name (a temp string) for pool_acquire() and pool_release().
+ */
+const char* pool_declare_private(const char* name, size_t size) {
+    const char* full = temp_sprintf(".%s", name);
+    pool_add(full, size);
+    return full;
+}
+
+void pools_free(void) {
+    for (size_t i = 0; i < g_pools.count; i++) free(g_pools.items[i].name);
+    da_free(g_pools);
+    memset(&g_pools, 0, sizeof(g_pools));
+}
+
+/*
+ * Lock a free slot file of `pool`, whether or not this process holds a
+ * slot already.
+ */
+static bool pool_take(Pool* pool, int* slot) {
+#ifdef _WIN32
+    (void)slot;
+    pool->held++;
+    return true;
+#else
+    const char* name = pool->name;
+    if (!mkdir_if_not_exists(MEWO_STATE_DIR) || !mkdir_if_not_exists(POOL_DIR)) {
+        nob_log(NOB_WARNING, "pool %s: cannot create %s, not limiting it", name, POOL_DIR);
+        pool->held++;
+        return true;
+    }
+
+    for (size_t i = 0; i < pool->size; i++) {
+        const char* path = temp_sprintf("%s/%s.%zu", POOL_DIR, name, i);
+        int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            nob_log(NOB_WARNING, "pool %s: cannot open %s: %s", name, path, strerror(errno));
+            continue;
+        }
+        if (flock(fd, LOCK_EX | LOCK_NB) == 0) {
+            pool->held++;
+            *slot = fd;
+            return true;
+        }
+        close(fd);
+    }
+    return false;
+#endif
+}
+
+/*
+ * Take a free slot of `name` without waiting. On success *slot is the
+ * descriptor holding it (-1 if nothing needs to be held), to be given
+ * back with pool_release(). A forked child inherits the slot and keeps
+ * it until it exits, even if the parent releases its copy.
+ */
+bool pool_try_acquire(const char* name, int* slot) {
+    *slot = -1;
+    Pool* pool = pool_find(name);
+    if (!pool) return true;
+    if (pool->held > 0) {
+        pool->held++;
+        return true;
+    }
+    return pool_take(pool, slot);
+}
+
+/*
+ * pool_try_acquire() for a job about to be forked. Jobs run side by side,
+ * so each one needs a slot of its own: only the slot this process holds
+ * itself (the label that started the jobs) is re-entrant, and only for
+ * one job at a time. Then *lent is set, *slot is -1, and pool_return()
+ * gives the slot back once the job is done; otherwise release the slot
+ * as usual.
+ */
+bool pool_try_admit(const char* name, int* slot, bool* lent) {
+    *slot = -1;
+    *lent = false;
+    Pool* pool = pool_find(name);
+    if (!pool) return true;
+    if (pool->held > 0 && !pool->lent) {
+        pool->lent = true;
+        *lent = true;
+        return true;
+    }
+    return pool_take(pool, slot);
+}
+
+/*
+ * The job the held slot of `name` was lent to is done. A forked job calls
+ * it too: the slot it runs in is its own, whatever its parent lent.
+ */
+void pool_return(const char* name) {
+    Pool* pool = pool_find(name);
+    if (pool) pool->lent = false;
+}
+
+/*
+ * Take a slot of `name`, waiting for one to become free.
+ */
+int pool_acquire(const char* name) {
+    int slot = -1;
+    bool waited = false;
+    while (!pool_try_acquire(name, &slot)) {
+        if (!waited) nob_log(NOB_INFO, "Waiting for a free slot in pool %s", name);
+        waited = true;
+#ifndef _WIN32
+        usleep(POOL_POLL_MS * 1000);
+#endif
+    }
+    return slot;
+}
+
+void pool_release(const char* name, int slot) {
+    Pool* pool = pool_find(name);
+    if (pool && pool->held > 0) pool->held--;
+#ifndef _WIN32
+    if (slot >= 0) close(slot);
+#else
+    (void)slot;
+#endif
+}
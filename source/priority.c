@@ -0,0 +1,138 @@
+/*
+ * priority.c - Priority classes for labels (#priority(background))
+ *
+ * Features:
+ *   - high, normal and background map to a nice value and an I/O
+ *     priority (best-effort 0 / unchanged / idle class)
+ *   - Applied to a helper thread that runs the label while the main
+ *     thread waits for it: Linux keeps nice and I/O priority per thread
+ *     and processes forked from it inherit them, so every command and job
+ *     of the label gets them while mewo itself, which could not take a
+ *     lower nice value back without privileges, keeps its own
+ *   - SIGINT and SIGTERM are blocked in the waiting thread, so they reach
+ *     the helper and interrupt its waits (cancelling jobs on Ctrl-C)
+ *   - high only gains a negative nice value with CAP_SYS_NICE
+ *   - Runs the label unchanged on other platforms
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - nob.h utilities
+ */
+
+typedef enum {
+    PRIORITY_HIGH,
+    PRIORITY_NORMAL,
+    PRIORITY_BACKGROUND,
+} Priority;
+
+typedef bool (*Priority_Func)(void* data);
+
+bool priority_parse(const char* name, Priority* out) {
+    if (strcmp(name, "high") == 0) *out = PRIORITY_HIGH;
+    else if (strcmp(name, "normal") == 0) *out = PRIORITY_NORMAL;
+    else if (strcmp(name, "background") == 0) *out = PRIORITY_BACKGROUND;
+    else return false;
+    return true;
+}
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+/* Kernel ABI of ioprio_set(); glibc has no wrapper */
+#define PRIORITY_IOPRIO_WHO_PROCESS 1
+#define PRIORITY_IOPRIO_CLASS_SHIFT 13
+#define PRIORITY_IOPRIO_CLASS_BE 2
+#define PRIORITY_IOPRIO_CLASS_IDLE 3
+
+#define PRIORITY_HIGH_NICE (-5)
+#define PRIORITY_BACKGROUND_NICE 10
+#define PRIORITY_STACK_SIZE (64 * 1024 * 1024)
+
+typedef struct {
+    Priority priority;
+    Priority_Func func;
+    void* data;
+    bool ok;
+    sigset_t old_mask;      /* the caller's signal mask, for the helper */
+} PriorityRun;
+
+static void priority_apply_to_thread(Priority priority) {
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    int nice_value = getpriority(PRIO_PROCESS, tid);
+    int ioprio = 0;
+
+    if (priority == PRIORITY_HIGH) {
+        if (nice_value > PRIORITY_HIGH_NICE) nice_value = PRIORITY_HIGH_NICE;
+        ioprio = PRIORITY_IOPRIO_CLASS_BE << PRIORITY_IOPRIO_CLASS_SHIFT;  /* level 0, the highest */
+    } else {
+        if (nice_value < PRIORITY_BACKGROUND_NICE) nice_value = PRIORITY_BACKGROUND_NICE;
+        ioprio = PRIORITY_IOPRIO_CLASS_IDLE << PRIORITY_IOPRIO_CLASS_SHIFT;
+    }
+
+    if (setpriority(PRIO_PROCESS, tid, nice_value) != 0 && errno != EACCES && errno != EPERM) {
+        nob_log(NOB_WARNING, "Could not set nice value %d: %s", nice_value, strerror(errno));
+    }
+    if (syscall(SYS_ioprio_set, PRIORITY_IOPRIO_WHO_PROCESS, tid, ioprio) != 0 && errno != EPERM) {
+        nob_log(NOB_WARNING, "Could not set I/O priority: %s", strerror(errno));
+    }
+}
+
+static void* priority_thread(void* arg) {
+    PriorityRun* run = arg;
+    pthread_sigmask(SIG_SETMASK, &run->old_mask, NULL);
+    priority_apply_to_thread(run->priority);
+    run->ok = run->func(run->data);
+    return NULL;
+}
+
+/*
+ * Run func(data) with `priority`, waiting for it to finish.
+ */
+bool priority_run(Priority priority, Priority_Func func, void* data) {
+    if (priority == PRIORITY_NORMAL) return func(data);
+
+    PriorityRun run = { .priority = priority, .func = func, .data = data };
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, PRIORITY_STACK_SIZE);
+
+    /* A signal for the thread blocked in pthread_join would never wake the helper's reaper */
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &run.old_mask);
+
+    pthread_t thread;
+    int err = pthread_create(&thread, &attr, priority_thread, &run);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        pthread_sigmask(SIG_SETMASK, &run.old_mask, NULL);
+        nob_log(NOB_WARNING, "Could not start a thread for #priority, running at normal priority: %s", strerror(err));
+        return func(data);
+    }
+
+    pthread_join(thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &run.old_mask, NULL);
+    return run.ok;
+}
+
+#else
+
+bool priority_run(Priority priority, Priority_Func func, void* data) {
+    static bool warned = false;
+    if (priority != PRIORITY_NORMAL && !warned) {
+        nob_log(NOB_WARNING, "#priority is only supported on Linux, labels run at normal priority");
+        warned = true;
+    }
+    return func(data);
+}
+
+#endif
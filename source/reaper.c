@@ -0,0 +1,339 @@
+/*
+ * reaper.c - Event loop for child processes
+ *
+ * Features:
+ *   - Waits for any number of children at once, with a timeout, from one
+ *     thread: every child is a pidfd in an epoll set, so an exit wakes the
+ *     loop right away instead of a blocking wait on one pid or a sleep
+ *   - Optionally reads a child's output pipe in the same loop, so a child
+ *     writing more than the pipe holds never stalls its own exit
+ *   - Optionally feeds a child's stdin pipe in the same loop, so a child
+ *     that doesn't read it never stalls the waiter (or its timeout)
+ *   - Only reaps the children it was given, never someone else's
+ *   - A signal that sets `interrupt` always cuts the wait short, also
+ *     one that arrives just before the loop goes to sleep
+ *   - Kernels without pidfd_open (before 5.3) and other Unixes check the
+ *     children every REAPER_POLL_MS instead, while waiting on the pipes
+ *     with poll()
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - nob.h utilities
+ */
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434     /* the same on every architecture */
+#endif
+#endif
+
+#define REAPER_POLL_MS 10
+#define REAPER_MAX_EVENTS 32
+
+typedef struct {
+    pid_t pid;
+    int pidfd;              /* -1 without pidfd support */
+    int out_fd;             /* output pipe, -1 if none or at EOF */
+    String_Builder* out;
+    int in_fd;              /* stdin pipe still being fed, -1 if none or done */
+    const char* in_data;
+    size_t in_len;
+    size_t in_off;
+    bool exited;
+    int wstatus;
+    struct rusage usage;
+} ReaperChild;
+
+typedef struct {
+    ReaperChild* items;
+    size_t count;
+    size_t capacity;
+    int epfd;               /* -1 when poll() is used */
+    volatile sig_atomic_t* interrupt;   /* give up waiting when a signal sets this */
+} Reaper;
+
+void reaper_init(Reaper* r) {
+    memset(r, 0, sizeof(*r));
+    r->epfd = -1;
+#ifdef __linux__
+    r->epfd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+}
+
+void reaper_free(Reaper* r) {
+    for (size_t i = 0; i < r->count; i++) {
+        if (r->items[i].pidfd >= 0) close(r->items[i].pidfd);
+        if (r->items[i].out_fd >= 0) close(r->items[i].out_fd);
+        if (r->items[i].in_fd >= 0) close(r->items[i].in_fd);
+    }
+    if (r->epfd >= 0) close(r->epfd);
+    free(r->items);
+    memset(r, 0, sizeof(*r));
+    r->epfd = -1;
+}
+
+/*
+ * Stop watching `fd` and close it. Forked children may hold copies of
+ * it, which would keep it in the epoll set after a plain close().
+ */
+static void reaper_close(Reaper* r, int fd) {
+#ifdef __linux__
+    if (r->epfd >= 0) epoll_ctl(r->epfd, EPOLL_CTL_DEL, fd, NULL);
+#else
+    (void)r;
+#endif
+    close(fd);
+}
+
+static void reaper_watch(Reaper* r, int fd, uint32_t events) {
+#ifdef __linux__
+    struct epoll_event ev = { .events = events };
+    ev.data.fd = fd;
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        nob_log(NOB_WARNING, "Could not watch child process: %s", strerror(errno));
+    }
+#else
+    (void)r;
+    (void)fd;
+    (void)events;
+#endif
+}
+
+/*
+ * Wait for `pid` too. With `out_fd` >= 0, everything it writes there is
+ * appended to `out` and the child is only reported once the pipe is at
+ * EOF as well; the reaper closes `out_fd`.
+ */
+void reaper_add(Reaper* r, pid_t pid, int out_fd, String_Builder* out) {
+    ReaperChild child = { .pid = pid, .pidfd = -1, .out_fd = out_fd, .out = out, .in_fd = -1 };
+#ifdef __linux__
+    if (r->epfd >= 0) {
+        child.pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+        if (child.pidfd >= 0) reaper_watch(r, child.pidfd, EPOLLIN);
+        if (out_fd >= 0) reaper_watch(r, out_fd, EPOLLIN);
+    }
+#endif
+    da_append(r, child);
+}
+
+static void reaper_close_input(Reaper* r, ReaperChild* child) {
+    if (child->in_off < child->in_len) {
+        nob_log(NOB_INFO, "Process %d closed its stdin after %zu of %zu bytes", (int)child->pid,
+                child->in_off, child->in_len);
+    }
+    reaper_close(r, child->in_fd);
+    child->in_fd = -1;
+}
+
+/*
+ * Write `data` to `in_fd`, the non-blocking write end of the stdin of
+ * `pid` (added before), while waiting; `in_fd` is closed once it's all
+ * written or the child exits. `data` must stay valid until then. The
+ * caller keeps SIGPIPE from killing it when the child stops reading.
+ */
+void reaper_feed(Reaper* r, pid_t pid, int in_fd, const char* data, size_t len) {
+    for (size_t i = 0; i < r->count; i++) {
+        ReaperChild* child = &r->items[i];
+        if (child->pid != pid) continue;
+        child->in_fd = in_fd;
+        child->in_data = data;
+        child->in_len = len;
+        child->in_off = 0;
+        if (len == 0) {
+            reaper_close_input(r, child);
+            return;
+        }
+#ifdef __linux__
+        if (r->epfd >= 0) reaper_watch(r, in_fd, EPOLLOUT);
+#endif
+        return;
+    }
+    close(in_fd);
+}
+
+static void reaper_collect(Reaper* r, ReaperChild* child) {
+    pid_t pid = wait4(child->pid, &child->wstatus, WNOHANG, &child->usage);
+    if (pid == 0 || (pid < 0 && errno == EINTR)) return;
+    if (pid < 0) {
+        /* Reaped behind our back (SIGCHLD ignored); report it as failed */
+        nob_log(NOB_WARNING, "Could not wait on process %d: %s", (int)child->pid, strerror(errno));
+        child->wstatus = -1;
+        memset(&child->usage, 0, sizeof(child->usage));
+    }
+    child->exited = true;
+    if (child->pidfd >= 0) {
+        reaper_close(r, child->pidfd);
+        child->pidfd = -1;
+    }
+    /* Nobody left to read it */
+    if (child->in_fd >= 0) reaper_close_input(r, child);
+}
+
+static void reaper_write(Reaper* r, ReaperChild* child) {
+    ssize_t n = write(child->in_fd, child->in_data + child->in_off, child->in_len - child->in_off);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) return;
+    if (n > 0) {
+        child->in_off += (size_t)n;
+        if (child->in_off < child->in_len) return;
+    }
+    reaper_close_input(r, child);
+}
+
+static void reaper_read(Reaper* r, ReaperChild* child) {
+    char buf[4096];
+    ssize_t n = read(child->out_fd, buf, sizeof(buf));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) return;
+    if (n > 0) {
+        if (child->out) sb_append_buf(child->out, buf, (size_t)n);
+        return;
+    }
+    reaper_close(r, child->out_fd);
+    child->out_fd = -1;
+}
+
+static ReaperChild* reaper_find_fd(Reaper* r, int fd) {
+    for (size_t i = 0; i < r->count; i++) {
+        if (r->items[i].pidfd == fd || r->items[i].out_fd == fd || r->items[i].in_fd == fd) return &r->items[i];
+    }
+    return NULL;
+}
+
+/*
+ * Sleep until something happens to a child or `wait_ms` passes (-1 =
+ * forever), and handle it. With `mask`, that is the signal mask while
+ * sleeping (epoll only; poll() sleeps with the current one).
+ */
+static bool reaper_wait_events(Reaper* r, int wait_ms, const sigset_t* mask) {
+#ifdef __linux__
+    if (r->epfd >= 0) {
+        struct epoll_event events[REAPER_MAX_EVENTS];
+        int n = epoll_pwait(r->epfd, events, REAPER_MAX_EVENTS, wait_ms, mask);
+        if (n < 0) return false;
+        for (int i = 0; i < n; i++) {
+            ReaperChild* child = reaper_find_fd(r, events[i].data.fd);
+            if (!child) continue;
+            if (child->pidfd == events[i].data.fd) {
+                reaper_collect(r, child);
+            } else if (child->in_fd == events[i].data.fd) {
+                reaper_write(r, child);
+            } else {
+                reaper_read(r, child);
+            }
+        }
+        return true;
+    }
+#else
+    (void)mask;
+#endif
+    struct pollfd fds[REAPER_MAX_EVENTS];
+    nfds_t nfds = 0;
+    for (size_t i = 0; i < r->count && nfds < REAPER_MAX_EVENTS; i++) {
+        if (r->items[i].out_fd >= 0) {
+            fds[nfds].fd = r->items[i].out_fd;
+            fds[nfds].events = POLLIN;
+            fds[nfds].revents = 0;
+            nfds++;
+        }
+        if (r->items[i].in_fd >= 0 && nfds < REAPER_MAX_EVENTS) {
+            fds[nfds].fd = r->items[i].in_fd;
+            fds[nfds].events = POLLOUT;
+            fds[nfds].revents = 0;
+            nfds++;
+        }
+    }
+    int n = poll(fds, nfds, wait_ms);
+    if (n < 0) return false;
+    for (nfds_t i = 0; i < nfds; i++) {
+        if (fds[i].revents == 0) continue;
+        ReaperChild* child = reaper_find_fd(r, fds[i].fd);
+        if (!child) continue;
+        if (child->in_fd == fds[i].fd) {
+            reaper_write(r, child);
+        } else {
+            reaper_read(r, child);
+        }
+    }
+    return true;
+}
+
+/*
+ * Wait up to `timeout_ms` (-1 = forever) for one of the children to end
+ * and reap it. Returns its pid, 0 on timeout, or -1 when there are no
+ * children left, waiting failed, or a signal set `interrupt` (errno EINTR).
+ */
+pid_t reaper_wait(Reaper* r, int timeout_ms, int* wstatus, struct rusage* usage) {
+    uint64_t start = nob_nanos_since_unspecified_epoch();
+
+    for (;;) {
+        bool polling = false;
+        for (size_t i = 0; i < r->count; i++) {
+            ReaperChild* child = &r->items[i];
+            if (!child->exited && child->pidfd < 0) {
+                reaper_collect(r, child);
+                polling = polling || !child->exited;
+            }
+            if (child->exited && child->out_fd < 0) {
+                pid_t pid = child->pid;
+                if (wstatus) *wstatus = child->wstatus;
+                if (usage) *usage = child->usage;
+                r->items[i] = r->items[--r->count];
+                return pid;
+            }
+        }
+        if (r->count == 0) return -1;
+
+        int wait_ms = -1;
+        if (timeout_ms >= 0) {
+            uint64_t elapsed_ms = (nob_nanos_since_unspecified_epoch() - start) / 1000000;
+            if (elapsed_ms >= (uint64_t)timeout_ms) return 0;
+            wait_ms = timeout_ms - (int)elapsed_ms;
+        }
+        if (polling && (wait_ms < 0 || wait_ms > REAPER_POLL_MS)) wait_ms = REAPER_POLL_MS;
+
+        /*
+         * A signal between checking `interrupt` and going to sleep would
+         * be missed until something else wakes us up, so SIGINT/SIGTERM
+         * stay blocked until epoll_pwait() unblocks them atomically.
+         * poll() can't, so it never sleeps longer than REAPER_POLL_MS.
+         */
+        sigset_t wait_mask;
+        if (r->interrupt) {
+            sigset_t stop_signals;
+            sigemptyset(&stop_signals);
+            sigaddset(&stop_signals, SIGINT);
+            sigaddset(&stop_signals, SIGTERM);
+            sigprocmask(SIG_BLOCK, &stop_signals, &wait_mask);
+            if (*r->interrupt) {
+                sigprocmask(SIG_SETMASK, &wait_mask, NULL);
+                errno = EINTR;
+                return -1;
+            }
+            if (r->epfd < 0 && (wait_ms < 0 || wait_ms > REAPER_POLL_MS)) wait_ms = REAPER_POLL_MS;
+        }
+        bool ok = reaper_wait_events(r, wait_ms, r->interrupt ? &wait_mask : NULL);
+        if (r->interrupt) {
+            int saved_errno = errno;
+            sigprocmask(SIG_SETMASK, &wait_mask, NULL);
+            errno = saved_errno;
+        }
+        if (!ok) {
+            if (errno == EINTR) continue;
+            nob_log(NOB_ERROR, "Could not wait on child processes: %s", strerror(errno));
+            return -1;
+        }
+    }
+}
+
+#endif
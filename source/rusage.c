@@ -0,0 +1,154 @@
+/*
+ * rusage.c - Per-command resource usage for Mewo
+ *
+ * Features:
+ *   - CPU time, peak RSS, page faults and context switches of the
+ *     processes a command started (getrusage(RUSAGE_CHILDREN) deltas),
+ *     or of the calling thread for a command run in-process (builtins)
+ *   - Bytes read and written, through syscalls and from storage
+ *     (/proc/self/io, which reaped children are added to on Linux)
+ *   - The last command's usage, for --debug and ${#rusage(field)}
+ *   - Zeros on Windows
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - nob.h utilities
+ */
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+typedef struct {
+    double user_s;
+    double sys_s;
+    size_t max_rss_kb;      /* 0 if no larger than an earlier command's */
+    size_t minflt;
+    size_t majflt;
+    size_t nvcsw;
+    size_t nivcsw;
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+    unsigned long long disk_read_bytes;
+    unsigned long long disk_write_bytes;
+    bool self;              /* sampled by rusage_begin_self() */
+} RUsage;
+
+static RUsage g_rusage_last = {0};
+
+static void rusage_sample(RUsage* start, bool self) {
+    memset(start, 0, sizeof(RUsage));
+    start->self = self;
+#ifndef _WIN32
+    struct rusage ru;
+#ifdef RUSAGE_THREAD
+    int who = self ? RUSAGE_THREAD : RUSAGE_CHILDREN;
+#else
+    int who = self ? RUSAGE_SELF : RUSAGE_CHILDREN;
+#endif
+    if (getrusage(who, &ru) == 0) {
+        start->user_s = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+        start->sys_s = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+#ifdef __APPLE__
+        start->max_rss_kb = (size_t)ru.ru_maxrss / 1024;
+#else
+        start->max_rss_kb = (size_t)ru.ru_maxrss;
+#endif
+        start->minflt = (size_t)ru.ru_minflt;
+        start->majflt = (size_t)ru.ru_majflt;
+        start->nvcsw = (size_t)ru.ru_nvcsw;
+        start->nivcsw = (size_t)ru.ru_nivcsw;
+    }
+
+    FILE* f = fopen("/proc/self/io", "rb");
+    if (f) {
+        char line[128];
+        unsigned long long value;
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "rchar: %llu", &value) == 1) start->read_bytes = value;
+            else if (sscanf(line, "wchar: %llu", &value) == 1) start->write_bytes = value;
+            else if (sscanf(line, "read_bytes: %llu", &value) == 1) start->disk_read_bytes = value;
+            else if (sscanf(line, "write_bytes: %llu", &value) == 1) start->disk_write_bytes = value;
+        }
+        fclose(f);
+    }
+#endif
+}
+
+/*
+ * Totals so far of everything this process has waited for, to be passed
+ * to rusage_end() once the command finished.
+ */
+void rusage_begin(RUsage* start) {
+    rusage_sample(start, false);
+}
+
+/*
+ * Totals so far of the calling thread, for a command mewo runs itself.
+ */
+void rusage_begin_self(RUsage* start) {
+    rusage_sample(start, true);
+}
+
+/*
+ * What was used since rusage_begin() or rusage_begin_self().
+ */
+void rusage_end(const RUsage* start, RUsage* out) {
+    RUsage now;
+    rusage_sample(&now, start->self);
+
+    out->user_s = now.user_s - start->user_s;
+    out->sys_s = now.sys_s - start->sys_s;
+    /* The peak is a maximum over all children, not a sum; mewo's own is not the command's */
+    out->max_rss_kb = !start->self && now.max_rss_kb > start->max_rss_kb ? now.max_rss_kb : 0;
+    out->minflt = now.minflt - start->minflt;
+    out->majflt = now.majflt - start->majflt;
+    out->nvcsw = now.nvcsw - start->nvcsw;
+    out->nivcsw = now.nivcsw - start->nivcsw;
+    out->read_bytes = now.read_bytes - start->read_bytes;
+    out->write_bytes = now.write_bytes - start->write_bytes;
+    out->disk_read_bytes = now.disk_read_bytes - start->disk_read_bytes;
+    out->disk_write_bytes = now.disk_write_bytes - start->disk_write_bytes;
+    out->self = start->self;
+}
+
+void rusage_set_last(const RUsage* usage) {
+    g_rusage_last = *usage;
+}
+
+const RUsage* rusage_last(void) {
+    return &g_rusage_last;
+}
+
+/*
+ * One field of `usage` as text: user, sys, cpu (seconds), maxrss (KiB),
+ * minflt, majflt, nvcsw, nivcsw, read, write, disk_read, disk_write (bytes).
+ */
+bool rusage_field(const RUsage* usage, const char* name, char* buf, size_t size) {
+    if (strcmp(name, "user") == 0) snprintf(buf, size, "%.3f", usage->user_s);
+    else if (strcmp(name, "sys") == 0) snprintf(buf, size, "%.3f", usage->sys_s);
+    else if (strcmp(name, "cpu") == 0) snprintf(buf, size, "%.3f", usage->user_s + usage->sys_s);
+    else if (strcmp(name, "maxrss") == 0) snprintf(buf, size, "%zu", usage->max_rss_kb);
+    else if (strcmp(name, "minflt") == 0) snprintf(buf, size, "%zu", usage->minflt);
+    else if (strcmp(name, "majflt") == 0) snprintf(buf, size, "%zu", usage->majflt);
+    else if (strcmp(name, "nvcsw") == 0) snprintf(buf, size, "%zu", usage->nvcsw);
+    else if (strcmp(name, "nivcsw") == 0) snprintf(buf, size, "%zu", usage->nivcsw);
+    else if (strcmp(name, "read") == 0) snprintf(buf, size, "%llu", usage->read_bytes);
+    else if (strcmp(name, "write") == 0) snprintf(buf, size, "%llu", usage->write_bytes);
+    else if (strcmp(name, "disk_read") == 0) snprintf(buf, size, "%llu", usage->disk_read_bytes);
+    else if (strcmp(name, "disk_write") == 0) snprintf(buf, size, "%llu", usage->disk_write_bytes);
+    else return false;
+    return true;
+}
+
+/*
+ * Human readable one line summary of `usage`.
+ */
+void rusage_format(const RUsage* usage, char* buf, size_t size) {
+    snprintf(buf, size,
+             "%.3fs user, %.3fs sys, %zu KiB max RSS, %zu/%zu major/minor faults, "
+             "%zu/%zu voluntary/involuntary switches, %llu KiB read, %llu KiB written",
+             usage->user_s, usage->sys_s, usage->max_rss_kb, usage->majflt, usage->minflt,
+             usage->nvcsw, usage->nivcsw, usage->read_bytes / 1024, usage->write_bytes / 1024);
+}
@@ -0,0 +1,152 @@
+/*
+ * scratch.c - Per-step scratch directories for Mewo (#scratch)
+ *
+ * Features:
+ *   - A fresh, uniquely named directory for a command or label, on
+ *     /dev/shm when it is there (tmpfs, so intermediate files never hit
+ *     the disk), else $TMPDIR or /tmp, or wherever --scratch-dir says
+ *   - Exposed as ${scratch} while the step runs; the previous value (a
+ *     scratch of an enclosing label, or a user variable) comes back after
+ *   - Removed recursively when the step ends, or kept for inspection when
+ *     it failed and --keep-scratch is set
+ *   - Also where #save captures a command's output, so concurrent jobs
+ *     never share a capture file
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - str_dup(), set_error() from error.c
+ *   - nob.h utilities
+ *   - vars_get(), vars_set(), vars_delete(), var_clone() from vars.c
+ */
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+static const char* g_scratch_root = NULL;
+static bool g_scratch_keep_failed = false;
+
+void scratch_set_options(const char* root, bool keep_failed) {
+    g_scratch_root = (root && *root) ? root : NULL;
+    g_scratch_keep_failed = keep_failed;
+}
+
+static const char* scratch_root(void) {
+    if (g_scratch_root) return g_scratch_root;
+#ifdef _WIN32
+    const char* temp = getenv("TEMP");
+    return temp ? temp : ".";
+#else
+    if (access("/dev/shm", W_OK | X_OK) == 0) return "/dev/shm";
+    const char* tmpdir = getenv("TMPDIR");
+    return (tmpdir && *tmpdir) ? tmpdir : "/tmp";
+#endif
+}
+
+/*
+ * Create a new scratch directory. Returns its path (to be freed), or
+ * NULL with an error set.
+ */
+char* scratch_create(size_t line_number) {
+    const char* root = scratch_root();
+#ifdef _WIN32
+    static unsigned counter = 0;
+    for (int attempt = 0; attempt < 100; attempt++) {
+        char* path = str_dup(temp_sprintf("%s\\mewo-%d-%u", root, _getpid(), counter++));
+        if (_mkdir(path) == 0) return path;
+        free(path);
+        if (errno != EEXIST) break;
+    }
+#else
+    char* path = str_dup(temp_sprintf("%s/mewo-XXXXXX", root));
+    if (mkdtemp(path)) return path;
+    free(path);
+#endif
+    char msg[512];
+    snprintf(msg, sizeof(msg), "Could not create a scratch directory in %s: %s", root, strerror(errno));
+    set_error(ERROR_RUNTIME, msg, line_number);
+    return NULL;
+}
+
+static bool scratch_remove_tree(const char* path) {
+    Nob_File_Type type = nob_get_file_type(path);
+    if ((int)type < 0) return false;
+
+    if (type == NOB_FILE_DIRECTORY) {
+        Nob_File_Paths children = {0};
+        if (!nob_read_entire_dir(path, &children)) return false;
+
+        bool ok = true;
+        for (size_t i = 0; i < children.count; i++) {
+            if (strcmp(children.items[i], ".") == 0 || strcmp(children.items[i], "..") == 0) continue;
+            size_t mark = temp_save();
+            ok = scratch_remove_tree(temp_sprintf("%s/%s", path, children.items[i])) && ok;
+            temp_rewind(mark);
+        }
+        da_free(children);
+#ifdef _WIN32
+        return ok && _rmdir(path) == 0;
+#else
+        return ok && rmdir(path) == 0;
+#endif
+    }
+
+    return nob_delete_file(path);
+}
+
+/*
+ * Remove a scratch directory, unless the step failed and --keep-scratch
+ * asks to keep it. Frees `path`.
+ */
+void scratch_destroy(char* path, bool ok) {
+    if (!path) return;
+    if (!ok && g_scratch_keep_failed) {
+        fprintf(stderr, "Kept scratch directory %s\n", path);
+    } else if (!scratch_remove_tree(path)) {
+        nob_log(NOB_WARNING, "Could not remove scratch directory %s", path);
+    }
+    free(path);
+}
+
+typedef struct {
+    char* path;
+    Variable* saved;    /* ${scratch} before the step, NULL if unset */
+} ScratchScope;
+
+/*
+ * Give the step a scratch directory as ${scratch}. In a dry run nothing
+ * is created and ${scratch} names where it would be.
+ */
+bool scratch_enter(ScratchScope* scope, bool dry_run, size_t line_number) {
+    Variable* old = vars_get("scratch");
+    scope->saved = old ? var_clone(old) : NULL;
+    scope->path = NULL;
+
+    const char* value = temp_sprintf("%s/mewo-XXXXXX", scratch_root());
+    if (!dry_run) {
+        scope->path = scratch_create(line_number);
+        if (!scope->path) {
+            if (scope->saved) var_free(scope->saved);
+            scope->saved = NULL;
+            return false;
+        }
+        value = scope->path;
+    }
+    vars_set_string("scratch", value);
+    return true;
+}
+
+void scratch_leave(ScratchScope* scope, bool ok) {
+    if (scope->saved) {
+        vars_set("scratch", scope->saved);
+    } else {
+        vars_delete("scratch");
+    }
+    scope->saved = NULL;
+    scratch_destroy(scope->path, ok);
+    scope->path = NULL;
+}
@@ -0,0 +1,137 @@
+/*
+ * shard.c - Deterministic work sharding for Mewo
+ *
+ * Features:
+ *   - --shard K/N selects the K-th of N shards (1-based)
+ *   - Stable FNV-1a hashing of item names by default
+ *   - Duration-balanced assignment (longest first, to the least loaded
+ *     shard) when a shared timing history is given with --shard-timings;
+ *     mewo records "label:" keys itself, "item:" keys for ${#shard()}
+ *     array items have to be added by the user. Without any, items are
+ *     spread evenly by count
+ *   - No coordinator: every node computes the same partition
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - History from history.c
+ */
+
+typedef struct {
+    size_t index;
+    size_t count;
+    bool balanced;
+    History timings;
+} Shard;
+
+static Shard g_shard = {0};
+
+bool shard_active(void) {
+    return g_shard.count > 1;
+}
+
+/*
+ * Configure sharding from "K/N". `timings_path` may be NULL for hashing.
+ */
+bool shard_init(const char* spec, const char* timings_path) {
+    char* end = NULL;
+    unsigned long k = strtoul(spec, &end, 10);
+    if (end == spec || *end != '/') return false;
+    const char* n_str = end + 1;
+    unsigned long n = strtoul(n_str, &end, 10);
+    if (end == n_str || *end != '\0') return false;
+    if (n == 0 || k == 0 || k > n) return false;
+
+    g_shard.index = (size_t)(k - 1);
+    g_shard.count = (size_t)n;
+
+    if (timings_path) {
+        if (!history_load(&g_shard.timings, timings_path)) {
+            nob_log(NOB_WARNING, "Could not read shard timings %s: %s", timings_path, strerror(errno));
+        }
+        g_shard.balanced = true;
+    }
+    return true;
+}
+
+void shard_free(void) {
+    history_free(&g_shard.timings);
+    memset(&g_shard, 0, sizeof(Shard));
+}
+
+static uint64_t shard_hash(const char* s) {
+    uint64_t h = 14695981039346656037ULL;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+typedef struct {
+    size_t index;
+    const char* name;
+    double weight;
+} ShardItem;
+
+static int shard_item_cmp(const void* a, const void* b) {
+    const ShardItem* x = a;
+    const ShardItem* y = b;
+    if (x->weight > y->weight) return -1;
+    if (x->weight < y->weight) return 1;
+    return strcmp(x->name, y->name);
+}
+
+/*
+ * Mark in `keep` which of `names` belong to this shard.
+ * `key_prefix` namespaces the timing keys (e.g. "label:").
+ */
+void shard_select(const char** names, size_t count, const char* key_prefix, bool* keep) {
+    if (!shard_active()) {
+        for (size_t i = 0; i < count; i++) keep[i] = true;
+        return;
+    }
+
+    if (!g_shard.balanced) {
+        for (size_t i = 0; i < count; i++) {
+            keep[i] = shard_hash(names[i]) % g_shard.count == g_shard.index;
+        }
+        return;
+    }
+
+    ShardItem* items = malloc(count * sizeof(ShardItem));
+    double known_total = 0;
+    size_t known = 0;
+    for (size_t i = 0; i < count; i++) {
+        items[i].index = i;
+        items[i].name = names[i];
+        items[i].weight = -1;
+
+        double ms;
+        if (history_get(&g_shard.timings, temp_sprintf("%s%s", key_prefix, names[i]), &ms)) {
+            items[i].weight = ms;
+            known_total += ms;
+            known++;
+        }
+    }
+
+    double fallback = known > 0 ? known_total / known : 1;
+    for (size_t i = 0; i < count; i++) {
+        if (items[i].weight < 0) items[i].weight = fallback;
+    }
+
+    qsort(items, count, sizeof(ShardItem), shard_item_cmp);
+
+    double* load = calloc(g_shard.count, sizeof(double));
+    for (size_t i = 0; i < count; i++) {
+        size_t best = 0;
+        for (size_t s = 1; s < g_shard.count; s++) {
+            if (load[s] < load[best]) best = s;
+        }
+        load[best] += items[i].weight;
+        keep[items[i].index] = best == g_shard.index;
+    }
+
+    free(load);
+    free(items);
+}
@@ -0,0 +1,797 @@
+/*
+ * trace.c - File access tracing for #traced commands (Linux)
+ *
+ * Features:
+ *   - Runs a command under ptrace and follows every process it forks,
+ *     until the command itself exits; the tracer is a process of its
+ *     own, which keeps what the command left running going untraced
+ *   - #timeout applies: SIGTERM to every tracee, then SIGKILL
+ *   - A seccomp filter installed in the child makes only file related
+ *     syscalls (open, exec, stat/access probes, rename, unlink) stop the
+ *     tracee, so compute-heavy commands run at full speed; without
+ *     seccomp every syscall is inspected instead
+ *   - Paths are resolved against the tracee's cwd or dirfd and stored
+ *     relative to the project directory; outside it, /proc, /sys, /dev,
+ *     /run and /tmp are ignored
+ *   - Result is a DepsFiles list: files read, files written, and files
+ *     looked up (found or missing) inside the project
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - str_dup() from error.c
+ *   - nob.h utilities
+ *   - DepsFiles, deps_files_add() from deps.c
+ */
+
+#ifdef __linux__
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#if defined(__x86_64__)
+    #define TRACE_AUDIT_ARCH AUDIT_ARCH_X86_64
+#elif defined(__aarch64__)
+    #define TRACE_AUDIT_ARCH AUDIT_ARCH_AARCH64
+#elif defined(__riscv) && __riscv_xlen == 64
+    #define TRACE_AUDIT_ARCH AUDIT_ARCH_RISCV64
+#endif
+
+#define TRACE_KILL_GRACE_MS 2000
+#define TRACE_TIMEOUT_EXIT_CODE 124   /* like timeout(1) */
+
+/* Kernel ABI of PTRACE_GET_SYSCALL_INFO (Linux 5.3+); libc headers vary */
+#define TRACE_GET_SYSCALL_INFO 0x420e
+#define TRACE_INFO_ENTRY 1
+#define TRACE_INFO_EXIT 2
+#define TRACE_INFO_SECCOMP 3
+
+typedef struct {
+    uint8_t op;
+    uint8_t pad[3];
+    uint32_t arch;
+    uint64_t instruction_pointer;
+    uint64_t stack_pointer;
+    union {
+        struct {
+            uint64_t nr;
+            uint64_t args[6];
+        } entry;
+        struct {
+            int64_t rval;
+            uint8_t is_error;
+        } exit;
+        struct {
+            uint64_t nr;
+            uint64_t args[6];
+            uint32_t ret_data;
+        } seccomp;
+    };
+} TraceSyscallInfo;
+
+typedef enum {
+    TRACE_READ,         /* open for reading, exec */
+    TRACE_WRITE,        /* open for writing, creat */
+    TRACE_PROBE,        /* stat, access, readlink */
+    TRACE_RENAME,       /* first path removed, second written */
+    TRACE_REMOVE,       /* unlink */
+} Trace_Op;
+
+typedef struct {
+    int pid;
+    bool in_syscall;
+    Trace_Op op;
+    char* path;
+    char* path2;
+} Tracee;
+
+typedef struct {
+    Tracee* items;
+    size_t count;
+    size_t capacity;
+    const char* root;
+    size_t root_len;
+    DepsFiles* files;
+} Tracer;
+
+static long trace_syscalls[] = {
+#ifdef SYS_open
+    SYS_open,
+#endif
+#ifdef SYS_creat
+    SYS_creat,
+#endif
+#ifdef SYS_stat
+    SYS_stat,
+#endif
+#ifdef SYS_lstat
+    SYS_lstat,
+#endif
+#ifdef SYS_access
+    SYS_access,
+#endif
+#ifdef SYS_readlink
+    SYS_readlink,
+#endif
+#ifdef SYS_rename
+    SYS_rename,
+#endif
+#ifdef SYS_unlink
+    SYS_unlink,
+#endif
+#ifdef SYS_openat2
+    SYS_openat2,
+#endif
+#ifdef SYS_faccessat2
+    SYS_faccessat2,
+#endif
+#ifdef SYS_renameat2
+    SYS_renameat2,
+#endif
+#ifdef SYS_statx
+    SYS_statx,
+#endif
+    SYS_openat, SYS_execve, SYS_execveat, SYS_newfstatat, SYS_faccessat,
+    SYS_readlinkat, SYS_renameat, SYS_unlinkat,
+};
+
+#define TRACE_SYSCALL_COUNT (sizeof(trace_syscalls) / sizeof(trace_syscalls[0]))
+
+/*
+ * In the child: stop only at the syscalls above. Returns false if seccomp
+ * is unavailable, in which case the tracer steps through every syscall.
+ */
+static bool trace_install_filter(void) {
+#ifdef TRACE_AUDIT_ARCH
+    struct sock_filter filter[4 + TRACE_SYSCALL_COUNT + 2];
+    size_t n = 0;
+    filter[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch));
+    filter[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, TRACE_AUDIT_ARCH, 1, 0);
+    filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+    filter[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr));
+    for (size_t i = 0; i < TRACE_SYSCALL_COUNT; i++) {
+        /* On a match, jump past the remaining compares to RET_TRACE */
+        uint8_t to_trace = (uint8_t)(TRACE_SYSCALL_COUNT - i);
+        filter[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)trace_syscalls[i], to_trace, 0);
+    }
+    filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+    filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE);
+
+    struct sock_fprog prog = { .len = (unsigned short)n, .filter = filter };
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0) return false;
+    return prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) == 0;
+#else
+    return false;
+#endif
+}
+
+/* process_vm_readv() is only declared with _GNU_SOURCE */
+static ssize_t trace_vm_read(int pid, void* dst, uint64_t addr, size_t len) {
+    struct iovec local = { dst, len };
+    struct iovec remote = { (void*)(uintptr_t)addr, len };
+    return (ssize_t)syscall(SYS_process_vm_readv, pid, &local, 1UL, &remote, 1UL, 0UL);
+}
+
+static Tracee* trace_get(Tracer* t, int pid) {
+    for (size_t i = 0; i < t->count; i++) {
+        if (t->items[i].pid == pid) return &t->items[i];
+    }
+    if (t->count >= t->capacity) {
+        size_t new_cap = t->capacity == 0 ? 16 : t->capacity * 2;
+        Tracee* new_items = realloc(t->items, new_cap * sizeof(Tracee));
+        if (!new_items) return NULL;
+        t->items = new_items;
+        t->capacity = new_cap;
+    }
+    Tracee* tracee = &t->items[t->count++];
+    memset(tracee, 0, sizeof(Tracee));
+    tracee->pid = pid;
+    return tracee;
+}
+
+static void trace_clear(Tracee* tracee) {
+    free(tracee->path);
+    free(tracee->path2);
+    tracee->path = NULL;
+    tracee->path2 = NULL;
+    tracee->in_syscall = false;
+}
+
+static void trace_remove(Tracer* t, int pid) {
+    for (size_t i = 0; i < t->count; i++) {
+        if (t->items[i].pid == pid) {
+            trace_clear(&t->items[i]);
+            t->items[i] = t->items[--t->count];
+            return;
+        }
+    }
+}
+
+/*
+ * Copy a NUL terminated string out of the tracee, one page at a time so
+ * a string ending just before an unmapped page still reads.
+ */
+static char* trace_read_string(int pid, uint64_t addr) {
+    if (addr == 0) return NULL;
+    char buf[PATH_MAX];
+    size_t len = 0;
+    while (len < sizeof(buf)) {
+        size_t page_left = 4096 - ((addr + len) & 4095);
+        size_t want = sizeof(buf) - len < page_left ? sizeof(buf) - len : page_left;
+        ssize_t n = trace_vm_read(pid, buf + len, addr + len, want);
+        if (n <= 0) return NULL;
+        char* nul = memchr(buf + len, '\0', (size_t)n);
+        if (nul) return str_dup(buf);
+        len += (size_t)n;
+    }
+    return NULL;
+}
+
+static char* trace_readlink(const char* link) {
+    char buf[PATH_MAX];
+    ssize_t n = readlink(link, buf, sizeof(buf) - 1);
+    if (n < 0) return NULL;
+    buf[n] = '\0';
+    return str_dup(buf);
+}
+
+/*
+ * Absolute, lexically normalized path of `path` as seen by `pid`.
+ */
+static char* trace_resolve(int pid, int dirfd, const char* path) {
+    String_Builder sb = {0};
+    if (path[0] != '/') {
+        char* base = dirfd == AT_FDCWD ? trace_readlink(temp_sprintf("/proc/%d/cwd", pid))
+                                       : trace_readlink(temp_sprintf("/proc/%d/fd/%d", pid, dirfd));
+        if (!base) return NULL;
+        sb_append_cstr(&sb, base);
+        free(base);
+    }
+    sb_append_cstr(&sb, "/");
+    sb_append_cstr(&sb, path);
+    sb_append_null(&sb);
+
+    /* Collapse "//", "/./" and "/../" */
+    char* out = malloc(sb.count + 1);
+    size_t o = 0;
+    const char* p = sb.items;
+    while (*p) {
+        while (*p == '/') p++;
+        if (!*p) break;
+        const char* seg = p;
+        while (*p && *p != '/') p++;
+        size_t seg_len = (size_t)(p - seg);
+        if (seg_len == 1 && seg[0] == '.') continue;
+        if (seg_len == 2 && seg[0] == '.' && seg[1] == '.') {
+            while (o > 0 && out[o - 1] != '/') o--;
+            if (o > 0) o--;
+            continue;
+        }
+        out[o++] = '/';
+        memcpy(out + o, seg, seg_len);
+        o += seg_len;
+    }
+    if (o == 0) out[o++] = '/';
+    out[o] = '\0';
+    sb_free(sb);
+    return out;
+}
+
+static bool trace_ignored(const char* abs) {
+    static const char* prefixes[] = { "/proc/", "/sys/", "/dev/", "/run/", "/tmp/" };
+    for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+        if (strncmp(abs, prefixes[i], strlen(prefixes[i])) == 0) return true;
+    }
+    return false;
+}
+
+static void trace_note(Tracer* t, const char* abs, Trace_Op op, bool found) {
+    if (!abs) return;
+
+    const char* path = abs;
+    bool inside = strncmp(abs, t->root, t->root_len) == 0 && abs[t->root_len] == '/';
+    if (!inside && trace_ignored(abs)) return;
+    if (inside) {
+        path = abs + t->root_len + 1;
+        if (strncmp(path, MEWO_STATE_DIR "/", strlen(MEWO_STATE_DIR) + 1) == 0) return;
+    }
+
+    switch (op) {
+        case TRACE_READ:
+            deps_files_add(t->files, path, DEPS_INPUT);
+            break;
+        case TRACE_PROBE:
+            /* Lookups outside the project (search paths) are too noisy to track */
+            if (inside) deps_files_add(t->files, path, found ? DEPS_PRESENT : DEPS_ABSENT);
+            break;
+        case TRACE_WRITE:
+        case TRACE_RENAME:
+        case TRACE_REMOVE:
+            deps_files_add(t->files, path, DEPS_OUTPUT);
+            break;
+    }
+}
+
+/*
+ * Syscall entry: remember what the call is about to touch.
+ */
+static void trace_enter(Tracer* t, Tracee* tracee, uint64_t nr, const uint64_t* args) {
+    int pid = tracee->pid;
+    int dirfd = AT_FDCWD;
+    uint64_t path_arg = 0;
+    uint64_t flags = 0;
+
+    trace_clear(tracee);
+    tracee->in_syscall = true;
+    tracee->op = TRACE_PROBE;
+
+    long n = (long)nr;
+    if (n == SYS_openat) {
+        dirfd = (int)args[0];
+        path_arg = args[1];
+        flags = args[2];
+        tracee->op = (flags & (O_WRONLY | O_RDWR | O_CREAT | O_TRUNC)) ? TRACE_WRITE : TRACE_READ;
+#ifdef SYS_openat2
+    } else if (n == SYS_openat2) {
+        dirfd = (int)args[0];
+        path_arg = args[1];
+        if (trace_vm_read(pid, &flags, args[2], sizeof(flags)) != sizeof(flags)) flags = 0;
+        tracee->op = (flags & (O_WRONLY | O_RDWR | O_CREAT | O_TRUNC)) ? TRACE_WRITE : TRACE_READ;
+#endif
+#ifdef SYS_open
+    } else if (n == SYS_open) {
+        path_arg = args[0];
+        flags = args[1];
+        tracee->op = (flags & (O_WRONLY | O_RDWR | O_CREAT | O_TRUNC)) ? TRACE_WRITE : TRACE_READ;
+#endif
+#ifdef SYS_creat
+    } else if (n == SYS_creat) {
+        path_arg = args[0];
+        tracee->op = TRACE_WRITE;
+#endif
+    } else if (n == SYS_execve) {
+        path_arg = args[0];
+        tracee->op = TRACE_READ;
+    } else if (n == SYS_execveat) {
+        dirfd = (int)args[0];
+        path_arg = args[1];
+        tracee->op = TRACE_READ;
+    } else if (n == SYS_newfstatat || n == SYS_faccessat || n == SYS_readlinkat
+#ifdef SYS_statx
+               || n == SYS_statx
+#endif
+#ifdef SYS_faccessat2
+               || n == SYS_faccessat2
+#endif
+               ) {
+        dirfd = (int)args[0];
+        path_arg = args[1];
+#if defined(SYS_stat) && defined(SYS_lstat) && defined(SYS_access) && defined(SYS_readlink)
+    } else if (n == SYS_stat || n == SYS_lstat || n == SYS_access || n == SYS_readlink) {
+        path_arg = args[0];
+#endif
+    } else if (n == SYS_renameat
+#ifdef SYS_renameat2
+               || n == SYS_renameat2
+#endif
+               ) {
+        tracee->op = TRACE_RENAME;
+        char* from = trace_read_string(pid, args[1]);
+        char* to = trace_read_string(pid, args[3]);
+        if (from && from[0]) tracee->path = trace_resolve(pid, (int)args[0], from);
+        if (to && to[0]) tracee->path2 = trace_resolve(pid, (int)args[2], to);
+        free(from);
+        free(to);
+        return;
+#ifdef SYS_rename
+    } else if (n == SYS_rename) {
+        tracee->op = TRACE_RENAME;
+        char* from = trace_read_string(pid, args[0]);
+        char* to = trace_read_string(pid, args[1]);
+        if (from && from[0]) tracee->path = trace_resolve(pid, AT_FDCWD, from);
+        if (to && to[0]) tracee->path2 = trace_resolve(pid, AT_FDCWD, to);
+        free(from);
+        free(to);
+        return;
+#endif
+    } else if (n == SYS_unlinkat) {
+        dirfd = (int)args[0];
+        path_arg = args[1];
+        tracee->op = TRACE_REMOVE;
+#ifdef SYS_unlink
+    } else if (n == SYS_unlink) {
+        path_arg = args[0];
+        tracee->op = TRACE_REMOVE;
+#endif
+    } else {
+        tracee->in_syscall = false;
+        return;
+    }
+
+    char* raw = trace_read_string(pid, path_arg);
+    if (raw && raw[0]) tracee->path = trace_resolve(pid, dirfd, raw);
+    free(raw);
+
+    /* exec replaces the address space, so record it now */
+    if (tracee->op == TRACE_READ && (n == SYS_execve || n == SYS_execveat) && tracee->path) {
+        if (access(tracee->path, X_OK) == 0) trace_note(t, tracee->path, TRACE_READ, true);
+        trace_clear(tracee);
+    }
+}
+
+/*
+ * Syscall exit: successful opens are accesses, failed lookups are probes.
+ */
+static void trace_exit(Tracer* t, Tracee* tracee, int64_t rval) {
+    if (!tracee->in_syscall) return;
+
+    if (tracee->op == TRACE_RENAME) {
+        if (rval == 0) {
+            trace_note(t, tracee->path, TRACE_REMOVE, true);
+            trace_note(t, tracee->path2, TRACE_WRITE, true);
+        }
+    } else if (tracee->op == TRACE_PROBE) {
+        if (rval >= 0) trace_note(t, tracee->path, TRACE_PROBE, true);
+        else if (rval == -ENOENT || rval == -ENOTDIR) trace_note(t, tracee->path, TRACE_PROBE, false);
+    } else if (rval >= 0) {
+        trace_note(t, tracee->path, tracee->op, true);
+    } else if ((rval == -ENOENT || rval == -ENOTDIR) && tracee->op == TRACE_READ) {
+        trace_note(t, tracee->path, TRACE_PROBE, false);
+    }
+    trace_clear(tracee);
+}
+
+static bool trace_uses_seccomp(int pid) {
+    /* /proc files report size 0, so read_entire_file() can't be used */
+    FILE* f = fopen(temp_sprintf("/proc/%d/status", pid), "r");
+    if (!f) return false;
+    bool seccomp = false;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "Seccomp:", 8) == 0) {
+            seccomp = atoi(line + 8) == 2;
+            break;
+        }
+    }
+    fclose(f);
+    return seccomp;
+}
+
+/* Continue a tracee: to the next filtered syscall, or the next one */
+#define TRACE_RESUME(p, sig) ptrace(seccomp ? PTRACE_CONT : PTRACE_SYSCALL, (p), NULL, (void*)(long)(sig))
+
+/*
+ * Handle one ptrace stop of tracee `w`. Children it forks are added to
+ * `t`, so only known tracees are ever waited for.
+ */
+static void trace_stopped(Tracer* t, int w, int status, bool seccomp) {
+    Tracee* tracee = trace_get(t, w);
+    int sig = WSTOPSIG(status);
+    int event = status >> 16;
+
+    if (sig == (SIGTRAP | 0x80) || event == PTRACE_EVENT_SECCOMP) {
+        TraceSyscallInfo info;
+        memset(&info, 0, sizeof(info));
+        long got = ptrace((enum __ptrace_request)TRACE_GET_SYSCALL_INFO, w, (void*)sizeof(info), &info);
+        if (got > 0 && tracee) {
+            if (info.op == TRACE_INFO_SECCOMP) {
+                trace_enter(t, tracee, info.seccomp.nr, info.seccomp.args);
+                /* Step to the exit of this syscall to see its result */
+                ptrace(PTRACE_SYSCALL, w, NULL, NULL);
+                return;
+            }
+            if (info.op == TRACE_INFO_ENTRY) {
+                trace_enter(t, tracee, info.entry.nr, info.entry.args);
+            } else if (info.op == TRACE_INFO_EXIT) {
+                trace_exit(t, tracee, info.exit.rval);
+            }
+        }
+        TRACE_RESUME(w, 0);
+    } else if (event != 0) {
+        /* fork/clone notifications name the new child, which attached itself */
+        unsigned long child = 0;
+        if ((event == PTRACE_EVENT_FORK || event == PTRACE_EVENT_VFORK || event == PTRACE_EVENT_CLONE) &&
+            ptrace(PTRACE_GETEVENTMSG, w, NULL, &child) == 0 && child > 0) {
+            trace_get(t, (int)child);
+        }
+        TRACE_RESUME(w, 0);
+    } else if (sig == SIGSTOP && tracee && !tracee->in_syscall) {
+        /* Initial stop of a newly attached child */
+        TRACE_RESUME(w, 0);
+    } else {
+        TRACE_RESUME(w, sig == SIGTRAP ? 0 : sig);
+    }
+}
+
+/*
+ * Poll every known tracee once and handle what happened. Sets *top_exit
+ * once `top` exited. True if anything did.
+ */
+static bool trace_poll(Tracer* t, int top, bool seccomp, int* top_exit, bool* top_done) {
+    bool progressed = false;
+    size_t i = 0;
+    while (i < t->count) {
+        int w = t->items[i].pid;
+        int status;
+        int r = waitpid(w, &status, WNOHANG | __WALL);
+        if (r < 0 && errno == EINTR) continue;
+        if (r == 0) {
+            i++;
+            continue;
+        }
+        progressed = true;
+
+        if (r < 0 || WIFEXITED(status) || WIFSIGNALED(status)) {
+            if (w == top) {
+                if (r > 0) *top_exit = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+                *top_done = true;
+            }
+            /* The last tracee takes its place, so `i` stays */
+            trace_remove(t, w);
+            continue;
+        }
+        if (WIFSTOPPED(status)) trace_stopped(t, w, status, seccomp);
+        i++;
+    }
+    return progressed;
+}
+
+static void trace_signal_all(Tracer* t, int sig) {
+    for (size_t i = 0; i < t->count; i++) {
+        syscall(SYS_tkill, t->items[i].pid, sig);
+    }
+}
+
+/*
+ * Keep what the command left running (background jobs, daemons) going
+ * without recording anything. They can't be detached: the seccomp filter
+ * stays and fails every filtered syscall with ENOSYS when there is no
+ * tracer, so this process stays their tracer until they are all gone.
+ */
+static void trace_linger(void) {
+    /* Don't hold mewo's descriptors (event stream, pipes of other jobs) open meanwhile */
+    DIR* dir = opendir("/proc/self/fd");
+    if (dir) {
+        int own = dirfd(dir);
+        struct dirent* ent;
+        while ((ent = readdir(dir))) {
+            int fd = atoi(ent->d_name);
+            if (fd > STDERR_FILENO && fd != own) close(fd);
+        }
+        closedir(dir);
+    }
+
+    for (;;) {
+        int status;
+        int w = waitpid(-1, &status, __WALL);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        if (!WIFSTOPPED(status)) continue;
+        int sig = WSTOPSIG(status);
+        int event = status >> 16;
+        bool delivered = event == 0 && sig != (SIGTRAP | 0x80) && sig != SIGTRAP;
+        /* The initial stop of a new child is ptrace's, not a real SIGSTOP */
+        if (sig == SIGSTOP && event == 0) delivered = false;
+        ptrace(PTRACE_CONT, w, NULL, (void*)(long)(delivered ? sig : 0));
+    }
+}
+
+/*
+ * The tracer process: run and trace the command until it exits, write
+ * "<exit code> <timed out>\0" and then "<kind> <path>\0" per file to
+ * `out_fd`, then linger for its leftover children. Never returns.
+ */
+static void trace_session(const char* root, const char* shell, const char* cmd, int timeout_ms, int out_fd) {
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+    int pid = fork();
+    if (pid < 0) _exit(127);
+
+    if (pid == 0) {
+        close(out_fd);
+        if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) != 0) _exit(127);
+        trace_install_filter();
+        raise(SIGSTOP);
+        const char* sh = shell ? shell : "/bin/sh";
+        execlp(sh, sh, "-c", cmd, (char*)NULL);
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status)) _exit(127);
+
+    bool seccomp = trace_uses_seccomp(pid);
+    long options = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK |
+                   PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL;
+    if (seccomp) options |= PTRACE_O_TRACESECCOMP;
+    if (ptrace(PTRACE_SETOPTIONS, pid, NULL, (void*)options) != 0) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        _exit(127);
+    }
+    nob_log(NOB_INFO, "trace: %s", seccomp ? "seccomp filtered" : "stepping every syscall");
+
+    DepsFiles files = {0};
+    Tracer t = {0};
+    t.root = root;
+    t.root_len = strcmp(root, "/") == 0 ? 0 : strlen(root);
+    t.files = &files;
+
+    /* Tracee stops arrive as SIGCHLD; taken with sigtimedwait() so the deadline applies */
+    sigset_t chld_set;
+    sigemptyset(&chld_set);
+    sigaddset(&chld_set, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_set, NULL);
+
+    trace_get(&t, pid);
+    TRACE_RESUME(pid, 0);
+    int exit_code = -1;
+
+    uint64_t deadline = timeout_ms > 0 ? nob_nanos_since_unspecified_epoch() + (uint64_t)timeout_ms * 1000000 : 0;
+    bool timed_out = false;
+    bool killed = false;
+    bool top_done = false;
+    while (!top_done) {
+        if (trace_poll(&t, pid, seccomp, &exit_code, &top_done)) continue;
+        if (t.count == 0) break;
+
+        if (deadline == 0) {
+            sigwaitinfo(&chld_set, NULL);
+            continue;
+        }
+        uint64_t now = nob_nanos_since_unspecified_epoch();
+        if (now < deadline) {
+            uint64_t left = deadline - now;
+            struct timespec ts = { .tv_sec = (time_t)(left / 1000000000), .tv_nsec = (long)(left % 1000000000) };
+            sigtimedwait(&chld_set, NULL, &ts);
+            continue;
+        }
+
+        if (!timed_out) {
+            timed_out = true;
+            trace_signal_all(&t, SIGTERM);
+            deadline = now + (uint64_t)TRACE_KILL_GRACE_MS * 1000000;
+        } else if (!killed) {
+            killed = true;
+            trace_signal_all(&t, SIGKILL);
+            deadline = 0;
+        }
+    }
+
+    String_Builder sb = {0};
+    sb_appendf(&sb, "%d %d", timed_out ? TRACE_TIMEOUT_EXIT_CODE : exit_code, timed_out ? 1 : 0);
+    da_append(&sb, '\0');
+    for (size_t i = 0; i < files.count; i++) {
+        sb_appendf(&sb, "%d %s", (int)files.items[i].kind, files.items[i].path);
+        da_append(&sb, '\0');
+    }
+    for (size_t off = 0; off < sb.count;) {
+        ssize_t n = write(out_fd, sb.items + off, sb.count - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        off += (size_t)n;
+    }
+    close(out_fd);
+
+    trace_linger();
+    _exit(0);
+}
+
+/*
+ * Run `cmd` through `shell` (or /bin/sh) and collect the files it and its
+ * children touched, relative to `root_dir` when inside it. Tracing ends
+ * when the shell exits; what it left running goes on untraced. After
+ * `timeout_ms` (0 = no limit) every tracee gets SIGTERM, and SIGKILL
+ * TRACE_KILL_GRACE_MS later, and *timed_out is set. False if the command
+ * could not be started or traced.
+ *
+ * The tracer is a process of its own that mewo doesn't wait for, so it
+ * can outlive the command for the children it left behind.
+ */
+bool trace_run(const char* root_dir, const char* shell, const char* cmd, int timeout_ms,
+               int* exit_code, bool* timed_out, DepsFiles* files) {
+    *timed_out = false;
+    *exit_code = 127;
+    char* root = realpath(root_dir, NULL);
+    if (!root) return false;
+
+    int fds[2];
+    if (pipe(fds) < 0) {
+        free(root);
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+    fflush(stdout);
+    fflush(stderr);
+
+    int pid = fork();
+    if (pid == 0) {
+        /* Orphan the tracer, so nobody has to wait for it */
+        close(fds[0]);
+        if (fork() != 0) _exit(0);
+        trace_session(root, shell, cmd, timeout_ms, fds[1]);
+    }
+    close(fds[1]);
+    free(root);
+    if (pid < 0) {
+        close(fds[0]);
+        return false;
+    }
+    while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {}
+
+    String_Builder sb = {0};
+    char buf[4096];
+    for (;;) {
+        ssize_t n = read(fds[0], buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        sb_append_buf(&sb, buf, (size_t)n);
+    }
+    close(fds[0]);
+
+    /* The first record is the result; without it the tracer failed */
+    const char* p = sb.items;
+    const char* end = sb.items + sb.count;
+    const char* nul = p ? memchr(p, '\0', (size_t)(end - p)) : NULL;
+    int code, timeout_flag;
+    bool ok = nul && sscanf(p, "%d %d", &code, &timeout_flag) == 2;
+    if (ok) {
+        *exit_code = code;
+        *timed_out = timeout_flag != 0;
+        for (p = nul + 1; p < end; p = nul + 1) {
+            nul = memchr(p, '\0', (size_t)(end - p));
+            if (!nul) break;
+            int kind;
+            int skip = 0;
+            if (sscanf(p, "%d %n", &kind, &skip) == 1 && skip > 0) {
+                deps_files_add(files, p + skip, (Deps_Kind)kind);
+            }
+        }
+    }
+    sb_free(sb);
+    return ok;
+}
+
+#undef TRACE_RESUME
+
+bool trace_supported(void) {
+    return true;
+}
+
+#else
+
+bool trace_run(const char* root_dir, const char* shell, const char* cmd, int timeout_ms,
+               int* exit_code, bool* timed_out, DepsFiles* files) {
+    (void)root_dir;
+    (void)shell;
+    (void)cmd;
+    (void)timeout_ms;
+    (void)exit_code;
+    (void)files;
+    *timed_out = false;
+    return false;
+}
+
+bool trace_supported(void) {
+    return false;
+}
+
+#endif
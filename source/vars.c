@@ -7,12 +7,16 @@
  *   - Escape sequence $${} for literal ${
  *   - Nested interpolation ${${varname}}
  *   - Type coercion to string for interpolation
+ *   - Content hashes with ${#hash(path)}
+ *   - Last command's resource usage with ${#rusage(field)}
  */
 
 /* Note: This file is included from main.c which provides:
  *   - stdio.h, stdlib.h, string.h, stdbool.h
  *   - str_dup() from error.c
  *   - nob.h utilities
+ *   - rusage_last(), rusage_field() from rusage.c
+ *   - Reaper from reaper.c
  */
 
 #include <math.h>
@@ -106,6 +110,8 @@ static int g_last_exit_code = 0;
 
 static char* g_global_shell = NULL;
 
+static char* g_matrix_id = NULL;
+
 void set_last_exit_code(int code) {
     g_last_exit_code = code;
 }
@@ -123,6 +129,15 @@ const char* get_global_shell(void) {
     return g_global_shell;
 }
 
+void set_matrix_id(const char* id) {
+    free(g_matrix_id);
+    g_matrix_id = id ? str_dup(id) : NULL;
+}
+
+const char* get_matrix_id(void) {
+    return g_matrix_id ? g_matrix_id : "";
+}
+
 void argv_init(char** args, size_t count) {
     g_argv.items = args;
     g_argv.count = count;
@@ -237,6 +252,34 @@ void vars_free(void) {
     g_variables.capacity = 0;
 }
 
+Variables vars_snapshot(void) {
+    Variables snap = {0};
+    if (g_variables.count == 0) return snap;
+
+    snap.keys = malloc(g_variables.count * sizeof(char*));
+    snap.values = malloc(g_variables.count * sizeof(Variable*));
+    if (!snap.keys || !snap.values) {
+        free(snap.keys);
+        free(snap.values);
+        memset(&snap, 0, sizeof(snap));
+        return snap;
+    }
+    snap.capacity = g_variables.count;
+
+    for (size_t i = 0; i < g_variables.count; i++) {
+        snap.keys[snap.count] = str_dup(g_variables.keys[i]);
+        snap.values[snap.count] = var_clone(g_variables.values[i]);
+        snap.count++;
+    }
+    return snap;
+}
+
+void vars_restore(Variables* snap) {
+    vars_free();
+    g_variables = *snap;
+    memset(snap, 0, sizeof(Variables));
+}
+
 static int vars_find_index(const char* name) {
     for (size_t i = 0; i < g_variables.count; i++) {
         if (strcmp(g_variables.keys[i], name) == 0) {
@@ -582,6 +625,60 @@ static bool is_valid_identifier(const char* s) {
     return true;
 }
 
+/*
+ * Run `cmd` for ${#exec}, through `shell` (NULL for /bin/sh), and append
+ * what it prints to `out`.
+ */
+static bool vars_exec_capture(const char* shell, const char* cmd, String_Builder* out) {
+#ifdef _WIN32
+    FILE* fp = NULL;
+    if (shell) {
+        fp = popen(temp_sprintf("%s -c \"%s\"", shell, cmd), "r");
+    } else {
+        fp = popen(cmd, "r");
+    }
+    if (!fp) return false;
+
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) sb_append_buf(out, buf, n);
+    pclose(fp);
+    return true;
+#else
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        if (shell) {
+            execlp(shell, shell, "-c", cmd, (char*)NULL);
+        } else {
+            execl("/bin/sh", "sh", "-c", cmd, (char*)NULL);
+        }
+        _exit(127);
+    }
+    close(fds[1]);
+
+    /* The output is read while waiting, so a long one can't fill the pipe */
+    Reaper reaper;
+    reaper_init(&reaper);
+    reaper_add(&reaper, pid, fds[0], out);
+    pid_t done = reaper_wait(&reaper, -1, NULL, NULL);
+    reaper_free(&reaper);
+    return done == pid;
+#endif
+}
+
 static char* interp_internal(const char* input, size_t line_number, bool* error) {
     if (!input) {
         *error = false;
@@ -721,6 +818,49 @@ static char* interp_internal(const char* input, size_t line_number, bool* error)
                 continue;
             }
             
+            if (strcmp(interpolated_expr, "#matrix_id") == 0) {
+                free(interpolated_expr);
+                if (!ib_append_str(&ib, get_matrix_id())) {
+                    set_error(ERROR_MEMORY, "Out of memory during interpolation", line_number);
+                    ib_free(&ib);
+                    *error = true;
+                    return NULL;
+                }
+                p = after;
+                continue;
+            }
+            
+            if (strcmp(interpolated_expr, "#rusage") == 0 ||
+                (strncmp(interpolated_expr, "#rusage(", 8) == 0 &&
+                 interpolated_expr[strlen(interpolated_expr) - 1] == ')')) {
+                char buf[512];
+                bool known = true;
+                if (interpolated_expr[7] == '\0') {
+                    rusage_format(rusage_last(), buf, sizeof(buf));
+                } else {
+                    interpolated_expr[strlen(interpolated_expr) - 1] = '\0';
+                    known = rusage_field(rusage_last(), interpolated_expr + 8, buf, sizeof(buf));
+                }
+                if (!known) {
+                    char err_msg[256];
+                    snprintf(err_msg, sizeof(err_msg), "Unknown #rusage() field '%s'", interpolated_expr + 8);
+                    set_error(ERROR_RUNTIME, err_msg, line_number);
+                    free(interpolated_expr);
+                    ib_free(&ib);
+                    *error = true;
+                    return NULL;
+                }
+                free(interpolated_expr);
+                if (!ib_append_str(&ib, buf)) {
+                    set_error(ERROR_MEMORY, "Out of memory during interpolation", line_number);
+                    ib_free(&ib);
+                    *error = true;
+                    return NULL;
+                }
+                p = after;
+                continue;
+            }
+            
             if (strcmp(interpolated_expr, "argv") == 0) {
                 free(interpolated_expr);
                 for (size_t i = 0; i < argv_count(); i++) {
@@ -787,7 +927,99 @@ static char* interp_internal(const char* input, size_t line_number, bool* error)
                 continue;
             }
             
-            if (strncmp(interpolated_expr, "#env(", 5) == 0 && 
+            if (strncmp(interpolated_expr, "#shard(", 7) == 0 &&
+                interpolated_expr[strlen(interpolated_expr) - 1] == ')') {
+                size_t param_len = strlen(interpolated_expr) - 8;
+                char* param = malloc(param_len + 1);
+                if (!param) {
+                    set_error(ERROR_MEMORY, "Out of memory", line_number);
+                    free(interpolated_expr);
+                    ib_free(&ib);
+                    *error = true;
+                    return NULL;
+                }
+                memcpy(param, interpolated_expr + 7, param_len);
+                param[param_len] = '\0';
+                free(interpolated_expr);
+
+                Variable* var = vars_get(param);
+                if (!var || var->type != VAR_ARRAY) {
+                    char err_msg[256];
+                    snprintf(err_msg, sizeof(err_msg), "#shard() expects an array variable, got '%s'", param);
+                    set_error(ERROR_RUNTIME, err_msg, line_number);
+                    free(param);
+                    ib_free(&ib);
+                    *error = true;
+                    return NULL;
+                }
+                free(param);
+
+                size_t count = var->array_value.count;
+                char** names = malloc((count + 1) * sizeof(char*));
+                bool* keep = malloc((count + 1) * sizeof(bool));
+                for (size_t i = 0; i < count; i++) {
+                    names[i] = var_to_string(var->array_value.items[i]);
+                }
+                shard_select((const char**)names, count, "item:", keep);
+
+                bool first = true;
+                bool ok = true;
+                for (size_t i = 0; i < count; i++) {
+                    if (keep[i]) {
+                        if (!first) ok = ok && ib_append_char(&ib, ',');
+                        ok = ok && ib_append_str(&ib, names[i]);
+                        first = false;
+                    }
+                    free(names[i]);
+                }
+                free(names);
+                free(keep);
+
+                if (!ok) {
+                    set_error(ERROR_MEMORY, "Out of memory during interpolation", line_number);
+                    ib_free(&ib);
+                    *error = true;
+                    return NULL;
+                }
+                p = after;
+                continue;
+            }
+
+            if (strncmp(interpolated_expr, "#hash(", 6) == 0 &&
+                interpolated_expr[strlen(interpolated_expr) - 1] == ')') {
+                size_t content_len = strlen(interpolated_expr) - 7;
+                char* path = malloc(content_len + 1);
+                if (!path) {
+                    set_error(ERROR_MEMORY, "Out of memory", line_number);
+                    free(interpolated_expr);
+                    ib_free(&ib);
+                    *error = true;
+                    return NULL;
+                }
+                memcpy(path, interpolated_expr + 6, content_len);
+                path[content_len] = '\0';
+                free(interpolated_expr);
+
+                char* start = path;
+                while (*start == ' ' || *start == '\t') start++;
+                size_t pl = strlen(start);
+                while (pl > 0 && (start[pl-1] == ' ' || start[pl-1] == '\t')) start[--pl] = '\0';
+
+                char hex[41];
+                if (!file_content_hash(start, hex)) {
+                    set_error(ERROR_RUNTIME, temp_sprintf("#hash: cannot read '%s'", start), line_number);
+                    free(path);
+                    ib_free(&ib);
+                    *error = true;
+                    return NULL;
+                }
+                free(path);
+                ib_append_str(&ib, hex);
+                p = after;
+                continue;
+            }
+
+            if (strncmp(interpolated_expr, "#env(", 5) == 0 &&
                 interpolated_expr[strlen(interpolated_expr) - 1] == ')') {
                 size_t content_len = strlen(interpolated_expr) - 6;
                 char* content = malloc(content_len + 1);
@@ -954,29 +1186,10 @@ static char* interp_internal(const char* input, size_t line_number, bool* error)
                     shell = NULL;
                 }
 
-                char output_buf[1024] = {0};
-                size_t out_len = 0;
-
-                FILE* fp = NULL;
-                if (shell) {
-                    char* full_cmd = malloc(strlen(shell) + strlen(cmd) + 6);
-                    if (!full_cmd) {
-                        set_error(ERROR_MEMORY, "Out of memory", line_number);
-                        free(cmd);
-                        free(content);
-                        ib_free(&ib);
-                        *error = true;
-                        return NULL;
-                    }
-                    sprintf(full_cmd, "%s -c \"%s\"", shell, cmd);
-                    fp = popen(full_cmd, "r");
-                    free(full_cmd);
-                } else {
-                    fp = popen(cmd, "r");
-                }
-
-                if (!fp) {
+                String_Builder output = {0};
+                if (!vars_exec_capture(shell, cmd, &output)) {
                     set_error(ERROR_RUNTIME, "Failed to execute command", line_number);
+                    sb_free(output);
                     free(cmd);
                     free(content);
                     ib_free(&ib);
@@ -984,16 +1197,12 @@ static char* interp_internal(const char* input, size_t line_number, bool* error)
                     return NULL;
                 }
 
-                while (fgets(output_buf + out_len, sizeof(output_buf) - out_len, fp)) {
-                    out_len = strlen(output_buf);
-                    if (out_len >= sizeof(output_buf) - 1) break;
-                }
-
-                pclose(fp);
-
-                if (out_len > 0 && output_buf[out_len - 1] == '\n') output_buf[out_len - 1] = '\0';
+                if (output.count > 0 && output.items[output.count - 1] == '\n') output.count--;
+                sb_append_null(&output);
 
-                if (!ib_append_str(&ib, output_buf)) {
+                bool appended = ib_append_str(&ib, output.items);
+                sb_free(output);
+                if (!appended) {
                     set_error(ERROR_MEMORY, "Out of memory during interpolation", line_number);
                     free(cmd);
                     free(content);
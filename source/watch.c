@@ -0,0 +1,661 @@
+/*
+ * watch.c - Watch mode for Mewo (--watch)
+ *
+ * Features:
+ *   - Reruns a label whenever one of its watched files changes
+ *   - Watched paths come from #watch(...) statements (globs allowed),
+ *     otherwise the whole project directory; hidden directories such as
+ *     .git and .mewo are never watched
+ *   - inotify on Linux, mtime polling elsewhere
+ *   - Files a run writes itself don't trigger the next run: a file that
+ *     changes during a run, and had changed during an earlier run too,
+ *     is taken for the label's output (the first time such a file
+ *     appears costs one extra run). Editing it between runs makes it an
+ *     input again
+ *   - Changes are debounced (--debounce) so a burst of saves is one rerun
+ *   - The parsed AST is kept in memory; the Mewofile is only reparsed
+ *     when it changes itself
+ *   - A change during a run either queues one rerun, or with
+ *     --watch-restart cancels the running build and starts over
+ */
+
+/* Note: This file is included from main.c which provides:
+ *   - stdio.h, stdlib.h, string.h, stdbool.h
+ *   - execute_and_cleanup() from exec.c
+ *   - interpolate() from vars.c
+ *   - nob.h utilities
+ *   - events_finish() from events.c
+ */
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#define WATCH_POLL_MS 250
+#define WATCH_KILL_GRACE_MS 2000
+
+#ifndef _WIN32
+static volatile sig_atomic_t g_watch_stop = 0;
+
+static void watch_on_signal(int sig) {
+    (void)sig;
+    g_watch_stop = 1;
+}
+#endif
+
+typedef AST* (*Watch_Load_Func)(const char* mewofile);
+
+typedef struct {
+    char** items;
+    size_t count;
+    size_t capacity;
+} WatchPaths;
+
+static void watch_paths_add(WatchPaths* paths, const char* path) {
+    for (size_t i = 0; i < paths->count; i++) {
+        if (strcmp(paths->items[i], path) == 0) return;
+    }
+    if (paths->count >= paths->capacity) {
+        size_t new_cap = paths->capacity == 0 ? 16 : paths->capacity * 2;
+        char** new_items = realloc(paths->items, new_cap * sizeof(char*));
+        if (!new_items) return;
+        paths->items = new_items;
+        paths->capacity = new_cap;
+    }
+    paths->items[paths->count++] = str_dup(path);
+}
+
+static bool watch_same_path(const char* a, const char* b) {
+    while (a[0] == '.' && a[1] == '/') a += 2;
+    while (b[0] == '.' && b[1] == '/') b += 2;
+    return strcmp(a, b) == 0;
+}
+
+static bool watch_paths_contains(WatchPaths* paths, const char* path) {
+    for (size_t i = 0; i < paths->count; i++) {
+        if (watch_same_path(paths->items[i], path)) return true;
+    }
+    return false;
+}
+
+static void watch_paths_remove(WatchPaths* paths, const char* path) {
+    for (size_t i = 0; i < paths->count; i++) {
+        if (watch_same_path(paths->items[i], path)) {
+            free(paths->items[i]);
+            paths->items[i] = paths->items[--paths->count];
+            return;
+        }
+    }
+}
+
+static void watch_paths_free(WatchPaths* paths) {
+    for (size_t i = 0; i < paths->count; i++) {
+        free(paths->items[i]);
+    }
+    free(paths->items);
+    memset(paths, 0, sizeof(WatchPaths));
+}
+
+static void watch_add_pattern(WatchPaths* paths, const char* pattern) {
+#ifndef _WIN32
+    if (strpbrk(pattern, "*?[")) {
+        glob_t g;
+        if (glob(pattern, 0, NULL, &g) == 0) {
+            for (size_t i = 0; i < g.gl_pathc; i++) {
+                watch_paths_add(paths, g.gl_pathv[i]);
+            }
+        }
+        globfree(&g);
+        return;
+    }
+#endif
+    watch_paths_add(paths, pattern);
+}
+
+/*
+ * Collect the paths named by every #watch(...) in the Mewofile.
+ * Without any, the current directory is watched.
+ */
+static void watch_collect(AST* ast, const char* mewofile, WatchPaths* paths) {
+    for (size_t i = 0; i < ast->stmts_count; i++) {
+        Stmt* stmt = ast->stmts[i];
+        if (stmt->type != STMT_ATTR || strcmp(stmt->attr.name, "watch") != 0) continue;
+
+        for (int p = 0; p < stmt->attr.param_count; p++) {
+            const char* raw = stmt->attr.parameters[p]->command.raw_line;
+            char* value = interpolate(raw, stmt->line_number);
+            if (!value) {
+                clear_error();
+                value = str_dup(raw);
+            }
+            watch_add_pattern(paths, value);
+            free(value);
+        }
+    }
+
+    if (paths->count == 0) watch_paths_add(paths, ".");
+    watch_paths_add(paths, mewofile);
+}
+
+static bool watch_ignored_name(const char* name) {
+    size_t len = strlen(name);
+    if (len == 0) return true;
+    if (name[0] == '.' && strcmp(name, ".") != 0 && strcmp(name, "..") != 0) return true;
+    return name[len - 1] == '~';
+}
+
+/* ---- Change detection ---- */
+
+/* One file of the polled tree */
+typedef struct {
+    char* path;
+    long long mtime_ns;
+    long long size;
+} WatchStat;
+
+typedef struct {
+    WatchStat* items;
+    size_t count;
+    size_t capacity;
+} WatchSnapshot;
+
+typedef struct {
+#ifdef __linux__
+    int fd;
+    struct {
+        int* wds;
+        char** dirs;
+        bool* recursive;
+        size_t count;
+        size_t capacity;
+    } watches;
+#endif
+    WatchPaths files;
+    const char* mewofile;
+    WatchSnapshot snapshot;     /* when polling */
+    bool mewofile_changed;
+
+    bool running;               /* changes now are made by the run, or meanwhile by someone else */
+    WatchPaths run_changes;     /* what changed during the current run */
+    WatchPaths written;         /* what changed during earlier runs: their outputs */
+} Watcher;
+
+static bool watch_snapshot_visit(Nob_Walk_Entry entry) {
+    if (entry.level > 0 && watch_ignored_name(nob_path_name(entry.path))) {
+        *entry.action = NOB_WALK_SKIP;
+        return true;
+    }
+    if (entry.type == NOB_FILE_DIRECTORY) return true;
+
+    struct stat st;
+    if (stat(entry.path, &st) < 0) return true;
+
+    long long mtime_ns = (long long)st.st_mtime * 1000000000LL;
+#if defined(__APPLE__)
+    mtime_ns += st.st_mtimespec.tv_nsec;
+#elif !defined(_WIN32)
+    mtime_ns += st.st_mtim.tv_nsec;
+#endif
+    WatchStat file = { .path = str_dup(entry.path), .mtime_ns = mtime_ns, .size = (long long)st.st_size };
+    da_append((WatchSnapshot*)entry.data, file);
+    return true;
+}
+
+static int watch_stat_compare(const void* a, const void* b) {
+    return strcmp(((const WatchStat*)a)->path, ((const WatchStat*)b)->path);
+}
+
+static void watch_snapshot_free(WatchSnapshot* snapshot) {
+    for (size_t i = 0; i < snapshot->count; i++) {
+        free(snapshot->items[i].path);
+    }
+    free(snapshot->items);
+    memset(snapshot, 0, sizeof(WatchSnapshot));
+}
+
+static void watch_snapshot_take(WatchPaths* paths, WatchSnapshot* snapshot) {
+    for (size_t i = 0; i < paths->count; i++) {
+        if (!nob_file_exists(paths->items[i])) continue;
+        nob_walk_dir(paths->items[i], watch_snapshot_visit, .data = snapshot);
+    }
+    qsort(snapshot->items, snapshot->count, sizeof(WatchStat), watch_stat_compare);
+}
+
+/*
+ * A change to `path` was seen. Returns whether it should cause a run:
+ * not when an earlier run wrote the file and this is the current run
+ * writing it again.
+ */
+static bool watcher_note_change(Watcher* w, const char* path) {
+    bool relevant = true;
+    if (w->running) {
+        relevant = !watch_paths_contains(&w->written, path);
+        watch_paths_add(&w->run_changes, path);
+    } else {
+        /* Changed by someone else than the runs: an input after all */
+        watch_paths_remove(&w->written, path);
+    }
+
+    if (relevant && watch_same_path(path, w->mewofile)) {
+        w->mewofile_changed = true;
+    }
+    if (relevant) nob_log(NOB_INFO, "Changed: %s", path);
+    return relevant;
+}
+
+#ifdef __linux__
+
+#define WATCH_DIR_EVENTS (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+static void watcher_add_dir(Watcher* w, const char* dir, bool recursive) {
+    int wd = inotify_add_watch(w->fd, dir, WATCH_DIR_EVENTS | IN_ONLYDIR);
+    if (wd < 0) {
+        nob_log(NOB_WARNING, "Could not watch %s: %s", dir, strerror(errno));
+        return;
+    }
+
+    for (size_t i = 0; i < w->watches.count; i++) {
+        if (w->watches.wds[i] == wd) {
+            if (recursive) w->watches.recursive[i] = true;
+            return;
+        }
+    }
+
+    if (w->watches.count >= w->watches.capacity) {
+        size_t new_cap = w->watches.capacity == 0 ? 64 : w->watches.capacity * 2;
+        w->watches.wds = realloc(w->watches.wds, new_cap * sizeof(int));
+        w->watches.dirs = realloc(w->watches.dirs, new_cap * sizeof(char*));
+        w->watches.recursive = realloc(w->watches.recursive, new_cap * sizeof(bool));
+        w->watches.capacity = new_cap;
+    }
+    w->watches.wds[w->watches.count] = wd;
+    w->watches.dirs[w->watches.count] = str_dup(dir);
+    w->watches.recursive[w->watches.count] = recursive;
+    w->watches.count++;
+}
+
+static bool watch_add_tree_visit(Nob_Walk_Entry entry) {
+    if (entry.type != NOB_FILE_DIRECTORY) return true;
+    if (entry.level > 0 && watch_ignored_name(nob_path_name(entry.path))) {
+        *entry.action = NOB_WALK_SKIP;
+        return true;
+    }
+    watcher_add_dir(entry.data, entry.path, true);
+    return true;
+}
+
+static int watcher_find(Watcher* w, int wd) {
+    for (size_t i = 0; i < w->watches.count; i++) {
+        if (w->watches.wds[i] == wd) return (int)i;
+    }
+    return -1;
+}
+
+#endif
+
+static bool watcher_init(Watcher* w, WatchPaths* paths, const char* mewofile) {
+    memset(w, 0, sizeof(Watcher));
+    w->mewofile = mewofile;
+
+    for (size_t i = 0; i < paths->count; i++) {
+        watch_paths_add(&w->files, paths->items[i]);
+    }
+
+#ifdef __linux__
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd < 0) {
+        nob_log(NOB_WARNING, "inotify unavailable (%s), polling for changes", strerror(errno));
+    } else {
+        for (size_t i = 0; i < paths->count; i++) {
+            const char* path = paths->items[i];
+            if (!nob_file_exists(path)) continue;
+
+            if (nob_get_file_type(path) == NOB_FILE_DIRECTORY) {
+                nob_walk_dir(path, watch_add_tree_visit, .data = w);
+            } else {
+                char* dir = nob_temp_dir_name(path);
+                watcher_add_dir(w, dir, false);
+            }
+        }
+        return true;
+    }
+#endif
+
+    watch_snapshot_take(&w->files, &w->snapshot);
+    return true;
+}
+
+static void watcher_free(Watcher* w) {
+#ifdef __linux__
+    if (w->fd >= 0) close(w->fd);
+    for (size_t i = 0; i < w->watches.count; i++) {
+        free(w->watches.dirs[i]);
+    }
+    free(w->watches.wds);
+    free(w->watches.dirs);
+    free(w->watches.recursive);
+#endif
+    watch_paths_free(&w->files);
+    watch_snapshot_free(&w->snapshot);
+    watch_paths_free(&w->run_changes);
+    watch_paths_free(&w->written);
+}
+
+/*
+ * Compare the polled tree with the last snapshot.
+ */
+static bool watcher_poll_changes(Watcher* w) {
+    WatchSnapshot now = {0};
+    watch_snapshot_take(&w->files, &now);
+
+    bool changed = false;
+    size_t i = 0, j = 0;
+    while (i < w->snapshot.count || j < now.count) {
+        int cmp = i == w->snapshot.count ? 1 : j == now.count ? -1 :
+                  strcmp(w->snapshot.items[i].path, now.items[j].path);
+        if (cmp < 0) {
+            changed = watcher_note_change(w, w->snapshot.items[i].path) || changed;
+            i++;
+        } else if (cmp > 0) {
+            changed = watcher_note_change(w, now.items[j].path) || changed;
+            j++;
+        } else {
+            if (w->snapshot.items[i].mtime_ns != now.items[j].mtime_ns || w->snapshot.items[i].size != now.items[j].size) {
+                changed = watcher_note_change(w, now.items[j].path) || changed;
+            }
+            i++;
+            j++;
+        }
+    }
+
+    watch_snapshot_free(&w->snapshot);
+    w->snapshot = now;
+    return changed;
+}
+
+/*
+ * Wait up to `timeout_ms` (-1 = forever) for a change.
+ * Returns true if something relevant changed.
+ */
+static bool watcher_wait(Watcher* w, int timeout_ms) {
+#ifdef __linux__
+    if (w->fd >= 0) {
+        struct pollfd pfd = { .fd = w->fd, .events = POLLIN };
+        int n = poll(&pfd, 1, timeout_ms);
+        if (n <= 0) return false;
+
+        bool changed = false;
+        char buf[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+        for (;;) {
+            ssize_t len = read(w->fd, buf, sizeof(buf));
+            if (len <= 0) break;
+
+            for (char* p = buf; p < buf + len;) {
+                struct inotify_event* ev = (struct inotify_event*)p;
+                p += sizeof(struct inotify_event) + ev->len;
+
+                int idx = watcher_find(w, ev->wd);
+                if (idx < 0 || ev->len == 0) continue;
+                if (watch_ignored_name(ev->name)) continue;
+
+                size_t mark = temp_save();
+                const char* path = temp_sprintf("%s/%s", w->watches.dirs[idx], ev->name);
+
+                bool relevant = w->watches.recursive[idx];
+                for (size_t i = 0; i < w->files.count && !relevant; i++) {
+                    relevant = watch_same_path(path, w->files.items[i]);
+                }
+                if (relevant && w->watches.recursive[idx] && (ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO))) {
+                    nob_walk_dir(path, watch_add_tree_visit, .data = w);
+                }
+                if (relevant && watcher_note_change(w, path)) changed = true;
+                temp_rewind(mark);
+            }
+        }
+        return changed;
+    }
+#endif
+
+    uint64_t elapsed = 0;
+    for (;;) {
+        if (watcher_poll_changes(w)) return true;
+        if (timeout_ms >= 0 && elapsed >= (uint64_t)timeout_ms) return false;
+        int step = timeout_ms >= 0 && timeout_ms - (int)elapsed < WATCH_POLL_MS ? timeout_ms - (int)elapsed : WATCH_POLL_MS;
+        if (step <= 0) return false;
+#ifdef _WIN32
+        Sleep(step);
+#else
+        usleep(step * 1000);
+        /* Ctrl-C or SIGTERM: give execute_watch's loop the chance to stop */
+        if (g_watch_stop) return false;
+#endif
+        elapsed += step;
+    }
+}
+
+static void watcher_begin_run(Watcher* w) {
+    w->running = true;
+}
+
+/*
+ * The run is over: pick up the changes it made that weren't seen yet,
+ * and remember them as outputs. Returns whether anything else changed
+ * meanwhile.
+ */
+static bool watcher_end_run(Watcher* w) {
+    bool changed = watcher_wait(w, 0);
+    w->running = false;
+
+    for (size_t i = 0; i < w->run_changes.count; i++) {
+        if (!watch_paths_contains(&w->written, w->run_changes.items[i])) {
+            watch_paths_add(&w->written, w->run_changes.items[i]);
+        }
+    }
+    watch_paths_free(&w->run_changes);
+    return changed;
+}
+
+/* ---- Runs ---- */
+
+typedef struct {
+    const char* label;
+    bool dry_run;
+    bool echo;
+    const char* shell;
+    const char** enabled;
+    size_t enabled_count;
+    const char** disabled;
+    size_t disabled_count;
+    const char* mewofile;
+} WatchRun;
+
+static bool watch_run_once(AST* ast, WatchRun* run) {
+    return execute_and_cleanup(ast, run->label, run->dry_run, run->echo, run->shell,
+                               run->enabled, run->enabled_count,
+                               run->disabled, run->disabled_count);
+}
+
+static void watch_report(bool ok, uint64_t start_ns) {
+    double secs = (double)(nob_nanos_since_unspecified_epoch() - start_ns) / NOB_NANOS_PER_SEC;
+    printf("[watch] %s in %.2fs, waiting for changes...\n", ok ? "Finished" : "Failed", secs);
+    fflush(stdout);
+}
+
+#ifndef _WIN32
+
+static pid_t watch_start(AST* ast, WatchRun* run) {
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        nob_log(NOB_ERROR, "Could not fork: %s", strerror(errno));
+        return -1;
+    }
+    if (pid == 0) {
+        setpgid(0, 0);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+
+        bool ok = watch_run_once(ast, run);
+        if (!ok && has_error()) print_error(run->mewofile, stderr);
+        fflush(stdout);
+        fflush(stderr);
+        events_finish();
+        _exit(ok ? 0 : 1);
+    }
+    setpgid(pid, pid);
+    return pid;
+}
+
+/*
+ * Stop a running build: SIGTERM to its whole process group, then
+ * SIGKILL if it is still alive after a grace period.
+ */
+static void watch_cancel(pid_t pid) {
+    kill(-pid, SIGTERM);
+    for (int waited = 0; waited < WATCH_KILL_GRACE_MS; waited += 50) {
+        if (waitpid(pid, NULL, WNOHANG) == pid) return;
+        usleep(50 * 1000);
+    }
+    kill(-pid, SIGKILL);
+    while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {}
+}
+
+#endif
+
+/*
+ * Run `label` now and again every time a watched file changes, until
+ * interrupted. `load` reparses the Mewofile when it changes.
+ */
+bool execute_watch(AST* ast, const char* label, bool dry_run, bool echo, const char* shell,
+                   const char** enabled_features, size_t enabled_count,
+                   const char** disabled_features, size_t disabled_count,
+                   const char* mewofile, size_t debounce_ms, bool restart, Watch_Load_Func load) {
+    WatchRun run = {
+        .label = label, .dry_run = dry_run, .echo = echo, .shell = shell,
+        .enabled = enabled_features, .enabled_count = enabled_count,
+        .disabled = disabled_features, .disabled_count = disabled_count,
+        .mewofile = mewofile,
+    };
+
+    WatchPaths paths = {0};
+    watch_collect(ast, mewofile, &paths);
+    Watcher watcher;
+    watcher_init(&watcher, &paths, mewofile);
+    printf("[watch] Watching %zu path%s, press Ctrl-C to stop\n", paths.count, paths.count == 1 ? "" : "s");
+    watch_paths_free(&paths);
+
+#ifdef _WIN32
+    (void)restart;
+    for (;;) {
+        uint64_t start_ns = nob_nanos_since_unspecified_epoch();
+        Variables snap = vars_snapshot();
+        watcher_begin_run(&watcher);
+        bool ok = watch_run_once(ast, &run);
+        bool changed = watcher_end_run(&watcher);
+        vars_restore(&snap);
+        if (!ok && has_error()) print_error(mewofile, stderr);
+        clear_error();
+        watch_report(ok, start_ns);
+
+        if (!changed) {
+            while (!watcher_wait(&watcher, -1)) {}
+        }
+        while (watcher_wait(&watcher, (int)debounce_ms)) {}
+
+        if (watcher.mewofile_changed) {
+            watcher.mewofile_changed = false;
+            AST* fresh = load(mewofile);
+            if (fresh) {
+                free_ast(ast);
+                ast = fresh;
+            }
+        }
+    }
+#else
+    signal(SIGINT, watch_on_signal);
+    signal(SIGTERM, watch_on_signal);
+
+    uint64_t start_ns = nob_nanos_since_unspecified_epoch();
+    watcher_begin_run(&watcher);
+    pid_t child = watch_start(ast, &run);
+    bool pending = false;
+
+    while (!g_watch_stop) {
+        bool changed = watcher_wait(&watcher, child > 0 ? 100 : -1);
+
+        if (child > 0) {
+            int wstatus = 0;
+            pid_t done = waitpid(child, &wstatus, WNOHANG);
+            if (done == child) {
+                child = -1;
+                if (watcher_end_run(&watcher)) changed = true;
+                watch_report(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0, start_ns);
+            }
+        }
+
+        if (changed) {
+            while (!g_watch_stop && watcher_wait(&watcher, (int)debounce_ms)) {}
+            pending = true;
+
+            if (watcher.mewofile_changed) {
+                watcher.mewofile_changed = false;
+                AST* fresh = load(mewofile);
+                if (fresh) {
+                    if (child > 0) {
+                        watch_cancel(child);
+                        watcher_end_run(&watcher);
+                    }
+                    child = -1;
+                    free_ast(ast);
+                    ast = fresh;
+
+                    /* The outputs of the last run are still outputs */
+                    WatchPaths written = watcher.written;
+                    memset(&watcher.written, 0, sizeof(WatchPaths));
+                    watcher_free(&watcher);
+                    watch_collect(ast, mewofile, &paths);
+                    watcher_init(&watcher, &paths, mewofile);
+                    watcher.written = written;
+                    watch_paths_free(&paths);
+                } else {
+                    if (has_error()) print_error(mewofile, stderr);
+                    clear_error();
+                    pending = false;
+                }
+            }
+
+            if (child > 0 && restart && pending) {
+                printf("[watch] Change detected, restarting\n");
+                fflush(stdout);
+                watch_cancel(child);
+                watcher_end_run(&watcher);
+                child = -1;
+            }
+        }
+
+        if (pending && child <= 0 && !g_watch_stop) {
+            pending = false;
+            start_ns = nob_nanos_since_unspecified_epoch();
+            watcher_begin_run(&watcher);
+            child = watch_start(ast, &run);
+        }
+    }
+
+    if (child > 0) watch_cancel(child);
+    printf("\n[watch] Stopped\n");
+#endif
+
+    watcher_free(&watcher);
+    free_ast(ast);
+    return true;
+}